@@ -19,6 +19,12 @@ if [ ! -z "${VERBOSE}" ]; then
     verbose=${VERBOSE}
 fi
 
+# training batches in flight. Layers on different threads overlap when > 1
+pipeline=1
+if [ ! -z "${PIPELINE_DEPTH}" ]; then
+    pipeline=${PIPELINE_DEPTH}
+fi
+
 if [ $largesim -eq 0 ]; then
     echo "Running small simulation"
     cmd="sst ../test-image.py ${SSTOPTS} -- \
@@ -28,6 +34,7 @@ if [ $largesim -eq 0 ]; then
         --evalImages="${IMAGE_DATA}/eval" \
         --hiddenLayerSize=128 \
         --initialWeightScaling=0.01 \
+        --pipelineDepth=${pipeline} \
         --testImages="${IMAGE_DATA}/fashion_mnist_images/test" \
         --trainingImages="${IMAGE_DATA}/fashion_mnist_images/train" \
         --verbose=${verbose}"
@@ -39,6 +46,7 @@ else
         --evalImages="${IMAGE_DATA}/eval" \
         --hiddenLayerSize=128 \
         --initialWeightScaling=0.01 \
+        --pipelineDepth=${pipeline} \
         --testImages="${IMAGE_DATA}/fashion_mnist_images/test" \
         --trainingImages="${IMAGE_DATA}/fashion_mnist_images/train" \
         --verbose=${verbose}"
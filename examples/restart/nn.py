@@ -18,11 +18,18 @@ parser = argparse.ArgumentParser(description="neural net demo")
 parser.add_argument("--batchSize",            type=int,   help="number of images for each training batch", default=128)
 parser.add_argument("--classImageLimit",      type=int,   help="limited the number of images loaded per class", default=100000)
 parser.add_argument("--epochs",               type=int,   help="number of training rounds", default=1)
+parser.add_argument("--evalBatchSize",        type=int,   help="number of images for each evaluation batch", default=1)
 parser.add_argument("--evalImage",            type=str,   help="path to a single evaluation image", default="")
 parser.add_argument("--evalImages",           type=str,   help="path to a collection of evaluation images", default="")
+parser.add_argument("--fuseReLU",             type=int,   help="fuse each hidden dense layer with its ReLU activation", default=0)
+parser.add_argument("--fuseSoftmaxLoss",      type=int,   help="fuse the softmax activation into the cross-entropy loss", default=0)
+parser.add_argument("--gemmThreads",          type=int,   help="threads for each dense layer's matrix products", default=1)
 parser.add_argument("--hiddenLayers",         type=int,   help="number of hidden layers (3 minimum)", default=3)
 parser.add_argument("--hiddenLayerSize",      type=int,   help="number of neurons in each hidden layer", default=128)
 parser.add_argument("--initialWeightScaling", type=float, help="scaling factor for random weights", default=0.1)
+parser.add_argument("--pipelineDepth",        type=int,   help="training batches in flight (1 waits for each backward pass)", default=1)
+parser.add_argument("--prefetchDepth",        type=int,   help="training batches gathered ahead on a background thread", default=0)
+parser.add_argument("--shuffleSeed",          type=int,   help="seed for reshuffling the training images each epoch (0 keeps the load order)", default=0)
 parser.add_argument("--testImages",           type=str,   help="path to test data organized in class subdirectories", default="")
 parser.add_argument("--trainingImages",       type=str,   help="path to training data organized in class subdirectories", default="")
 parser.add_argument("--verbose",              type=int,   help="verbosity", default=1)
@@ -45,8 +52,12 @@ batch_controller_params = {
   "batchSize" : args.batchSize,
   "classImageLimit" : args.classImageLimit,
   "epochs" : args.epochs,
+  "evalBatchSize" : args.evalBatchSize,
   "evalImage" : args.evalImage,
   "evalImages" : args.evalImages,
+  "pipelineDepth" : args.pipelineDepth,
+  "prefetchDepth" : args.prefetchDepth,
+  "shuffleSeed" : args.shuffleSeed,
   "testImages" : args.testImages,
   "trainingImages" : args.trainingImages,
   "verbose" : args.verbose,
@@ -64,12 +75,13 @@ optimizer_params = {
 }
 
 class DenseLayer():
-  def __init__(self, name, inputs, neurons):
+  def __init__(self, name, inputs, neurons, transfer="neuralnet.NNDenseLayer"):
     self.comp =  sst.Component(name,  "neuralnet.NNLayer")
     self.transfer_function = self.comp.setSubComponent( 
-      "transfer_function", "neuralnet.NNDenseLayer" )
+      "transfer_function", transfer )
     self.transfer_function.addParams({ 
       "nInputs" : inputs, "nNeurons" : neurons,
+      "gemmThreads" : args.gemmThreads,
       "initialWeightScaling" : args.initialWeightScaling,
       "verbose" : args.verbose })
     self.optimizer = self.comp.setSubComponent(
@@ -93,7 +105,7 @@ class Softmax():
     self.tranfer_function.addParams( {"verbose" : args.verbose} )
 
 class Loss_CategoricalCrossEntropy:
-  def __init__(self, name):
+  def __init__(self, name, loss="neuralnet.NNLoss_CategoricalCrossEntropy"):
     self.comp = sst.Component(name,    "neuralnet.NNLayer")
     self.comp.addParams({ 
       "lastComponent" : 1,
@@ -102,7 +114,7 @@ class Loss_CategoricalCrossEntropy:
     self.transfer_function.addParams({ "verbose" : args.verbose })
     self.accuracy_function = self.comp.setSubComponent( "accuracy_function", "neuralnet.NNAccuracyCategorical")
     self.accuracy_function.addParams( {"verbose" : args.verbose} );
-    self.loss_function = self.comp.setSubComponent( "loss_function", "neuralnet.NNLoss_CategoricalCrossEntropy")
+    self.loss_function = self.comp.setSubComponent( "loss_function", loss)
     self.loss_function.addParams( {"verbose" : args.verbose} )
     self.optimizer = self.comp.setSubComponent( "optimizer", "neuralnet.NNAdamOptimizer" )
     self.optimizer.addParams( optimizer_params )
@@ -122,16 +134,26 @@ input.setSubComponent("transfer_function", "neuralnet.NNInputLayer")
 comps.append(input)
 
 # Hidden Layers
-comps.append(DenseLayer("dense1", image_size, args.hiddenLayerSize).comp)
-comps.append(ReLU("relu1").comp)
+# With fuseReLU each dense/relu component pair becomes one component
+def HiddenLayer(i, inputs, neurons):
+  if args.fuseReLU:
+    comps.append(DenseLayer(f"dense{i}", inputs, neurons, "neuralnet.NNDenseReLULayer").comp)
+  else:
+    comps.append(DenseLayer(f"dense{i}", inputs, neurons).comp)
+    comps.append(ReLU(f"relu{i}").comp)
+
+HiddenLayer(1, image_size, args.hiddenLayerSize)
 for i in range(2, args.hiddenLayers):
-  comps.append(DenseLayer(f"dense{i}", args.hiddenLayerSize, args.hiddenLayerSize).comp)
-  comps.append(ReLU(f"relu{i}").comp)
+  HiddenLayer(i, args.hiddenLayerSize, args.hiddenLayerSize)
 comps.append(DenseLayer(f"dense{args.hiddenLayers}", args.hiddenLayerSize, 10).comp)
 
 # Output Layers
-comps.append(Softmax("softmax").comp)
-comps.append(Loss_CategoricalCrossEntropy("loss").comp)
+# With fuseSoftmaxLoss the loss component takes the logits directly
+if args.fuseSoftmaxLoss:
+  comps.append(Loss_CategoricalCrossEntropy("loss", "neuralnet.NNLoss_SoftmaxCategoricalCrossEntropy").comp)
+else:
+  comps.append(Softmax("softmax").comp)
+  comps.append(Loss_CategoricalCrossEntropy("loss").comp)
 
 # Connections
 for i in range(len(comps)):
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+#
+# Mid-training restart. Train once straight through, then again with
+# checkpoints, and restart from the first checkpoint. The restarted run
+# must print the same epoch results and predictions as the tail of the
+# uninterrupted run. The ctest version is test/neuralnet/nn-restart.sh.
+#
+
+# clean up old checkpoints and logs
+rm -rf cpt-training*
+
+IMAGE_DATA=$(realpath "../../image_data")
+
+NNOPTS="--classImageLimit=200 \
+    --batchSize=128 \
+    --epochs=4 \
+    --evalImages=${IMAGE_DATA}/eval \
+    --hiddenLayerSize=128 \
+    --initialWeightScaling=0.01 \
+    --prefetchDepth=2 \
+    --shuffleSeed=7 \
+    --testImages=${IMAGE_DATA}/fashion_mnist_images/test \
+    --trainingImages=${IMAGE_DATA}/fashion_mnist_images/train \
+    --verbose=2"
+
+results() {
+    grep -E "epoch [0-9]+ (training|validation):|Survey says" $1
+}
+
+cmd="sst nn.py -- ${NNOPTS}"
+echo $cmd
+$cmd > cpt-training.ref.log || exit 1
+
+cmd="sst nn.py --checkpoint-period=100us --checkpoint-prefix=cpt-training -- ${NNOPTS}"
+echo $cmd
+$cmd > cpt-training.save.log || exit 2
+
+cpt=$(find cpt-training -name "*.sstcpt" | sort -V | head -1)
+cmd="sst --load-checkpoint ${cpt}"
+echo $cmd
+$cmd > cpt-training.restart.log || exit 3
+
+results cpt-training.restart.log > cpt-training.restart.txt
+grep -q "training:" cpt-training.restart.txt || { echo "error: ${cpt} was not taken during training"; exit 4; }
+results cpt-training.ref.log | tail -n $(wc -l < cpt-training.restart.txt) | diff - cpt-training.restart.txt || exit 5
+echo "restarted run matches the uninterrupted run"
@@ -18,6 +18,7 @@ sst-register -u dbgcli
 sst-register -u gridtest
 sst-register -u NNBatchController
 sst-register -u NNLayer
+sst-register -u NNFusedNetwork
 sst-register -u NNInputLayer
 sst-register -u NNDenseLayer
 sst-register -u NNActivationReLULayer
@@ -43,6 +44,7 @@ if test -f "$CONFIG"; then
   sed -i.bak '/gridtest/d' $CONFIG
   sed -i.bak '/NNBatchController/d' $CONFIG
   sed -i.bak '/NNLayer/d' $CONFIG
+  sed -i.bak '/NNFusedNetwork/d' $CONFIG
   sed -i.bak '/NNInputLayer/d' $CONFIG
   sed -i.bak '/NNDenseLayer/d' $CONFIG
   sed -i.bak '/NNActivationReLULayer/d' $CONFIG
@@ -0,0 +1,215 @@
+//
+// _readprobe_cc_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+// Decoder for the binary probe files written by the debug probe flush2file
+// action (see sstcomp/dbgcli/probe_file.h). Text output follows the probe's
+// stdout dump; CSV output has one row per record.
+//
+// usage: readprobe [-csv] probe-file...
+//
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "probe_file.h"
+
+using namespace std;
+using namespace SSTDEBUG::Probe;
+
+struct layout_t {
+    uint32_t rec_bytes = 0;
+    vector<probe_field_t> fields;
+};
+
+// Matches ProbeBufCtl::TRIGGER_STATE
+static const char trig2char[] = { '-', '!', '+', 'o' };
+static const uint32_t TRIGREC = 1, TRIGGERED = 2;
+
+static string render_field(const char* rec, const probe_field_t& f)
+{
+    ostringstream os;
+    const char* p = rec + f.offset;
+    switch (static_cast<FIELD_TYPE>(f.type)) {
+    case FIELD_TYPE::UINT: {
+        uint64_t v = 0;
+        memcpy(&v, p, f.size);
+        os << v;
+        break;
+    }
+    case FIELD_TYPE::INT: {
+        int64_t v = 0;
+        if (f.size == 1) { int8_t x; memcpy(&x, p, 1); v = x; }
+        else if (f.size == 2) { int16_t x; memcpy(&x, p, 2); v = x; }
+        else if (f.size == 4) { int32_t x; memcpy(&x, p, 4); v = x; }
+        else memcpy(&v, p, 8);
+        os << v;
+        break;
+    }
+    case FIELD_TYPE::FLOAT: {
+        if (f.size == 4) { float x; memcpy(&x, p, 4); os << x; }
+        else { double x; memcpy(&x, p, 8); os << x; }
+        break;
+    }
+    default:
+        os << hex << setfill('0');
+        for (unsigned i = 0; i < f.size; i++)
+            os << setw(2) << unsigned(uint8_t(p[i]));
+        break;
+    }
+    return os.str();
+}
+
+static string render_rec(const char* rec, const layout_t& l, bool csv)
+{
+    string s;
+    for (size_t i = 0; i < l.fields.size(); i++) {
+        if (csv) s += ",";
+        else if (i) s += " ";
+        if (!csv) s += string(l.fields[i].name) + "=";
+        s += render_field(rec, l.fields[i]);
+    }
+    return s;
+}
+
+static bool decode(const string& fileName, bool csv, string& csvHeader)
+{
+    ifstream ifs(fileName, ios::binary);
+    if (!ifs.is_open()) {
+        cerr << "Error: Cannot open " << fileName << endl;
+        return false;
+    }
+    vector<char> buf((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    size_t pos = 0;
+    auto take = [&](void* dst, size_t n) {
+        if (pos + n > buf.size()) return false;
+        memcpy(dst, &buf[pos], n);
+        pos += n;
+        return true;
+    };
+
+    probe_file_header_t h;
+    if (!take(&h, sizeof(h)) || memcmp(h.magic, PROBE_FILE_MAGIC, sizeof(h.magic)) != 0) {
+        cerr << "Error: " << fileName << " is not a probe file" << endl;
+        return false;
+    }
+    if (h.version != PROBE_FILE_VERSION) {
+        cerr << "Error: " << fileName << " has unsupported version " << h.version << endl;
+        return false;
+    }
+    if (!csv)
+        cout << "#F " << fileName << " rank=" << h.rank << " thread=" << h.thread << endl;
+
+    map<uint32_t, layout_t> layouts;
+    probe_block_t b;
+    while (pos < buf.size()) {
+        if (!take(&b, sizeof(b)) || pos + b.bytes > buf.size()) {
+            cerr << "Error: " << fileName << " truncated at byte " << pos << endl;
+            return false;
+        }
+        const size_t end = pos + b.bytes;
+        if (b.kind == uint32_t(BLOCK_KIND::LAYOUT)) {
+            probe_layout_t pl;
+            layout_t l;
+            if (!take(&pl, sizeof(pl))) {
+                cerr << "Error: " << fileName << " truncated at byte " << pos << endl;
+                return false;
+            }
+            l.rec_bytes = pl.rec_bytes;
+            l.fields.resize(pl.num_fields);
+            for (auto& f : l.fields) {
+                if (!take(&f, sizeof(f)) || f.offset + f.size > l.rec_bytes ||
+                    (f.type != uint16_t(FIELD_TYPE::RAW) && f.size > 8)) {
+                    cerr << "Error: " << fileName << " bad record layout " << pl.id << endl;
+                    return false;
+                }
+                f.name[sizeof(f.name) - 1] = 0;
+            }
+            layouts[pl.id] = l;
+        } else if (b.kind == uint32_t(BLOCK_KIND::DATA)) {
+            probe_data_t d;
+            if (!take(&d, sizeof(d)) || pos + d.name_len > end || layouts.count(d.layout) == 0) {
+                cerr << "Error: " << fileName << " bad data block at byte " << pos << endl;
+                return false;
+            }
+            const layout_t& l = layouts[d.layout];
+            string name(&buf[pos], d.name_len);
+            pos += d.name_len;
+            if (pos + (d.has_trigger_rec ? l.rec_bytes : 0) + d.num_recs * (8 + l.rec_bytes) > end) {
+                cerr << "Error: " << fileName << " truncated records for " << name << endl;
+                return false;
+            }
+            if (csv) {
+                // new header row whenever the record layout changes
+                string header = "component,flush_cycle,seq,tag";
+                for (const auto& f : l.fields) header += string(",") + f.name;
+                if (header != csvHeader) cout << header << endl;
+                csvHeader = header;
+            }
+            if (!csv) {
+                cout << "#C " << name << " flushed at cycle " << d.cycle << endl;
+                cout << "#I " << d.num_recs << " records" << endl;
+            }
+            if (d.has_trigger_rec) {
+                if (!csv && d.num_recs) {
+                    cout << "#I saved trigger due to buffer overflow\n";
+                    cout << "#T " << render_rec(&buf[pos], l, false) << endl;
+                    if (d.samples_lost > 0)
+                        cout << "# records discarded " << d.samples_lost << endl;
+                }
+                pos += l.rec_bytes;
+            }
+            for (uint64_t i = 0; i < d.num_recs; i++) {
+                uint64_t hdr = 0;
+                take(&hdr, sizeof(hdr));
+                const uint32_t tag = uint32_t(hdr & 3);
+                if (csv) {
+                    cout << name << "," << d.cycle << "," << (hdr >> 2) - 1 << "," << trig2char[tag]
+                         << render_rec(&buf[pos], l, true) << endl;
+                } else {
+                    char pfx = (d.trig_state == TRIGGERED && tag == TRIGREC) ? 'T' : ' ';
+                    cout << "#" << pfx << " " << render_rec(&buf[pos], l, false) << endl;
+                }
+                pos += l.rec_bytes;
+            }
+        }
+        // skip anything this version does not know about
+        pos = end;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    // parse command line
+    bool csv = false;
+    int first = 1;
+    if (argc > 1 && string(argv[1]) == "-csv") {
+        csv = true;
+        first = 2;
+    }
+    if (first >= argc) {
+        cout << "Usage: readprobe [-csv] probe-file..." << endl;
+        return 1;
+    }
+
+    string csvHeader;
+    for (int i = first; i < argc; i++)
+        if (!decode(argv[i], csv, csvHeader))
+            return 1;
+    return 0;
+}
+
+// EOF
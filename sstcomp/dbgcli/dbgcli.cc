@@ -78,11 +78,18 @@ DbgCLI::DbgCLI(SST::ComponentId_t id, const SST::Params& params ) :
   int probePort       = params.find<int>("probePort", 0);
   int probePostDelay  = params.find<int>("probePostDelay", 0);
   uint64_t cliControl = params.find<uint64_t>("cliControl", 0);
+  std::string probeFile = params.find<std::string>("probeFile", "");
+  std::string probeTrigger = params.find<std::string>("probeTrigger", "");
   // Create Probe
   probe_ = std::make_unique<DbgCLI_Probe>(
           this, &output, probeMode, 
           probeStartCycle, probeEndCycle, probeBufferSize, 
           probePort, probePostDelay, cliControl);
+  if (probeMode && !probeFile.empty())
+    probe_->setFlushFile(probeFile, getRank().rank, getRank().thread);
+  std::string triggerError;
+  if (probeMode && !probe_->setTrigger(probeTrigger, triggerError))
+    output.fatal(CALL_INFO, -1, "probeTrigger: %s\n", triggerError.c_str());
 
   // constructor completeå
   output.verbose( CALL_INFO, 5, 0, "Constructor complete\n" );
@@ -211,15 +218,22 @@ DbgCLI_Probe::DbgCLI_Probe(SST::Component * comp, SST::Output * out,
  : ProbeControl(comp, out, mode, startCycle, endCycle, bufferSize, port, postDelay, cliControl)
 {
   probeBuffer = std::make_shared<ProbeBuffer<event_atts_t>>(bufferSize);
+  probeBuffer->setFields({
+    PROBE_FIELD(event_atts_t, cycle_, "cycle"),
+    PROBE_FIELD(event_atts_t, sz_, "sz"),
+    PROBE_FIELD(event_atts_t, deliveryTime_, "deliveryTime"),
+    PROBE_FIELD(event_atts_t, priority_, "priority"),
+    PROBE_FIELD(event_atts_t, orderTag_, "orderTag"),
+    PROBE_FIELD(event_atts_t, queueOrder_, "queueOrder"),
+  });
   setBufferControls(probeBuffer);
 }
 
 void DbgCLI_Probe::capture_event_atts(uint64_t cycle, uint64_t sz, DbgCLIEvent *ev)
 {
   if (! sampling()) return;
-  // copy the sample into the circular buffer  
-  event_atts_t e(cycle, sz, ev);
-  probeBuffer->capture(e);
+  // build the sample in place in the circular buffer
+  probeBuffer->emplace(cycle, sz, ev);
   // Finally call base class to update counters
   ProbeControl::sample();
 }
@@ -117,9 +117,11 @@ public:
     {"probeMode",       "0-Disabled,1-Checkpoint based, >1-rsv",    "0"},
     {"probeStartCycle", "Use with checkpoint-sim-period",           "0"},
     {"probeEndCycle",   "Cycle probing disable. 0 is no limit",     "0"},
-    {"probeBufferSize", "Records in circular trace buffer",      "1024"}, // DEFAULT_PROBE_BUFFER_SIZE
+    {"probeBufferSize", "Records in circular trace buffer (rounded up to a power of 2)", "1024"}, // DEFAULT_PROBE_BUFFER_SIZE
     {"probePostDelay",  "post-trigger delay cycles. -1 to sample until checkpoint", "0"},
     {"probePort",       "Socket assignment for debug port",         "0"},
+    {"probeFile",       "Flush to binary <probeFile>.<rank>.<thread>.prb files instead of stdout", ""},
+    {"probeTrigger",    "Trigger expression over the record fields, e.g. 'sz > 90 && priority == 50'. Empty uses the built-in trigger", ""},
     {"cliControl",  "0x40 every chkpt, 0x20 chkpts when probe active, 0x10 sync state change,\n"
                     "0x04 every probe sample, 0x02 probe samples from trigger onward, 0x01 probe state change"
                     , "0"},
@@ -9,11 +9,25 @@
 // information, see the LICENSE file in the top level directory of the
 // distribution.
 
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+
 #include "probe.h"
 #include "tcldbg.h"
 
 namespace SSTDEBUG::Probe {
 
+// a client closing mid-response must not raise SIGPIPE in the simulator
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
 ProbeControl::ProbeControl( SST::Component * comp, SST::Output * out,
     int mode, SST::SimTime_t startCycle, SST::SimTime_t  endCycle, int bufferSize, 
     int port, int postDelay, uint64_t cliControl) : 
@@ -59,12 +73,17 @@ ProbeControl::ProbeControl( SST::Component * comp, SST::Output * out,
 
 }
 
-ProbeControl::~ProbeControl() {}
+ProbeControl::~ProbeControl()
+{
+    if (probeServer_)
+        probeServer_->detach(this);
+}
 
 void
 ProbeControl::updateSyncState(SST::SimTime_t cycle)
 {
     syncCycle = cycle;
+    publishedCycle_.store(cycle, std::memory_order_relaxed);
     switch (syncState_) {
     case SyncState::WAIT:
         if (cycle >= startCycle_) {
@@ -117,7 +136,10 @@ ProbeControl::updateProbeState(SST::SimTime_t  cycle)
         if ( useDelayCounter_ && (postDelayCounter_ < 0) ) {
             // trigger detected. Indicate flush and wait until sync action clears
             out_->verbose(CALL_INFO,1,0, "Sampling stopped at cycle %" PRId64 "\n", cycle);
-            syncActions_.f.flush2stdout = true;
+            if (probeFile_)
+                syncActions_.f.flush2file = true;
+            else
+                syncActions_.f.flush2stdout = true;
             probeState_ = ProbeState::WAIT;
         }
         break;
@@ -154,10 +176,10 @@ ProbeControl::handleSyncPointActions()
         probeBufCtl_->reset_buffer();
     }
     if (syncActions_.f.flush2file) {
-        out_->verbose(CALL_INFO, 1, 0, "syncAction: flush to file (TODO)\n");
+        out_->verbose(CALL_INFO, 1, 0, "syncAction: flush to file %s\n", probeFile_->fileName().c_str());
         syncActions_.f.flush2file = 0;
-        // TODO 1 file per rank
-        // probeBufCtl_->render_buffer(ofile); 
+        probeBufCtl_->write_block(probeFile_->front(), probeLayout_, comp_->getName(), syncCycle);
+        probeFile_->swap();
         probeBufCtl_->reset_buffer();
     }
     // continuation / stop actions
@@ -196,6 +218,10 @@ ProbeControl::handleSyncPointActions()
 void
 ProbeControl::sample()
 {
+    // a trigger expression fires in capture() and tags the record it holds for
+    if (probeState_ == ProbeState::PRE_SAMPLING && probeBufCtl_->getTrigState() != ProbeBufCtl::CLEAR)
+        triggered();
+
     if (useDelayCounter_ && (probeState_ == ProbeState::POST_SAMPLING))
         postDelayCounter_--;
 
@@ -215,322 +241,723 @@ ProbeControl::trigger(bool cond)
 {
     if (probeState_ != ProbeState::PRE_SAMPLING) 
         return;
+    // a trigger expression replaces the component's condition
+    if (probeBufCtl_->getTrigger())
+        return;
     if (cond) { 
-        out_->verbose(CALL_INFO, 1, 0, "Detected Trigger\n");
-        probeState_ = ProbeState::POST_SAMPLING;
         probeBufCtl_->markAsTriggerRec();
-        if (!useDelayCounter_)
-            out_->verbose(CALL_INFO, 1,0, "Continue sampling\n");
-        else if (postDelayCounter_)
-            out_->verbose(CALL_INFO, 1,0, "Sampling for %d additional samples\n", postDelayCounter_);
+        triggered();
+    }
+}
+
+void
+ProbeControl::triggered()
+{
+    out_->verbose(CALL_INFO, 1, 0, "Detected Trigger\n");
+    probeState_ = ProbeState::POST_SAMPLING;
+    if (!useDelayCounter_)
+        out_->verbose(CALL_INFO, 1,0, "Continue sampling\n");
+    else if (postDelayCounter_)
+        out_->verbose(CALL_INFO, 1,0, "Sampling for %d additional samples\n", postDelayCounter_);
+}
+
+bool
+ProbeControl::setTrigger(const std::string& expr, std::string& error)
+{
+    assert(probeBufCtl_);
+    if (expr.empty()) {
+        probeBufCtl_->setTrigger(nullptr);
+        return true;
     }
+    std::shared_ptr<ProbeTrigger> t = ProbeTrigger::compile(expr, probeBufCtl_->fields(), error);
+    if (!t) return false;
+    probeBufCtl_->setTrigger(t);
+    out_->verbose(CALL_INFO, 1, 0, "probeTrigger=%s\n", expr.c_str());
+    return true;
 }
 
 void
 ProbeControl::setBufferControls(std::shared_ptr<ProbeBufCtl> probeBufCtl)
 {
     probeBufCtl_ = probeBufCtl;
+    // clients reach the component through the process's probe server
+    if (mode_ && port_) {
+        probeServer_ = ProbeServer::get(static_cast<uint16_t>(port_), out_);
+        probeWatched_ = probeServer_->attach(this);
+    }
 }
 
 void
-ProbeControl::updateCLI()
+ProbeControl::setFlushFile(const std::string& base, uint32_t rank, uint32_t thread)
 {
-    if (port_==0) return;
+    assert(probeBufCtl_);
+    probeFile_ = ProbeFileWriter::get(base, rank, thread);
+    if (!probeFile_->good())
+        out_->fatal(CALL_INFO, -1, "Could not open probe file %s\n", probeFile_->fileName().c_str());
+    probeLayout_ = probeFile_->layout(*probeBufCtl_);
+    out_->verbose(CALL_INFO, 1, 0, "probeFile=%s\n", probeFile_->fileName().c_str());
+}
 
-    // start up server if needed.
-    if (probeSocket_==nullptr) {
-        probeSocket_ = std::make_unique<ProbeSocket>(port_, this, this->comp_, out_);
-        if (probeSocket_->create() != ProbeSocket::RESULT::SUCCESS)
-            out_->fatal( CALL_INFO, -1, "Could not create debug port %d\n", port_);
-        if (probeSocket_->connect() != ProbeSocket::RESULT::SUCCESS)
-            out_->fatal( CALL_INFO, -1, "Could not connect to debug port %d\n", port_);
+void
+ProbeControl::updateCLI()
+{
+    // unwatched components pass their break points without the server lock
+    if (probeServer_ && probeWatched_->load(std::memory_order_acquire)) {
+        publishedCycle_.store(comp_->getCurrentSimCycle(), std::memory_order_relaxed);
+        probeServer_->breakpoint(this);
     }
-    // If connected run the CLI handler
-    if (probeSocket_->connected()) {
-        if (probeSocket_->cli_handler() != ProbeSocket::RESULT::SUCCESS)
-            out_->fatal( CALL_INFO, -1, "An error occured on debug port %d\n", port_);
+}
+
+std::shared_ptr<ProbeFileWriter>
+ProbeFileWriter::get(const std::string& base, uint32_t rank, uint32_t thread)
+{
+    // SST threads construct their components concurrently
+    static std::mutex mtx;
+    static std::map<std::string, std::weak_ptr<ProbeFileWriter>> writers;
+    const std::string fileName = base + "." + std::to_string(rank) + "." + std::to_string(thread) + ".prb";
+    std::lock_guard<std::mutex> lock(mtx);
+    std::shared_ptr<ProbeFileWriter> w = writers[fileName].lock();
+    if (!w) {
+        w = std::make_shared<ProbeFileWriter>(fileName, rank, thread);
+        writers[fileName] = w;
     }
+    return w;
 }
 
-ProbeBufCtl::ProbeBufCtl(size_t sz) : sz_(sz) {
-    tags.resize(sz);
-};
+ProbeFileWriter::ProbeFileWriter(const std::string& fileName, uint32_t rank, uint32_t thread)
+    : fileName_(fileName)
+{
+    ofs_.open(fileName_, std::ios::binary | std::ios::trunc);
+    good_ = ofs_.is_open();
+    if (!good_) return;
+    probe_file_header_t h = {};
+    memcpy(h.magic, PROBE_FILE_MAGIC, sizeof(h.magic));
+    h.version = PROBE_FILE_VERSION;
+    h.rank = rank;
+    h.thread = thread;
+    probe_append(front_, h);
+    thread_ = std::thread(&ProbeFileWriter::run, this);
+}
 
-void ProbeBufCtl::reset_buffer() {
-    num_recs=0;
-    cur  = 0;
-    first = 0;
-    samples_lost = 0;
+ProbeFileWriter::~ProbeFileWriter()
+{
+    if (!good_) return;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        done_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    // whatever was flushed after the last swap
+    ofs_.write(front_.data(), static_cast<std::streamsize>(front_.size()));
+    ofs_.close();
 }
 
-void ProbeBufCtl::reset_trigger() {
-    state = CLEAR;
+uint32_t
+ProbeFileWriter::layout(const ProbeBufCtl& buf)
+{
+    std::vector<char> l;
+    buf.write_layout(l, 0);
+    for (size_t id = 0; id < layouts_.size(); id++)
+        if (layouts_[id] == l) return static_cast<uint32_t>(id);
+    const uint32_t id = static_cast<uint32_t>(layouts_.size());
+    layouts_.push_back(l);
+    buf.write_layout(front_, id);
+    return id;
 }
 
-void ProbeBufCtl::markAsTriggerRec() { state = TRIGREC;}
+void
+ProbeFileWriter::swap()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (busy_) return;
+        std::swap(front_, back_);
+        busy_ = true;
+    }
+    cv_.notify_one();
+}
 
 void
-ProbeBufCtl::capture()
-{
-    // child class calls this first to establish pointer state before saving record
-    // When this buffer fills it writes over the oldest data
-
-    if (num_recs == 0) {
-        // empty
-        num_recs++;
-        first = 0;
-        cur = 0;
-    } else if (num_recs < sz_) {
-        num_recs++;
-        cur = (cur + 1) % sz_;
-        if (cur==0) first=1;
-    } else {
-        // full
-        cur = first;
-        first = (first + 1) % sz_;
+ProbeFileWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    for (;;) {
+        cv_.wait(lock, [this]{ return busy_ || done_; });
+        if (!busy_) return;
+        // back_ belongs to this thread until busy_ is cleared
+        lock.unlock();
+        ofs_.write(back_.data(), static_cast<std::streamsize>(back_.size()));
+        ofs_.flush();
+        back_.clear();
+        lock.lock();
+        busy_ = false;
     }
+}
 
-    //std::cout << "state=" << getTrigStateChar() <<  " sz=" << sz_ << " num_recs=" << num_recs << " first=" << first << " cur=" << cur << std::endl;
-    
-    if ( state==OVERRUN ) samples_lost++;
-
-    // Check tags before overwriting them
-    if ( (state == TRIGGERED) && (tags.at(cur) == TRIGREC)) {
-        //std::cout << "overrun!" << std::endl;
-        state = OVERRUN;
-        tags[cur] = OVERRUN;  // override tag
-    } else if ( state == TRIGREC ) { 
-        tags[cur] = state;  
-        state = TRIGGERED;
+ProbeCLI::ProbeCLI(ProbeControl * probeControl, SST::Component * comp)
+    : probeControl_(probeControl), comp_(comp)
+{}
+
+ProbeCLI::CMD
+ProbeCLI::parse(const std::string& line, std::vector<std::string>& args)
+{
+    splitStr(line, " ", args);
+    if (args.empty() || str2cmd.find(args[0]) == str2cmd.end())
+        return CMD::UNKNOWN;
+    return str2cmd.at(args[0]);
+}
+
+std::string
+ProbeCLI::help(const std::vector<std::string>& args)
+{
+    std::stringstream r;
+    if (args.size()==1) {
+        r <<  "Available commands:\n";
+        for (auto s : cmd2str)
+            r << " "  << s.second << "\n";
+        r << "Use 'help <command>' for more detailed information\n";
+    } else if ( str2cmd.find(args[1]) != str2cmd.end() ) {
+        r << cmd2help.at(str2cmd.at(args[1])) << "\n";
     } else {
-        tags[cur] = state;
+        r << "Unknown command: " << args[1] << "\n";
     }
- 
+    return r.str();
 }
 
-void ProbeBufCtl::render_buffer(std::ostream& os) {
-    // os << "rendering buffer" << std::endl;
-    // os << "trigger state: " << state << std::endl;
-    // TODO limit range
-    os << "#I " << num_recs << " records" << std::endl;
-    if (num_recs==0) return;
-    if (state==OVERRUN) {
-        os << "#I saved trigger due to buffer overflow\n";
-        os << "#";
-        render_trigger_rec(os, 'T');
-        os << std::endl;
-        if (samples_lost>0)
-            os << "# records discarded " << samples_lost << std::endl;
+bool
+ProbeCLI::concurrent(CMD cmd)
+{
+    switch (cmd) {
+    case CMD::COMPONENT:
+    case CMD::DUMP:
+    case CMD::DUMPBIN:
+    case CMD::ECHO:
+    case CMD::NUMRECS:
+    case CMD::TRIGSTATE:
+    case CMD::UNKNOWN:
+        return true;
+    default:
+        return false;
     }
-    for (size_t i=0;i<num_recs;i++) {
-        os << "#";
-        size_t idx = (first + i) % sz_;
-        char pfx = ( (state==TRIGGERED) && (tags.at(idx)==TRIGREC)) ? 'T' : ' ';
-        render( os, idx, pfx );
-        os << std::endl;
+}
+
+bool
+ProbeCLI::execute(CMD cmd, const std::vector<std::string>& args,
+                  const std::string& hostname, std::vector<char>& response, bool& binary)
+{
+    bool continueSim = false;
+    std::stringstream r;
+    binary = false;
+    switch (cmd) {
+    case CMD::CLICONTROL:
+        if (args.size() > 1) {
+            try {
+                uint64_t n = std::stoul(args[1]);
+                probeControl_->cliControl(n);
+            } catch (std::exception& e) {
+                std::cout << "Could not set cliControl. " << e.what() << std::endl;
+            }
+        }
+        r << probeControl_->cliControl();
+        break;
+    case CMD::COMPONENT:
+        r << comp_->getName();
+        break;
+    case CMD::CYCLE:
+        r << comp_->getCurrentSimCycle();
+        break;
+    case CMD::DISCONNECT:
+        r << "disconnecting";
+        continueSim = true;
+        break;
+    case CMD::DUMP:
+        probeControl_->buf()->render_buffer(r);
+        break;
+    case CMD::DUMPBIN:
+        {
+            // a complete probe file (see probe_file.h) with one data block.
+            // The server does not know the rank and thread so both are 0.
+            // This may run off the SST thread, so the cycle is the one
+            // published at the last sync point or break point.
+            probe_file_header_t h = {};
+            memcpy(h.magic, PROBE_FILE_MAGIC, sizeof(h.magic));
+            h.version = PROBE_FILE_VERSION;
+            response.clear();
+            probe_append(response, h);
+            probeControl_->buf()->write_layout(response, 0);
+            probeControl_->buf()->write_block(response, 0, comp_->getName(), probeControl_->cycle());
+            binary = true;
+        }
+        return continueSim;
+    case CMD::ECHO:
+        {
+            std::string s;
+            joinStr(1, args, ".", s);
+            r << s;
+        }
+        break;
+    case CMD::HOSTNAME:
+        r << hostname;
+        break;
+    case CMD::NUMRECS:
+        r << probeControl_->buf()->getNumRecs();
+        break;
+    case CMD::PROBESTATE:
+        r << probeControl_->getProbeStateStr();
+        break;
+    case CMD::RUN:
+        if (args.size() > 1) {
+            try {
+                uint64_t n = std::stoul(args[1]);
+                continueSim = true;
+                runEventCounter_ = (int) n;
+                r << "continuing sim for " << n << " events";;
+            } catch (std::exception& e) {
+                std::cout << "could not set number of events. " << e.what() << std::endl;
+                r << "?";
+            }
+        } else {
+            runEventCounter_ = 0;
+            continueSim = true;
+            r << "continuing sim";
+        }
+        break;
+    case CMD::SPIN:
+        tcldbg::spin();
+        r << "freed from spin";
+        break;
+    case CMD::SYNCSTATE:
+        r << probeControl_->getSyncStateStr();
+        break;
+    case CMD::TRIGGER:
+        if (args.size() > 1) {
+            std::string expr, error;
+            if (args[1] != "clear")
+                joinStr(1, args, " ", expr);
+            if (!probeControl_->setTrigger(expr, error)) {
+                r << "trigger error: " << error;
+                break;
+            }
+        }
+        r << probeControl_->getTriggerStr();
+        break;
+    case CMD::TRIGSTATE:
+        r << probeControl_->buf()->getTrigStateChar();
+        break;
+    case CMD::HELP:
+        r << help(args);
+        break;
+    case CMD::LIST:
+    case CMD::SELECT:
+    case CMD::UNKNOWN:
+        // LIST and SELECT are handled by the server
+        r <<  "?";
+        break;
     }
+    const std::string s = r.str();
+    response.assign(s.begin(), s.end());
+    return continueSim;
 }
 
-ProbeSocket::ProbeSocket(uint16_t port, ProbeControl * probeControl, SST::Component * comp, SST::Output* out) 
-    : port_(port), probeControl_(probeControl), comp_(comp), out_(out) 
-{}
+void
+ProbeCLI::splitStr(std::string s, const char* delim, std::vector<std::string>& v)
+{
+    char* ptr     = s.data();
+    char* saveptr = nullptr;
+    for( v.clear(); auto token = strtok_r( ptr, delim, &saveptr ); ptr = nullptr )
+      v.push_back( token );
+}
 
-ProbeSocket::~ProbeSocket() {
-    if (socket_state_ >= SOCKET_STATE::CREATED) {
-        if (serverSock_ >= 0) close(serverSock_);
+void
+ProbeCLI::joinStr(size_t startpos, std::vector<std::string> v, const char* delim, std::string& s)
+{
+    s.clear();
+    size_t n = v.size();
+    for ( size_t i = startpos; i < n; i++ ) {
+        s.append(v[i]);
+        if (i < n-1) s.append(delim);
     }
-    if (socket_state_ >= SOCKET_STATE::CONNECTED) {
-        if (clientSock_ >= 0) close(clientSock_);
+}
+
+std::shared_ptr<ProbeServer>
+ProbeServer::get(uint16_t port, SST::Output* out)
+{
+    // SST threads construct their components concurrently
+    static std::mutex mtx;
+    static std::weak_ptr<ProbeServer> server;
+    std::lock_guard<std::mutex> lock(mtx);
+    std::shared_ptr<ProbeServer> s = server.lock();
+    if (!s) {
+        s = std::make_shared<ProbeServer>(port, out);
+        server = s;
+    } else if (s->port() != port) {
+        out->verbose(CALL_INFO, 1, 0, "probePort=%d ignored. Using probe server on port %d\n", port, s->port());
     }
+    return s;
 }
 
-ProbeSocket::RESULT ProbeSocket::create()
+ProbeServer::ProbeServer(uint16_t port, SST::Output* out) : port_(port)
 {
     serverSock_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSock_ < 0) return RESULT::CREATION_ERROR;
+    if (serverSock_ < 0)
+        out->fatal(CALL_INFO, -1, "Could not create debug port %d\n", port_);
     sockaddr_in serv_addr;
     memset((char *) &serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = INADDR_ANY;
     serv_addr.sin_port = htons(port_);
-    int rc = bind(serverSock_, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
-    if (rc < 0)
-        return RESULT::BINDING_ERROR;
-    socket_state_ = SOCKET_STATE::CREATED;
-    return RESULT::SUCCESS;
-}
-
-ProbeSocket::RESULT ProbeSocket::connect()
-{
-    if (socket_state_!=SOCKET_STATE::CREATED) return RESULT::INVALID;
-    gethostname(buffer_, sizeof(buffer_));
-    hostname_ = std::string(buffer_);
-    out_->verbose(CALL_INFO, 1, 0, "Waiting for connection on %s:%d\n", hostname_.c_str(), port_);
-    // block until client connects (limit 1)
-    listen(serverSock_, 1);
-    clientSock_ = accept(serverSock_, nullptr, nullptr);
-    if (clientSock_ < 0) {
-        perror("accept failed: ");
-        return RESULT::ACCEPTING_ERROR;
-    }
-    socket_state_ = SOCKET_STATE::CONNECTED;
-    out_->verbose(CALL_INFO, 1, 0, "Connected\n"); // TODO client identification on connection
-    return RESULT::SUCCESS;
-}
-
-ProbeSocket::RESULT ProbeSocket::cli_handler() {
-    if (socket_state_== SOCKET_STATE::DISCONNECTING) {
-        close(clientSock_);
-        socket_state_ = SOCKET_STATE::CREATED;
-        return ProbeSocket::RESULT::SUCCESS;
-    } 
-    if (socket_state_ != SOCKET_STATE::CONNECTED) return RESULT::INVALID;
+    if (bind(serverSock_, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0 ||
+        listen(serverSock_, SOMAXCONN) < 0)
+        out->fatal(CALL_INFO, -1, "Could not bind debug port %d\n", port_);
+    if (pipe(wakePipe_) < 0)
+        out->fatal(CALL_INFO, -1, "Could not create probe server pipe\n");
+    for (int fd : {serverSock_, wakePipe_[0], wakePipe_[1]})
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    hostname_ = std::string(host);
+    waitClient_ = std::getenv("PROBE_WAIT_CLIENT") != nullptr;
+    out->verbose(CALL_INFO, 1, 0, "Probe server listening on %s:%d%s\n", hostname_.c_str(), port_,
+                 waitClient_ ? ". Waiting for a client at the first break point" : "");
+    thread_ = std::thread(&ProbeServer::run, this);
+}
+
+ProbeServer::~ProbeServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        done_ = true;
+        wake();
+    }
+    thread_.join();
+    for (auto& c : clients_) close(c.second.sock);
+    close(serverSock_);
+    close(wakePipe_[0]);
+    close(wakePipe_[1]);
+}
 
+const std::atomic<bool> *
+ProbeServer::attach(ProbeControl * probeControl)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto comp = std::make_unique<component_t>();
+    comp->probeControl = probeControl;
+    comp->cli = std::make_unique<ProbeCLI>(probeControl, probeControl->comp());
+    const std::atomic<bool> * watched = &comp->watched;
+    components_[probeControl->comp()->getName()] = std::move(comp);
+    // a single component is selected by default
+    rewatch();
+    return watched;
+}
+
+void
+ProbeServer::detach(ProbeControl * probeControl)
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    auto it = components_.find(probeControl->comp()->getName());
+    if (it == components_.end()) return;
+    const std::string msg = "component " + it->first + " has ended";
+    // wait out dumps still rendering from this component's buffer
+    component_t& comp = *it->second;
+    comp.cv.wait(lock, [&] { return comp.readers == 0; });
+    for (auto& r : comp.requests) {
+        auto c = clients_.find(r.client);
+        if (c == clients_.end()) continue;
+        c->second.pending--;
+        respond(c->second, MSG::TEXT, msg.data(), msg.size());
+    }
+    components_.erase(it);
+    rewatch();
+}
+
+void
+ProbeServer::breakpoint(ProbeControl * probeControl)
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    auto it = components_.find(probeControl->comp()->getName());
+    if (it == components_.end()) return;
+    component_t& comp = *it->second;
+    // PROBE_WAIT_CLIENT holds break points until the first client connects
+    comp.cv.wait(lock, [&] { return done_ || !waitClient_; });
+    if (!comp.watched) return;
     // Run sequencing. Do not break into interactive mode
-    if (--runEventCounter_ > 0) 
-        return ProbeSocket::RESULT::SUCCESS;
+    if (comp.cli->skip()) return;
 
-    // Message Loop
+    comp.stopped = true;
     bool continueSim = false;
-    do {
-        memset(buffer_,0,SOCKET_BUFFER_SIZE);
-        int rc = (int) recv(clientSock_, buffer_,sizeof(buffer_), 0);
-        if ( rc < 0) return RESULT::RECV_ERROR;
-        // std::cout << "<server received>" << buffer_ << std::endl;
-        std::stringstream response;
-        std::string user_input(buffer_);
-        std::vector<std::string> args;
-        splitStr(user_input, " ", args);
-        CMD cmd = CMD::UNKNOWN;
-        if (str2cmd.find(args[0]) != str2cmd.end())
-            cmd = str2cmd.at(args[0]);
-        switch (cmd) {
-        case CMD::CLICONTROL:
-            if (args.size() > 1) {
-                try {
-                    uint64_t n = std::stoul(args[1]);
-                    probeControl_->cliControl(n);
-                } catch (std::exception& e) {
-                    std::cout << "Could not set cliControl. " << e.what() << std::endl;
-                }
-            }
-            response << probeControl_->cliControl();
-            break;
-        case CMD::COMPONENT:
-            response << comp_->getName();
-            break;
-        case CMD::CYCLE:
-            response << comp_->getCurrentSimCycle();
-            break;
-        case CMD::DISCONNECT:
-            socket_state_ = SOCKET_STATE::DISCONNECTING;
-            response << "disconnecting";
-            continueSim = true;
-            break;
-        case CMD::DUMP:
-            // TODO fix socket protocol for any sized buffer transfer
-            probeControl_->buf()->render_buffer(response);
-            break;
-        case CMD::ECHO:
-            {
-                std::string s;
-                joinStr(1, args, ".", s);
-                response << s;
-            }
-            break;
-
-        case CMD::HOSTNAME:
-            response << hostname_;
-            break;
-        case CMD::NUMRECS:
-            response << probeControl_->buf()->getNumRecs();
-            break;
-        case CMD::PROBESTATE:
-            response << probeControl_->getProbeStateStr();
-            break;
-        case CMD::RUN:
-            if (args.size() > 1) {
-                try {
-                    uint64_t n = std::stoul(args[1]);
-                    continueSim = true;
-                    runEventCounter_ = (int) n;
-                    response << "continuing sim for " << n << " events";;
-                } catch (std::exception& e) {
-                    std::cout << "could not set number of events. " << e.what() << std::endl;
-                    response << "?";
-                }
-            } else {
-                runEventCounter_ = 0;
-                continueSim = true;
-                response << "continuing sim";
-            }
-            break;
-        case CMD::SPIN:
-            tcldbg::spin();
-            response << "freed from spin";
-            break;
-        case CMD::SYNCSTATE:
-            response << probeControl_->getSyncStateStr();
-            break;
-        case CMD::TRIGSTATE:
-            response << probeControl_->buf()->getTrigStateChar();
-            break;
-        case CMD::HELP:
-        {
-            std::stringstream r;
-            if (args.size()==1) {
-                r <<  "Available commands:\n";
-                for (auto s : cmd2str) 
-                    r << " "  << s.second << "\n";
-                r << "Use 'help <command>' for more detailed information\n";
-            } else if ( str2cmd.find(args[1]) != str2cmd.end() ) {
-                r << cmd2help.at(str2cmd.at(args[1])) << "\n";
-            } else {
-                r << "Unknown command: " << args[1] << "\n";
-            }
-            response << r.str();
+    while (!continueSim) {
+        comp.cv.wait(lock, [&] { return done_ || !comp.requests.empty() || !comp.watched; });
+        if (comp.requests.empty())
+            break;  // the last client watching this component went away
+        request_t r = std::move(comp.requests.front());
+        comp.requests.pop_front();
+        // the component cannot move while stopped so its commands run unlocked
+        lock.unlock();
+        std::vector<char> response;
+        bool binary = false;
+        continueSim = comp.cli->execute(r.cmd, r.args, hostname_, response, binary);
+        lock.lock();
+        auto c = clients_.find(r.client);
+        if (c == clients_.end()) continue;
+        c->second.pending--;
+        if (r.cmd == ProbeCLI::CMD::DISCONNECT) {
+            c->second.selected.clear();
+            c->second.detached = true;
+            rewatch();
+        }
+        respond(c->second, binary ? MSG::BINARY : MSG::TEXT, response.data(), response.size());
+    }
+    comp.stopped = false;
+}
+
+void
+ProbeServer::run()
+{
+    std::vector<pollfd> fds;
+    std::vector<uint64_t> ids;
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (!done_) {
+        for (auto it = clients_.begin(); it != clients_.end(); ) {
+            uint64_t id = (it++)->first;
+            if (clients_.at(id).closing) drop(id);
         }
-            break;
-        case CMD::UNKNOWN:
-            response <<  "?";
-            break;
+        fds.assign({ {wakePipe_[0], POLLIN, 0}, {serverSock_, POLLIN, 0} });
+        ids.assign(2, 0);
+        for (auto& c : clients_) {
+            short events = POLLIN;
+            if (c.second.txpos < c.second.txbuf.size()) events |= POLLOUT;
+            fds.push_back({c.second.sock, events, 0});
+            ids.push_back(c.first);
         }
+        lock.unlock();
+        int rc = poll(fds.data(), static_cast<nfds_t>(fds.size()), -1);
+        lock.lock();
+        if (rc < 0) continue;   // EINTR
+        if (fds[0].revents & POLLIN) {
+            char b[64];
+            while (read(wakePipe_[0], b, sizeof(b)) > 0) {}
+        }
+        if (fds[1].revents & POLLIN)
+            accept_clients();
+        for (size_t i = 2; i < fds.size(); i++) {
+            auto it = clients_.find(ids[i]);
+            if (it == clients_.end() || it->second.closing) continue;
+            bool ok = true;
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                ok = receive(lock, it->first, it->second);
+            if (ok && (fds[i].revents & POLLOUT))
+                ok = flush(it->second);
+            if (!ok) drop(it->first);
+        }
+    }
+}
 
-        // std::cout << "<server sending>" << response << std::endl;
-        memset(buffer_,0,SOCKET_BUFFER_SIZE);
-        memcpy(buffer_, response.str().c_str(), strlen(response.str().c_str()));
-        rc = (int) send(clientSock_, buffer_, strlen(buffer_), 0);
-    } while (!continueSim);
+void
+ProbeServer::accept_clients()
+{
+    for (;;) {
+        int sock = accept(serverSock_, nullptr, nullptr);
+        if (sock < 0) return;
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        clients_[nextClient_++].sock = sock;
+        waitClient_ = false;
+        rewatch();
+    }
+}
 
-    return ProbeSocket::RESULT::SUCCESS;
+bool
+ProbeServer::receive(std::unique_lock<std::mutex>& lock, uint64_t id, client_t& c)
+{
+    char buf[4096];
+    for (;;) {
+        ssize_t rc = recv(c.sock, buf, sizeof(buf), 0);
+        if (rc > 0) {
+            c.rxbuf.append(buf, static_cast<size_t>(rc));
+            continue;
+        }
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;  // closed or failed
+    }
+    // complete frames
+    size_t pos = 0;
+    msg_hdr_t hdr;
+    while (!c.closing && c.rxbuf.size() - pos >= sizeof(hdr)) {
+        memcpy(&hdr, &c.rxbuf[pos], sizeof(hdr));
+        const size_t len = ntohl(hdr.length);
+        if (c.cmd.size() + len > MAX_CMD_SIZE || static_cast<MSG>(ntohs(hdr.type)) != MSG::CMD)
+            return false;
+        if (c.rxbuf.size() - pos - sizeof(hdr) < len) break;
+        c.cmd.append(c.rxbuf, pos + sizeof(hdr), len);
+        pos += sizeof(hdr) + len;
+        if (ntohs(hdr.flags) & MSG_MORE) continue;
+        dispatch(lock, id, c, c.cmd);
+        c.cmd.clear();
+    }
+    c.rxbuf.erase(0, pos);
+    return true;
 }
 
 void
-ProbeSocket::splitStr(std::string s, const char* delim, std::vector<std::string>& v)
+ProbeServer::dispatch(std::unique_lock<std::mutex>& lock, uint64_t id, client_t& c, const std::string& line)
 {
-    char* ptr     = s.data();
-    char* saveptr = nullptr;
-    for( v.clear(); auto token = strtok_r( ptr, delim, &saveptr ); ptr = nullptr )
-      v.push_back( token );
+    std::vector<std::string> args;
+    ProbeCLI::CMD cmd = ProbeCLI::parse(line, args);
+    std::stringstream r;
+    const std::string name = resolve(c);
+
+    // server commands
+    switch (cmd) {
+    case ProbeCLI::CMD::HELP:
+        r << ProbeCLI::help(args);
+        break;
+    case ProbeCLI::CMD::HOSTNAME:
+        r << hostname_;
+        break;
+    case ProbeCLI::CMD::LIST:
+        for (auto& comp : components_)
+            r << (comp.first == name ? "* " : "  ") << comp.first << " "
+              << (comp.second->stopped ? "stopped" : "running") << "\n";
+        break;
+    case ProbeCLI::CMD::SELECT:
+        if (args.size() == 1) {
+            r << (name.empty() ? "none" : name);
+        } else if (components_.find(args[1]) != components_.end()) {
+            c.selected = args[1];
+            c.detached = false;
+            r << "selected " << args[1];
+            // the previous selection may no longer be watched
+            rewatch();
+        } else {
+            r << "Unknown component: " << args[1];
+        }
+        break;
+    default:
+        break;
+    }
+    if (r.tellp() > 0) {
+        const std::string s = r.str();
+        respond(c, MSG::TEXT, s.data(), s.size());
+        return;
+    }
+
+    // component commands
+    auto it = components_.find(name);
+    if (it == components_.end()) {
+        const std::string s = "no component selected. Use list and select <component>";
+        respond(c, MSG::TEXT, s.data(), s.size());
+        return;
+    }
+    component_t& comp = *it->second;
+    if (!comp.stopped && c.pending == 0 && ProbeCLI::concurrent(cmd)) {
+        // these read only fixed component data and what the SST thread
+        // publishes atomically: buffer slots and the trigger record through
+        // their sequence headers, the trigger state, the lost sample count
+        // and ProbeControl::cycle(). A large dump then renders without
+        // holding up the other components' break points. Only this thread
+        // erases clients, so c stays valid.
+        comp.readers++;
+        lock.unlock();
+        std::vector<char> response;
+        bool binary = false;
+        comp.cli->execute(cmd, args, hostname_, response, binary);
+        lock.lock();
+        if (--comp.readers == 0)
+            comp.cv.notify_all();
+        respond(c, binary ? MSG::BINARY : MSG::TEXT, response.data(), response.size());
+        return;
+    }
+    // wait for the component's next break point
+    comp.requests.push_back({id, cmd, args});
+    c.pending++;
+    comp.cv.notify_one();
 }
 
 void
-ProbeSocket::joinStr(size_t startpos, std::vector<std::string> v, const char* delim, std::string& s)
+ProbeServer::respond(client_t& c, MSG type, const char* p, size_t n)
 {
-    s.clear();
-    size_t n = v.size();
-    for ( size_t i = startpos; i < n; i++ ) {
-        s.append(v[i]);
-        if (i < n-1) s.append(delim);
+    if (c.txpos == c.txbuf.size()) {
+        c.txbuf.clear();
+        c.txpos = 0;
+    }
+    // at least one frame, even for an empty response
+    c.txbuf.reserve(c.txbuf.size() + n + (n / CHUNK_SIZE + 1) * sizeof(msg_hdr_t));
+    do {
+        const size_t len = std::min(n, CHUNK_SIZE);
+        const uint16_t flags = (n > len) ? MSG_MORE : 0;
+        msg_hdr_t hdr = { htonl(static_cast<uint32_t>(len)),
+                          htons(static_cast<uint16_t>(type)), htons(flags) };
+        probe_append(c.txbuf, hdr);
+        c.txbuf.insert(c.txbuf.end(), p, p + len);
+        p += len;
+        n -= len;
+    } while (n > 0);
+    if (!c.closing && !flush(c)) {
+        c.closing = true;
+        rewatch();
     }
+    // the event loop polls for the rest
+    wake();
 }
 
 bool
-ProbeSocket::match(std::string in, CMD cmd)
+ProbeServer::flush(client_t& c)
 {
-    if (str2cmd.find(in) == str2cmd.end())
-        return false;
-    return (str2cmd.at(in) == cmd);
+    while (c.txpos < c.txbuf.size()) {
+        ssize_t rc = send(c.sock, &c.txbuf[c.txpos], c.txbuf.size() - c.txpos, SEND_FLAGS);
+        if (rc > 0) {
+            c.txpos += static_cast<size_t>(rc);
+            continue;
+        }
+        if (rc < 0 && errno == EINTR) continue;
+        return rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    return true;
+}
+
+void
+ProbeServer::drop(uint64_t id)
+{
+    close(clients_.at(id).sock);
+    clients_.erase(id);
+    // forget its commands and resume components nobody watches anymore
+    for (auto& comp : components_) {
+        auto& q = comp.second->requests;
+        q.erase(std::remove_if(q.begin(), q.end(), [id](const request_t& r) { return r.client == id; }), q.end());
+    }
+    rewatch();
+}
+
+void
+ProbeServer::wake()
+{
+    char b = 0;
+    if (write(wakePipe_[1], &b, 1) < 0) {}  // full pipe: a wake up is pending anyway
+}
+
+std::string
+ProbeServer::resolve(const client_t& c) const
+{
+    if (!c.selected.empty()) return c.selected;
+    if (!c.detached && components_.size() == 1) return components_.begin()->first;
+    return "";
+}
+
+void
+ProbeServer::rewatch()
+{
+    for (auto& comp : components_) {
+        bool watched = waitClient_;
+        for (auto& c : clients_)
+            watched |= !c.second.closing && resolve(c.second) == comp.first;
+        comp.second->watched.store(watched, std::memory_order_release);
+        comp.second->cv.notify_all();
+    }
 }
 
 } // namespace SSTDEBUG
\ No newline at end of file
@@ -14,24 +14,32 @@
 
 // -- Standard Headers
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <stdexcept>
 #include <sstream>
 #include <string>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
 // -- SST Headers
 #include "SST.h"
 
+#include "probe_buffer.h"
+
 namespace SSTDEBUG::Probe {
 
-class ProbeBufCtl;
-class ProbeSocket;
+class ProbeFileWriter;
+class ProbeServer;
 
 enum class SyncState {
     INVALID, IDLE, WAIT, ACTIVE
@@ -107,6 +115,8 @@ public:
     ProbeControl& operator=( const ProbeControl& ) = delete;
     /// child class provides controls to buffer
     void setBufferControls(std::shared_ptr<ProbeBufCtl>);
+    /// flush buffers to <base>.<rank>.<thread>.prb instead of stdout. Call after setBufferControls.
+    void setFlushFile(const std::string& base, uint32_t rank, uint32_t thread);
     /// Call back for sync points for high level controller updates
     void updateSyncState(SST::SimTime_t cycle);
     /// Called at end of component's clock cycle and end of updateSyncState
@@ -115,6 +125,10 @@ public:
     void handleSyncPointActions();
     /// Detect trigger to transition between pre and post sampling phase
     void trigger(bool cond);  // TODO pick a more specific name that differentiates this from other triggers
+    /// Trigger on a ProbeTrigger expression over the buffer's record fields instead
+    /// of the component's trigger() condition. Empty expr restores trigger().
+    /// Returns false with error set if expr does not compile.
+    bool setTrigger(const std::string& expr, std::string& error);
     /// Indicate data has been sampled.
     void sample();
     /// Avoid context switch by checking active state before probing
@@ -126,27 +140,38 @@ public:
 
     inline std::string const getSyncStateStr()  { return syncState2Str.at(syncState_);  }
     inline std::string const getProbeStateStr() { return probeState2Str.at(probeState_); }
+    inline std::string const getTriggerStr() {
+        return probeBufCtl_->getTrigger() ? probeBufCtl_->getTrigger()->expr() : "component";
+    }
     inline uint64_t cliControl() { return cliControl_.v; }
     inline void cliControl(uint64_t v) { cliControl_.v = v; }
 public:   
     /// Access functions for testing and CLI support 
     SST::Component * comp() { return comp_; };
     std::shared_ptr<ProbeBufCtl> buf() { return probeBufCtl_;}
-    /// CLI server may run only when active and a probe port has been provided.
+    /// Simulation cycle of the last sync point or break point. Safe to read off the SST thread.
+    SST::SimTime_t cycle() const { return publishedCycle_.load(std::memory_order_relaxed); }
+    /// Break point for probe clients. Only stops when a probe port has been provided
+    /// and a client has selected this component.
     void updateCLI();
  
  private:
+    void triggered();                           ///< enter post-trigger sampling
     SST::Component * comp_;                     ///< Component associated with this controller
     SST::Output * out_;                         ///< Component output stream
     SyncState syncState_ = SyncState::INVALID;  ///< State managed at sync points
     SyncState lastSyncState_ = SyncState::INVALID; /// < Saved sync state
     SST::SimTime_t      syncCycle = 0;                     ///< Cycle passed to updateSyncState
+    std::atomic<SST::SimTime_t> publishedCycle_ = 0;       ///< cycle() for probe server threads
     ProbeState probeState_ = ProbeState::IDLE;  ///< State managed by component level probe
     ProbeState lastProbeState_ = ProbeState::IDLE;  /// <saved probe state
-    std::unique_ptr<ProbeSocket>  probeSocket_; ///< CLI Probe Socket Server
+    std::shared_ptr<ProbeServer> probeServer_;  ///< CLI probe server shared by the components in this process
+    const std::atomic<bool> * probeWatched_ = nullptr; ///< set by probeServer_ while a client selects this component
     Actions syncActions_ = {};                  ///< Common actions to perform at checkpoint
     Actions probeActions_ = {};                 ///< Common actions to perform on probe event
     std::shared_ptr<ProbeBufCtl> probeBufCtl_;  ///< Controls for probe buffer
+    std::shared_ptr<ProbeFileWriter> probeFile_; ///< Binary flush output shared by the components on this thread
+    uint32_t probeLayout_ = 0;                  ///< Record layout id in probeFile_
 
     // -- Component probe parameters
     int      mode_;                             ///< 0-disable, 1-checkpoint-mode, >1-reserved
@@ -160,135 +185,117 @@ public:
     bool     useDelayCounter_;                  ///< when 0 post-trigger sampling continues until checkpoint.
 };
 
-// splits generic control from templatized data capture for Probe Buffer
-class ProbeBufCtl {
+// Background writer for binary probe files (see probe_file.h). One per
+// rank and thread, shared by the components running there. Blocks are
+// appended to a front buffer on the simulation thread; swap() hands it to
+// the writer thread and takes back the emptied back buffer, so the
+// simulation thread never waits on the file system. If the writer is still
+// busy the front buffer keeps growing until the next swap.
+class ProbeFileWriter {
 public:
-    enum TRIGGER_STATE : unsigned { 
-        CLEAR     = 0,  // not triggered
-        TRIGREC   = 1,  // current sample associated with trigger
-        TRIGGERED = 2,  // trigger has occurred
-        OVERRUN   = 3,  // trigger has occurred but buffer record overwritten
-    };
-    const std::map<TRIGGER_STATE, char> trig2char {
-        {CLEAR, '-'}, {TRIGREC,'!'}, {TRIGGERED, '+'}, {OVERRUN, 'o'}
-    };
-    ProbeBufCtl(size_t sz);
-    void reset_buffer();      // effectively clear buffer (e.g. after flush)
-    void reset_trigger();     // Clear trigger states
-    void markAsTriggerRec();  // Set TRIGREC state to enable special capture
-    void render_buffer(std::ostream& os);  // iterate over buffer for output
-    virtual void render(std::ostream& os, size_t idx, char pfx) = 0; // print a rec to ostream
-    virtual void render_trigger_rec(std::ostream&, char pfx) = 0; // print the saved trigger rec
-    // cli support
-    char getTrigStateChar() { return trig2char.at(state); };
-    size_t getNumRecs() { return num_recs; }
-protected:
-    void capture();                  // Called by child after capture record
-    size_t sz_;                      // defined size
-    size_t num_recs = 0;             // number of valid entries (max is sz)
-    size_t cur  = 0;                 // index to buffer entry to be written
-    size_t first = 0;                // index of oldest data written
-    int samples_lost = 0;            // number of samples sampled but overwritten in circular buffer
-    TRIGGER_STATE state;             // current state of triggering sequence  
-    std::vector<TRIGGER_STATE> tags; // state associated with each entry.
-};
-
-// Simple template wrapper for buffer data
-template<typename T> class ProbeBuffer : public ProbeBufCtl {
-public:
-    ProbeBuffer( size_t sz ) : ProbeBufCtl(sz) { buf.resize(sz); };
-    virtual ~ProbeBuffer() {};
-    void capture(T& rec) {
-        ProbeBufCtl::capture(); // update pointers and trigger capture detection
-        assert(cur < sz_);
-        buf.at(cur) = rec;
-        if (tags[cur]==TRIGREC)
-            trigger_rec = rec;
-    }
-    void render(std::ostream& os, size_t idx, char pfx) override {
-        assert(idx<sz_);
-        os << pfx << ' ' << buf.at(idx);
-    }
-    void render_trigger_rec(std::ostream& os, char pfx) override {
-        os << pfx << ' ' << trigger_rec;
-    }
+    /// Writer for this rank and thread, created on first use
+    static std::shared_ptr<ProbeFileWriter> get(const std::string& base, uint32_t rank, uint32_t thread);
+    ProbeFileWriter(const std::string& fileName, uint32_t rank, uint32_t thread);
+    ~ProbeFileWriter();
+    ProbeFileWriter( const ProbeFileWriter& )            = delete;
+    ProbeFileWriter& operator=( const ProbeFileWriter& ) = delete;
+    bool good() const { return good_; }
+    const std::string& fileName() const { return fileName_; }
+    /// Layout id for a buffer's records. Identical layouts share an id.
+    uint32_t layout(const ProbeBufCtl& buf);
+    /// Buffer for the next blocks. Simulation thread only.
+    std::vector<char>& front() { return front_; }
+    /// Pass the front buffer to the writer thread unless it is still busy
+    void swap();
 private:
-    std::vector<T> buf;     // the circular buffer
-    T trigger_rec;          // copy of record associated with triggered cycle
+    void run();
+    std::string fileName_;
+    std::ofstream ofs_;
+    bool good_ = false;
+    std::vector<std::vector<char>> layouts_ = {};  ///< LAYOUT blocks written so far, by id
+    std::vector<char> front_ = {};                ///< filled by the simulation thread
+    std::vector<char> back_ = {};                 ///< written by the writer thread
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool busy_ = false;                           ///< back_ holds data to write
+    bool done_ = false;
+    std::thread thread_;
 };
 
-class ProbeSocket {
+// Command interpreter for one probed component. The process's ProbeServer
+// parses each client command and hands it to the selected component's
+// ProbeCLI. Commands run on the simulation thread while the component is
+// stopped at a break point, except the concurrent() ones, which only read
+// state the probe buffer publishes atomically and may also run while the
+// component simulates.
+class ProbeCLI {
 
 public:
-    static const int SOCKET_BUFFER_SIZE=4096;
-    enum class RESULT : int { 
-        SUCCESS=0,
-        INVALID         = -1,
-        CREATION_ERROR  = -2,
-        BINDING_ERROR   = -3,
-        ACCEPTING_ERROR = -4,
-        RECV_ERROR      = -5,
-        SEND_ERROR      = -6,
-    };
-    enum class SOCKET_STATE : int {
-        INVALID   = 0,
-        CREATED   = 1,
-        DISCONNECTING = 2,
-        CONNECTED = 3,
-    };
     enum class CMD : int {
         CLICONTROL,
         COMPONENT,
         CYCLE,
         DISCONNECT,
         DUMP,
+        DUMPBIN,
         ECHO,
         HELP,
         HOSTNAME,
+        LIST,
         NUMRECS,
         PROBESTATE,
         RUN,
+        SELECT,
         SPIN,
         SYNCSTATE,
+        TRIGGER,
         TRIGSTATE,
         UNKNOWN,
     };
-    const std::map<CMD, const std::string> cmd2str {
+    static inline const std::map<CMD, const std::string> cmd2str {
         {CMD::CLICONTROL,    "clicontrol" },
         {CMD::COMPONENT, "component" },
         {CMD::CYCLE,     "cycle"},
         {CMD::DISCONNECT,"disconnect"},
         {CMD::DUMP,      "dump"},
+        {CMD::DUMPBIN,   "dumpbin"},
         {CMD::ECHO,      "echo"},
         {CMD::HELP,      "help"},
         {CMD::HOSTNAME,  "hostname"},
+        {CMD::LIST,      "list"},
         {CMD::NUMRECS,   "numrecs" },
         {CMD::PROBESTATE, "probestate"},
         {CMD::RUN,       "run"},
+        {CMD::SELECT,    "select"},
         {CMD::SPIN,      "spin"},
         {CMD::SYNCSTATE, "syncstate"},
+        {CMD::TRIGGER,   "trigger"},
         {CMD::TRIGSTATE, "trigstate"},
         {CMD::UNKNOWN,   ""},
     };
-    const std::map<const std::string, CMD> str2cmd {
+    static inline const std::map<const std::string, CMD> str2cmd {
         {"clicontrol", CMD::CLICONTROL },
         {"component",  CMD::COMPONENT },
         {"cycle",      CMD::CYCLE},
         {"disconnect", CMD::DISCONNECT},
         {"dump",       CMD::DUMP},
+        {"dumpbin",    CMD::DUMPBIN},
         {"echo",       CMD::ECHO},
         {"help",       CMD::HELP},
         {"hostname",   CMD::HOSTNAME},
-        {"numrecs",    CMD::NUMRECS}, 
+        {"list",       CMD::LIST},
+        {"numrecs",    CMD::NUMRECS},
         {"probestate", CMD::PROBESTATE},
         {"run",        CMD::RUN},
+        {"select",     CMD::SELECT},
         {"spin",       CMD::SPIN},
         {"syncstate",  CMD::SYNCSTATE},
+        {"trigger",    CMD::TRIGGER},
         {"trigstate",  CMD::TRIGSTATE},
         {"?",          CMD::HELP},
         {"",           CMD::UNKNOWN}
     };
-    const std::map<CMD, const std::string> cmd2help {
+    static inline const std::map<CMD, const std::string> cmd2help {
         {CMD::CLICONTROL,   "Controls for breaking into interactive mode\n"
                             "clicontrol   : returns current value\n"
                             "clicontrol n : sets clicontrol to 'n' (base 10 only)\n"
@@ -304,11 +311,17 @@ public:
         },
         {CMD::COMPONENT, "get name of the component being probed" },
         {CMD::CYCLE,     "get current simulation cycle seen by the component"},
-        {CMD::DISCONNECT,"disconnect from probe and allow simulation to complete"},
+        {CMD::DISCONNECT,"disconnect from the component and let it run free"},
         {CMD::DUMP,      "dump the probe sample buffer"},
+        {CMD::DUMPBIN,   "dump the probe sample buffer as raw records\n"
+                         "dumpbin file : the client saves a probe file for readprobe"},
         {CMD::ECHO,      "(test) return args following echo command"},
         {CMD::HELP,      "provide helpful information to user"},
         {CMD::HOSTNAME,  "get name of the host running the probe server"},
+        {CMD::LIST,      "list the probed components of this process\n"
+                         "stopped : waiting at a break point\n"
+                         "running : no client is stopped at one of its break points\n"
+                         "'*' marks the component selected by this client"},
         {CMD::NUMRECS,   "number of records in buffer" },
         {CMD::PROBESTATE, "query current component probe state\n"
                           "idle, pre-sampling, post-sampling, wait\n"
@@ -316,45 +329,158 @@ public:
         {CMD::RUN,       "run   : continue simulation until the next event defined by clicontrols\n"
                          "run N : run through N events\n"
         },
+        {CMD::SELECT,    "select      : name of the selected component\n"
+                         "select name : send the following commands to component 'name'\n"
+                         "A selected component stops at its break points until the client\n"
+                         "disconnects. With one probed component it is selected by default."},
         {CMD::SPIN,      "(test) enter spin loop for gdb connection"},
         {CMD::SYNCSTATE, "query current simulator sync state\n"
                          "invalid, wait, active, idle\n"
         },
+        {CMD::TRIGGER,   "trigger       : current trigger expression, or 'component'\n"
+                         "trigger expr  : trigger on expr over the record fields from now on\n"
+                         "trigger clear : return to the component's trigger condition\n"
+                         "expr uses C operators, count(cond), rise(cond) and\n"
+                         "'A then B within N', e.g. sz > 100 && priority == 50"
+        },
         {CMD::TRIGSTATE, "query current buffer trigger state\n"
                          "- pre-trigger\n! trigger record\n+ post-trigger\no buffer overrun"
         },
         {CMD::UNKNOWN,   "Unknown command"},
     };
 
-    ProbeSocket(uint16_t port, ProbeControl * probeControl, SST::Component * comp, SST::Output* out);
-    virtual ~ProbeSocket();
-    /// Create a valid socket
-    RESULT create();
-    /// Wait for connection from client 
-    RESULT connect();
-    /// Handle client commands and return a response
-    virtual RESULT cli_handler();
-    /// Utility for client to check state before entering CLI loop
-    inline bool connected() { return socket_state_ == SOCKET_STATE::CONNECTED;}
+    ProbeCLI(ProbeControl * probeControl, SST::Component * comp);
+    virtual ~ProbeCLI() {}
+    /// Split a command line into words and look up the command
+    static CMD parse(const std::string& line, std::vector<std::string>& args);
+    /// Response to help [command]
+    static std::string help(const std::vector<std::string>& args);
+    /// Commands that may run while the component simulates
+    static bool concurrent(CMD cmd);
+    /// Execute a component command. The response is text unless binary is set.
+    /// Returns true when the simulation should resume.
+    virtual bool execute(CMD cmd, const std::vector<std::string>& args,
+                         const std::string& hostname, std::vector<char>& response, bool& binary);
+    /// Run sequencing for 'run N'. True while break points are to be skipped.
+    bool skip() { return --runEventCounter_ > 0; }
 
 private:
-    uint16_t port_ = 0;
     ProbeControl * probeControl_;
     SST::Component * comp_;
-    SST::Output * out_;
-    SOCKET_STATE socket_state_ = SOCKET_STATE::INVALID;
-    char buffer_[SOCKET_BUFFER_SIZE];
-    int serverSock_ = 0;
-    int clientSock_ = 0;
-    std::string hostname_ = "invalid";
     int runEventCounter_ = 0; // counter for successive RUN commands
-    //TODO does SST have utility class for these things? 
+    //TODO does SST have utility class for these things?
     // courtesy of RevOpts.h
-    void splitStr( std::string s, const char* delim, std::vector<std::string>& v );
-    void joinStr( size_t startpos, std::vector<std::string> v, const char* delim, std::string& s);
-    bool match(std::string in, CMD cmd);
+    static void splitStr( std::string s, const char* delim, std::vector<std::string>& v );
+    static void joinStr( size_t startpos, std::vector<std::string> v, const char* delim, std::string& s);
+
+}; //class ProbeCLI
+
+// Probe socket server, one per process, shared by every ProbeControl with a
+// probe port. The first one registered picks the port. A helper thread runs
+// a poll() loop over the listening socket and any number of clients so the
+// simulation never waits for a connection. Each client selects a component
+// by name; a selected component stops at the break points its cliControl
+// requests and runs that client's commands until one of them resumes it.
+// Components no client selects run free. With PROBE_WAIT_CLIENT set in the
+// environment break points wait for the first client to connect instead.
+//
+// Every message in either direction is framed by an 8 byte header in
+// network byte order:
+//
+//   uint32_t length   payload bytes following the header
+//   uint16_t type     MSG
+//   uint16_t flags    MSG_MORE when further frames continue this message
+//
+// The client sends one CMD frame per command. Responses are TEXT, or
+// BINARY for dumpbin, and are split into frames of at most CHUNK_SIZE
+// bytes so any size can be returned. A client gets its responses in the
+// order of its commands.
+class ProbeServer {
+
+public:
+    static const size_t CHUNK_SIZE = 1 << 16;      ///< largest frame payload sent
+    static const size_t MAX_CMD_SIZE = 1 << 16;    ///< largest command accepted
+    enum class MSG : uint16_t {
+        CMD    = 1,   // client command text
+        TEXT   = 2,   // text response
+        BINARY = 3,   // binary response (dumpbin)
+    };
+    static const uint16_t MSG_MORE = 1;
+
+    /// Server for this process, created on first use
+    static std::shared_ptr<ProbeServer> get(uint16_t port, SST::Output* out);
+    ProbeServer(uint16_t port, SST::Output* out);
+    virtual ~ProbeServer();
+    ProbeServer( const ProbeServer& )            = delete;
+    ProbeServer& operator=( const ProbeServer& ) = delete;
+    uint16_t port() const { return port_; }
+    /// Make a component available to clients under its name. Returns the flag
+    /// the server sets while a client selects it; break points are only
+    /// passed to breakpoint() while it is set so others never take the lock.
+    const std::atomic<bool> * attach(ProbeControl * probeControl);
+    /// Remove a component. Its queued commands are answered with an error.
+    void detach(ProbeControl * probeControl);
+    /// Break point on the simulation thread. Returns at once unless a client
+    /// has selected the component, otherwise runs its commands until resumed.
+    /// Call only while the flag returned by attach() is set.
+    void breakpoint(ProbeControl * probeControl);
+
+private:
+    struct request_t {
+        uint64_t client;
+        ProbeCLI::CMD cmd;
+        std::vector<std::string> args;
+    };
+    struct component_t {
+        ProbeControl * probeControl;
+        std::unique_ptr<ProbeCLI> cli;
+        bool stopped = false;               ///< waiting in breakpoint()
+        std::atomic<bool> watched{false};   ///< selected by a client, or held by PROBE_WAIT_CLIENT
+        unsigned readers = 0;               ///< concurrent commands running without the lock
+        std::deque<request_t> requests = {}; ///< commands for the simulation thread
+        std::condition_variable cv = {};
+    };
+    struct client_t {
+        int sock = -1;
+        std::string rxbuf = {};             ///< received bytes not yet parsed
+        std::string cmd = {};               ///< command frames received so far
+        std::vector<char> txbuf = {};       ///< framed responses not yet sent
+        size_t txpos = 0;                   ///< bytes of txbuf already sent
+        std::string selected = {};          ///< component name
+        bool detached = false;              ///< no default selection after disconnect
+        unsigned pending = 0;               ///< commands queued to components
+        bool closing = false;               ///< drop on the next loop iteration
+    };
+    struct msg_hdr_t {
+        uint32_t length;
+        uint16_t type;
+        uint16_t flags;
+    };
+    // everything below is guarded by mtx_
+    void run();                              ///< helper thread event loop
+    void accept_clients();
+    bool receive(std::unique_lock<std::mutex>& lock, uint64_t id, client_t& c);
+    void dispatch(std::unique_lock<std::mutex>& lock, uint64_t id, client_t& c, const std::string& line);
+    void respond(client_t& c, MSG type, const char* p, size_t n);
+    bool flush(client_t& c);
+    void drop(uint64_t id);
+    void wake();
+    std::string resolve(const client_t& c) const;   ///< component a client's commands go to
+    void rewatch();                                 ///< update watched flags and wake break points
+
+    uint16_t port_ = 0;
+    std::string hostname_ = "invalid";
+    int serverSock_ = -1;
+    int wakePipe_[2] = {-1, -1};             ///< wakes poll() when responses are queued
+    std::mutex mtx_;
+    std::map<std::string, std::unique_ptr<component_t>> components_ = {};
+    std::map<uint64_t, client_t> clients_ = {};
+    uint64_t nextClient_ = 1;
+    bool waitClient_ = false;                ///< PROBE_WAIT_CLIENT
+    bool done_ = false;
+    std::thread thread_;
 
-}; //class ProbeSocket
+}; //class ProbeServer
 
 } // namespace SSTDEBUG::Probe
 #endif /* SST_DEBUG_PROBE_H */
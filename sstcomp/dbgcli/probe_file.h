@@ -0,0 +1,108 @@
+// Copyright 2009-2024 NTESS. Under the terms
+// of Contract DE-NA0003525 with NTESS, the U.S.
+// Government retains certain rights in this software.
+//
+// Copyright (c) 2009-2024, NTESS
+// All rights reserved.
+//
+// This file is part of the SST software package. For license
+// information, see the LICENSE file in the top level directory of the
+// distribution.
+
+#ifndef SST_DEBUG_PROBE_FILE_H
+#define SST_DEBUG_PROBE_FILE_H
+
+// -- Standard Headers
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary probe trace file format, shared by the flush2file writer and the
+// readprobe decoder (src/readprobe). No SST dependencies.
+//
+// A file holds the flushed probe buffers of every component on one rank
+// and thread. It starts with a probe_file_header_t followed by blocks, each
+// starting with a probe_block_t:
+//
+//   LAYOUT  probe_layout_t, then num_fields probe_field_t describing the
+//           records of the data blocks using this layout id
+//   DATA    probe_data_t, the component name (name_len bytes), the saved
+//           trigger record when has_trigger_rec is set, then num_recs
+//           entries of an 8 byte record header
+//           ((sequence + 1) << 2 | trigger tag) and the record bytes
+//
+// Integers are in host byte order. Nothing is padded.
+
+namespace SSTDEBUG::Probe {
+
+static const char PROBE_FILE_MAGIC[8] = {'S','S','T','P','R','O','B','E'};
+static const uint32_t PROBE_FILE_VERSION = 1;
+
+struct probe_file_header_t {
+    char     magic[8];      // PROBE_FILE_MAGIC
+    uint32_t version;       // PROBE_FILE_VERSION
+    uint32_t rank;          // writing rank
+    uint32_t thread;        // writing thread
+    uint32_t reserved;
+};
+
+enum class BLOCK_KIND : uint32_t { LAYOUT = 1, DATA = 2 };
+
+struct probe_block_t {
+    uint32_t kind;          // BLOCK_KIND
+    uint32_t bytes;         // size of the block after this header
+};
+
+struct probe_layout_t {
+    uint32_t id;            // referenced by probe_data_t::layout
+    uint32_t rec_bytes;     // sizeof the record
+    uint32_t num_fields;
+    uint32_t reserved;
+};
+
+enum class FIELD_TYPE : uint16_t { UINT = 0, INT = 1, FLOAT = 2, RAW = 3 };
+
+struct probe_field_t {
+    char     name[28];      // nul terminated
+    uint32_t offset;        // byte offset in the record
+    uint16_t size;          // bytes
+    uint16_t type;          // FIELD_TYPE
+};
+
+struct probe_data_t {
+    uint32_t layout;        // layout id of the records
+    uint32_t name_len;      // component name bytes
+    uint64_t cycle;         // sync point cycle of the flush
+    uint64_t num_recs;      // records in the block
+    uint64_t samples_lost;  // samples overwritten after a trigger overrun
+    uint32_t trig_state;    // ProbeBufCtl::TRIGGER_STATE at the flush
+    uint32_t has_trigger_rec; // 1 after an overrun wrote over the trigger record
+};
+
+/// Field description for a record member of type F. See PROBE_FIELD.
+template<typename F>
+probe_field_t make_probe_field(const char* name, size_t offset) {
+    static_assert(std::is_arithmetic_v<F>, "probe fields are integers or floating point");
+    probe_field_t f = {};
+    strncpy(f.name, name, sizeof(f.name) - 1);
+    f.offset = static_cast<uint32_t>(offset);
+    f.size = static_cast<uint16_t>(sizeof(F));
+    f.type = static_cast<uint16_t>(std::is_floating_point_v<F> ? FIELD_TYPE::FLOAT
+                                 : std::is_signed_v<F> ? FIELD_TYPE::INT : FIELD_TYPE::UINT);
+    return f;
+}
+/// Describe member m of record type R, shown by decoders as name
+#define PROBE_FIELD(R, m, name) SSTDEBUG::Probe::make_probe_field<decltype(R::m)>(name, offsetof(R, m))
+
+/// Append the raw bytes of v to a file buffer
+template<typename V>
+void probe_append(std::vector<char>& out, const V& v) {
+    const char* p = reinterpret_cast<const char*>(&v);
+    out.insert(out.end(), p, p + sizeof(V));
+}
+
+} // namespace SSTDEBUG::Probe
+#endif /* SST_DEBUG_PROBE_FILE_H */
@@ -0,0 +1,400 @@
+// Copyright 2009-2024 NTESS. Under the terms
+// of Contract DE-NA0003525 with NTESS, the U.S.
+// Government retains certain rights in this software.
+//
+// Copyright (c) 2009-2024, NTESS
+// All rights reserved.
+//
+// This file is part of the SST software package. For license
+// information, see the LICENSE file in the top level directory of the
+// distribution.
+
+#ifndef SST_DEBUG_PROBE_TRIGGER_H
+#define SST_DEBUG_PROBE_TRIGGER_H
+
+// -- Standard Headers
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "probe_file.h"
+
+// No SST dependencies. Timed by test/dbgcli/probe-bench.cc.
+
+namespace SSTDEBUG::Probe {
+
+// Trigger condition over the fields of a probe record, compiled at run time
+// so a trigger can be set from a parameter or re-armed from the CLI.
+//
+//   expr  := cond ( "then" cond [ "within" N ] )*
+//   cond  := comparisons and arithmetic over record fields and numbers
+//            with C operators and precedence:  || && == != < <= > >=
+//            + - * / % & and unary ! -
+//   count(cond)   samples so far on which cond held
+//   rise(cond)    cond holds and did not on the previous sample
+//
+// "A then B within N" holds on a sample where B holds and A held on one of
+// the N samples before it (any earlier sample without "within").
+//
+//   sz > 100 && priority == 50
+//   count(sz == 1) >= 10
+//   rise(sz > 90) then sz < 10 within 4
+//
+// Fields are the ones described with ProbeBufCtl::setFields. The expression
+// compiles to a flat postfix program run by eval() on each captured record.
+// Integer fields are evaluated as int64_t and floating point ones as
+// double. State kept for count, rise and then is cleared by reset().
+class ProbeTrigger {
+public:
+    /// Compile expr for records with the given fields. Returns nullptr and
+    /// sets error when expr is not valid.
+    static std::shared_ptr<ProbeTrigger> compile(const std::string& expr,
+                                                 const std::vector<probe_field_t>& fields,
+                                                 std::string& error) {
+        std::shared_ptr<ProbeTrigger> t(new ProbeTrigger(expr));
+        Parser p(expr, fields, *t);
+        if (!p.parse(error)) return nullptr;
+        t->reset();
+        return t;
+    }
+    const std::string& expr() const { return expr_; }
+    /// Clear the sample count and the count, rise and then state
+    void reset() {
+        sample_ = 0;
+        state_.assign(state_.size(), 0);
+    }
+    /// Evaluate for the next record
+    bool eval(const void* rec) {
+        const char* r = static_cast<const char*>(rec);
+        value_t st[MAX_STACK];
+        value_t* sp = st - 1;    // top of stack
+        for (const op_t& o : code_) {
+            switch (o.op) {
+            case OP::U8:   ++sp; sp->i = load<uint8_t>(r + o.arg); break;
+            case OP::U16:  ++sp; sp->i = load<uint16_t>(r + o.arg); break;
+            case OP::U32:  ++sp; sp->i = load<uint32_t>(r + o.arg); break;
+            case OP::U64:  ++sp; sp->i = static_cast<int64_t>(load<uint64_t>(r + o.arg)); break;
+            case OP::I8:   ++sp; sp->i = load<int8_t>(r + o.arg); break;
+            case OP::I16:  ++sp; sp->i = load<int16_t>(r + o.arg); break;
+            case OP::I32:  ++sp; sp->i = load<int32_t>(r + o.arg); break;
+            case OP::I64:  ++sp; sp->i = load<int64_t>(r + o.arg); break;
+            case OP::F32:  ++sp; sp->f = load<float>(r + o.arg); break;
+            case OP::F64:  ++sp; sp->f = load<double>(r + o.arg); break;
+            case OP::CONST: ++sp; *sp = o.imm; break;
+            case OP::I2F:  sp->f = static_cast<double>(sp->i); break;
+            case OP::I2F2: sp[-1].f = static_cast<double>(sp[-1].i); break;
+            case OP::F2B:  sp->i = sp->f != 0.0; break;
+            case OP::NEG:  sp->i = -sp->i; break;
+            case OP::FNEG: sp->f = -sp->f; break;
+            case OP::NOT:  sp->i = !sp->i; break;
+            case OP::ADD:  sp--; sp->i += sp[1].i; break;
+            case OP::SUB:  sp--; sp->i -= sp[1].i; break;
+            case OP::MUL:  sp--; sp->i *= sp[1].i; break;
+            case OP::DIV:  sp--; sp->i = sp[1].i ? sp->i / sp[1].i : 0; break;
+            case OP::MOD:  sp--; sp->i = sp[1].i ? sp->i % sp[1].i : 0; break;
+            case OP::BAND: sp--; sp->i &= sp[1].i; break;
+            case OP::FADD: sp--; sp->f += sp[1].f; break;
+            case OP::FSUB: sp--; sp->f -= sp[1].f; break;
+            case OP::FMUL: sp--; sp->f *= sp[1].f; break;
+            case OP::FDIV: sp--; sp->f /= sp[1].f; break;
+            case OP::EQ:   sp--; sp->i = sp->i == sp[1].i; break;
+            case OP::NE:   sp--; sp->i = sp->i != sp[1].i; break;
+            case OP::LT:   sp--; sp->i = sp->i <  sp[1].i; break;
+            case OP::LE:   sp--; sp->i = sp->i <= sp[1].i; break;
+            case OP::GT:   sp--; sp->i = sp->i >  sp[1].i; break;
+            case OP::GE:   sp--; sp->i = sp->i >= sp[1].i; break;
+            case OP::FEQ:  sp--; sp->i = sp->f == sp[1].f; break;
+            case OP::FNE:  sp--; sp->i = sp->f != sp[1].f; break;
+            case OP::FLT:  sp--; sp->i = sp->f <  sp[1].f; break;
+            case OP::FLE:  sp--; sp->i = sp->f <= sp[1].f; break;
+            case OP::FGT:  sp--; sp->i = sp->f >  sp[1].f; break;
+            case OP::FGE:  sp--; sp->i = sp->f >= sp[1].f; break;
+            case OP::AND:  sp--; sp->i = sp->i && sp[1].i; break;
+            case OP::OR:   sp--; sp->i = sp->i || sp[1].i; break;
+            case OP::COUNT:
+                state_[o.arg] += static_cast<uint64_t>(sp->i != 0);
+                sp->i = static_cast<int64_t>(state_[o.arg]);
+                break;
+            case OP::RISE: {
+                const bool now = sp->i != 0;
+                sp->i = now && !state_[o.arg];
+                state_[o.arg] = now;
+                break;
+            }
+            case OP::THEN: {
+                // state: 1 + sample on which the first condition last held
+                sp--;
+                const uint64_t last = state_[o.arg];
+                const bool b = sp[1].i != 0;
+                if (sp->i) state_[o.arg] = sample_ + 1;
+                sp->i = b && last && (o.imm.i == 0 || sample_ + 1 - last <= static_cast<uint64_t>(o.imm.i));
+                break;
+            }
+            }
+        }
+        sample_++;
+        return st[0].i != 0;
+    }
+    size_t size() const { return code_.size(); }   ///< program length
+
+private:
+    static constexpr int MAX_STACK = 16;
+    enum class OP : uint8_t {
+        U8, U16, U32, U64, I8, I16, I32, I64, F32, F64, CONST,
+        I2F, I2F2, F2B, NEG, FNEG, NOT,
+        ADD, SUB, MUL, DIV, MOD, BAND, FADD, FSUB, FMUL, FDIV,
+        EQ, NE, LT, LE, GT, GE, FEQ, FNE, FLT, FLE, FGT, FGE,
+        AND, OR, COUNT, RISE, THEN,
+    };
+    union value_t {
+        int64_t i;
+        double f;
+    };
+    struct op_t {
+        OP op;
+        uint32_t arg;       // field offset or state slot
+        value_t imm;        // constant, or the within limit of THEN
+    };
+    template<typename V> static V load(const char* p) {
+        V v;
+        memcpy(&v, p, sizeof(V));
+        return v;
+    }
+    explicit ProbeTrigger(const std::string& expr) : expr_(expr) {}
+
+    // Recursive descent compiler. Each rule emits the postfix code of its
+    // operands before its operator and returns whether the result is a
+    // double.
+    class Parser {
+    public:
+        Parser(const std::string& s, const std::vector<probe_field_t>& fields, ProbeTrigger& t)
+            : s_(s), fields_(fields), t_(t) {}
+        bool parse(std::string& error) {
+            next();
+            bool f = sequence();
+            if (f) emit(OP::F2B);
+            if (tok_ != TOK::END) fail("unexpected '" + text_ + "'");
+            if (err_.empty() && depth_ != 1) fail("empty expression");
+            error = err_;
+            return err_.empty();
+        }
+    private:
+        enum class TOK { END, NUM, NAME, OP, LPAREN, RPAREN };
+        const std::string& s_;
+        const std::vector<probe_field_t>& fields_;
+        ProbeTrigger& t_;
+        size_t pos_ = 0;
+        size_t start_ = 0;       // offset of the current token
+        TOK tok_ = TOK::END;
+        std::string text_ = {};
+        value_t num_ = {};
+        bool numIsFloat_ = false;
+        int depth_ = 0;          // stack depth at run time
+        std::string err_ = {};
+
+        void fail(const std::string& msg) { fail(msg, start_); }
+        void fail(const std::string& msg, size_t at) {
+            if (err_.empty()) err_ = msg + " at offset " + std::to_string(at);
+        }
+        void emit(OP op, uint32_t arg = 0, value_t imm = {}) {
+            t_.code_.push_back({op, arg, imm});
+            switch (op) {
+            case OP::U8: case OP::U16: case OP::U32: case OP::U64:
+            case OP::I8: case OP::I16: case OP::I32: case OP::I64:
+            case OP::F32: case OP::F64: case OP::CONST:
+                if (++depth_ > MAX_STACK) fail("expression too deep");
+                break;
+            case OP::I2F: case OP::I2F2: case OP::F2B: case OP::NEG: case OP::FNEG:
+            case OP::NOT: case OP::COUNT: case OP::RISE:
+                break;
+            default:
+                depth_--;
+                break;
+            }
+        }
+        uint32_t slot() {
+            t_.state_.push_back(0);
+            return static_cast<uint32_t>(t_.state_.size() - 1);
+        }
+        void next() {
+            while (pos_ < s_.size() && isspace(static_cast<unsigned char>(s_[pos_]))) pos_++;
+            text_.clear();
+            start_ = pos_;
+            if (pos_ >= s_.size()) { tok_ = TOK::END; return; }
+            const char* p = s_.c_str() + pos_;
+            char c = *p;
+            if (isdigit(static_cast<unsigned char>(c)) || (c == '.' && isdigit(static_cast<unsigned char>(p[1])))) {
+                char* end = nullptr;
+                const bool hex = c == '0' && (p[1] == 'x' || p[1] == 'X');
+                num_.i = static_cast<int64_t>(strtoull(p, &end, hex ? 16 : 10));
+                numIsFloat_ = !hex && (*end == '.' || *end == 'e' || *end == 'E');
+                if (numIsFloat_) num_.f = strtod(p, &end);
+                tok_ = TOK::NUM;
+                text_.assign(p, static_cast<size_t>(end - p));
+            } else if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                size_t n = 0;
+                while (isalnum(static_cast<unsigned char>(p[n])) || p[n] == '_') n++;
+                tok_ = TOK::NAME;
+                text_.assign(p, n);
+            } else if (c == '(' || c == ')') {
+                tok_ = c == '(' ? TOK::LPAREN : TOK::RPAREN;
+                text_ = c;
+            } else {
+                static const char* ops[] = { "&&", "||", "==", "!=", "<=", ">=",
+                                             "<", ">", "!", "+", "-", "*", "/", "%", "&" };
+                tok_ = TOK::OP;
+                for (const char* o : ops)
+                    if (strncmp(p, o, strlen(o)) == 0) { text_ = o; break; }
+                if (text_.empty()) {
+                    text_ = c;
+                    fail(std::string("unknown character '") + c + "'");
+                    tok_ = TOK::END;
+                    return;
+                }
+            }
+            pos_ += text_.size();
+        }
+        bool accept(const char* op) {
+            if ((tok_ != TOK::OP && tok_ != TOK::NAME) || text_ != op) return false;
+            next();
+            return true;
+        }
+        // both operands as int, or both as double
+        bool promote(bool lf, bool rf) {
+            if (lf && !rf) emit(OP::I2F);
+            else if (!lf && rf) emit(OP::I2F2);
+            return lf || rf;
+        }
+        void boolean(bool f) { if (f) emit(OP::F2B); }
+
+        bool sequence() {
+            bool f = logical_or();
+            while (accept("then")) {
+                boolean(f);
+                boolean(logical_or());
+                value_t within = {};
+                if (accept("within")) {
+                    if (tok_ != TOK::NUM || numIsFloat_ || num_.i <= 0) fail("'within' needs a sample count");
+                    within = num_;
+                    next();
+                }
+                emit(OP::THEN, slot(), within);
+                f = false;
+            }
+            return f;
+        }
+        bool logical_or() {
+            bool f = logical_and();
+            while (accept("||")) {
+                boolean(f);
+                boolean(logical_and());
+                emit(OP::OR);
+                f = false;
+            }
+            return f;
+        }
+        bool logical_and() {
+            bool f = comparison();
+            while (accept("&&")) {
+                boolean(f);
+                boolean(comparison());
+                emit(OP::AND);
+                f = false;
+            }
+            return f;
+        }
+        bool comparison() {
+            static const struct { const char* s; OP i; OP f; } rel[] = {
+                {"==", OP::EQ, OP::FEQ}, {"!=", OP::NE, OP::FNE}, {"<=", OP::LE, OP::FLE},
+                {">=", OP::GE, OP::FGE}, {"<", OP::LT, OP::FLT}, {">", OP::GT, OP::FGT} };
+            bool f = additive();
+            for (const auto& r : rel) {
+                if (accept(r.s)) {
+                    emit(promote(f, additive()) ? r.f : r.i);
+                    return false;
+                }
+            }
+            return f;
+        }
+        bool additive() {
+            bool f = multiplicative();
+            for (;;) {
+                if (accept("+")) { f = promote(f, multiplicative()); emit(f ? OP::FADD : OP::ADD); }
+                else if (accept("-")) { f = promote(f, multiplicative()); emit(f ? OP::FSUB : OP::SUB); }
+                else return f;
+            }
+        }
+        bool multiplicative() {
+            bool f = unary();
+            for (;;) {
+                if (accept("*")) { f = promote(f, unary()); emit(f ? OP::FMUL : OP::MUL); }
+                else if (accept("/")) { f = promote(f, unary()); emit(f ? OP::FDIV : OP::DIV); }
+                else if (accept("%")) { if (promote(f, unary())) fail("'%' needs integers"); emit(OP::MOD); }
+                else if (accept("&")) { if (promote(f, unary())) fail("'&' needs integers"); emit(OP::BAND); }
+                else return f;
+            }
+        }
+        bool unary() {
+            if (accept("!")) { boolean(unary()); emit(OP::NOT); return false; }
+            if (accept("-")) { bool f = unary(); emit(f ? OP::FNEG : OP::NEG); return f; }
+            return primary();
+        }
+        bool primary() {
+            if (tok_ == TOK::NUM) {
+                bool f = numIsFloat_;
+                emit(OP::CONST, 0, num_);
+                next();
+                return f;
+            }
+            if (tok_ == TOK::LPAREN) {
+                next();
+                bool f = sequence();
+                if (tok_ != TOK::RPAREN) fail("missing ')'");
+                next();
+                return f;
+            }
+            if (tok_ != TOK::NAME) {
+                fail(tok_ == TOK::END ? "unexpected end" : "unexpected '" + text_ + "'");
+                tok_ = TOK::END;
+                return false;
+            }
+            const std::string name = text_;
+            const size_t at = start_;
+            next();
+            if (name == "count" || name == "rise") {
+                if (tok_ != TOK::LPAREN) fail("'" + name + "' needs '('", at);
+                boolean(primary());
+                emit(name == "count" ? OP::COUNT : OP::RISE, slot());
+                return false;
+            }
+            for (const probe_field_t& fd : fields_) {
+                if (name != fd.name) continue;
+                static const OP uints[] = { OP::U8, OP::U16, OP::U32, OP::U64 };
+                static const OP ints[]  = { OP::I8, OP::I16, OP::I32, OP::I64 };
+                const int log2 = fd.size == 1 ? 0 : fd.size == 2 ? 1 : fd.size == 4 ? 2 : 3;
+                switch (static_cast<FIELD_TYPE>(fd.type)) {
+                case FIELD_TYPE::UINT:  emit(uints[log2], fd.offset); return false;
+                case FIELD_TYPE::INT:   emit(ints[log2], fd.offset); return false;
+                case FIELD_TYPE::FLOAT: emit(fd.size == 4 ? OP::F32 : OP::F64, fd.offset); return true;
+                default:
+                    fail("field '" + name + "' is not a number", at);
+                    return false;
+                }
+            }
+            fail("unknown field '" + name + "'", at);
+            return false;
+        }
+    };
+
+    std::string expr_;
+    std::vector<op_t> code_ = {};
+    std::vector<uint64_t> state_ = {};   ///< per count/rise/then state
+    uint64_t sample_ = 0;                ///< records evaluated since reset
+};
+
+} // namespace SSTDEBUG::Probe
+#endif /* SST_DEBUG_PROBE_TRIGGER_H */
@@ -1,6 +1,15 @@
 #ifndef __EIGEN__
 #define __EIGEN__
 
+// NN_CHECK_NO_MALLOC (SST_TOOLS_NEURALNET_CHECK_NO_MALLOC) lets the neural
+// net layers forbid Eigen heap allocations at run time (NNMallocScope)
+#ifdef NN_CHECK_NO_MALLOC
+#ifdef NDEBUG
+#error "NN_CHECK_NO_MALLOC reports through eigen_assert. Build without NDEBUG."
+#endif
+#define EIGEN_RUNTIME_NO_MALLOC
+#endif
+
 // clang-format off
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wconversion"
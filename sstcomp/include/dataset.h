@@ -4,10 +4,14 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <string>
 
+#include "dataset_cache.h"
 #include "eigen_utils.h"
+#include "nnscalar.h"
 #include "nnglobals.h"
+#include "thread_pool.h"
 #include "OPENCV.h"
 
 namespace fs = std::filesystem;
@@ -48,6 +52,7 @@ struct MNISTinfo {
 // Adjust image for use with predictor
 struct EigenImage {
   enum TRANSFORM { NONE, INVERT, LINEARIZE };
+  static constexpr int SIZE = 28;  // images are scaled to SIZE x SIZE
   Eigen::MatrixXd image_matrix = {}; // 2D matrix
   Eigen::MatrixXd linear_image = {}; // single row with entire image.
   std::string filepath;
@@ -98,11 +103,37 @@ struct EigenImage {
     }
   };
 
+  // Decode straight into one dataset row: SIZE*SIZE values in row-major
+  // (linearized) order, conditionally inverted and normalized to -1..1
+  // with the same arithmetic as load(). Safe to call from several threads.
+  // Returns false if the file cannot be read.
+  static bool decode(const std::string& filepath, TRANSFORM invert, nn_scalar_t* row) {
+    cv::Mat original_image = cv::imread(filepath, cv::IMREAD_GRAYSCALE);
+    if (original_image.empty())
+      return false;
+    cv::Mat image = {};
+    if ( original_image.rows != SIZE  || original_image.cols != SIZE ) {
+      cv::Size size28(SIZE,SIZE);
+      cv::resize(original_image, image, size28, 0, 0, cv::INTER_LINEAR);
+    } else {
+      image = original_image;
+    }
+    for (int r=0; r<SIZE; r++) {
+      const unsigned char* px = image.ptr(r);
+      for (int c=0; c<SIZE; c++) {
+        double v = px[c];
+        if (invert == INVERT)
+          v = 255 - v;
+        *row++ = static_cast<nn_scalar_t>((v - 127.5) / 127.5);
+      }
+    }
+    return true;
+  }
+
 }; //struct EigenImage
 
 // Internal representation of image file for training
 struct MNIST_image_t {
-  Eigen::MatrixXd data = {};
   int label = -1;
   fs::path image_path = {};
 };
@@ -118,15 +149,45 @@ private:
   double stddev_ = 0; // scalar only
   Eigen::VectorXd vecScalars = {};
   std::vector<MNIST_image_t> mnist_images = {};
+  RowMatrixXs samples_ = {};   // backing store for data unless a cache is mapped
+  DatasetCache cache_ = {};
+  // Point data at n x cols contiguous rows
+  void bind(const nn_scalar_t* p, Eigen::Index rows, Eigen::Index cols) {
+    new (&data) Eigen::Map<const RowMatrixXs>(p, rows, cols);
+  }
+  void bind() { bind(samples_.data(), samples_.rows(), samples_.cols()); }
 public:
-  Eigen::MatrixXd data;
+  Eigen::Map<const RowMatrixXs> data{nullptr, 0, 0}; // one sample per row
   Eigen::MatrixXi classes;   // for classification mode (e.g. spiral)
   Eigen::MatrixXd scalars;   // for regression/scalar mode (e.g. sine)
   double stddev() { return stddev_; }
+  bool cached() const { return cache_.mapped(); }
 
   // Training and validation data
   Dataset() {};
-  void load(const std::string& pathstring, DTYPE dtype, uint64_t limitPerClass, bool print=false) 
+  // data may view this object's own storage so datasets are not copied
+  Dataset(const Dataset&) = delete;
+  Dataset& operator=(const Dataset&) = delete;
+
+  // Drop all samples and unmap any cache
+  void clear() {
+    bind(nullptr, 0, 0);
+    cache_.close();
+    samples_.resize(0, 0);
+    classes.resize(0, 0);
+    scalars.resize(0, 0);
+    vecScalars.resize(0);
+    mnist_images.clear();
+    dtype_ = INVALID;
+    n_samples = n_classes = 0;
+    stddev_ = 0;
+  }
+
+  // IMAGE datasets only:
+  //   useCache  decoded images are kept in a binary cache next to the
+  //             image directory and mapped on later loads
+  //   threads   image decoding threads, 0 for one per hardware thread
+  void load(const std::string& pathstring, DTYPE dtype, uint64_t limitPerClass, bool print=false, bool useCache=false, unsigned threads=0) 
   {
     dtype_ = dtype;
     const char* path = pathstring.c_str();
@@ -146,7 +207,7 @@ public:
         load_scalar_data(path, print);
         break;
       case IMAGE: 
-        load_mnist_dataset(path, g_shuffle, limitPerClass, print);
+        load_mnist_dataset(path, g_shuffle, limitPerClass, print, useCache, threads);
         break;
       case INVALID:
         assert(false);
@@ -159,18 +220,19 @@ public:
     int rc = fscanf(f, "%d %d\n", &n_samples, &n_classes); assert(rc);
     int n_total = n_samples * n_classes;
     // std::cout << "spiral_data " << n_samples << " samples, " << n_classes << " classes, " << n_total << " entries" << std::endl;
-    data.resize(n_total, 2);
+    samples_.resize(n_total, 2);
     classes.resize(n_total, 1);
 
     double x,y;
     rc = fscanf(f, "[[%lf %lf]\n", &x, &y); assert(rc);
-    data(0,0) = x; data(0,1) = y;
+    samples_(0,0) = static_cast<nn_scalar_t>(x); samples_(0,1) = static_cast<nn_scalar_t>(y);
     for (int n=1;n<n_total-1; n++) {
       rc = fscanf(f, " [%lf %lf]\n", &x, &y); assert(rc);
-      data(n,0) = x; data(n,1) = y;
+      samples_(n,0) = static_cast<nn_scalar_t>(x); samples_(n,1) = static_cast<nn_scalar_t>(y);
     }
     rc = fscanf(f, " [%lf %lf]]\n", &x, &y); assert(rc);
-    data(n_total-1,0) = x; data(n_total-1,1) = y;
+    samples_(n_total-1,0) = static_cast<nn_scalar_t>(x); samples_(n_total-1,1) = static_cast<nn_scalar_t>(y);
+    bind();
 
     int d;
     rc = fscanf(f, "[%d", &d); assert(rc);
@@ -203,14 +265,15 @@ public:
     inputFile >> n_samples;
     assert(n_samples>0);
 
-    data.resize(n_samples,1);
+    samples_.resize(n_samples,1);
     scalars.resize(n_samples,1);
     vecScalars.resize(n_samples);
     double v;
     for (int i=0;i<n_samples; i++) {
       inputFile >> v;
-      data(i,0) = v;
+      samples_(i,0) = static_cast<nn_scalar_t>(v);
     }
+    bind();
     for (int i=0;i<n_samples;i++) {
       inputFile >> v;
       scalars(i,0) = v;
@@ -227,11 +290,34 @@ public:
 
   };
 
-  void load_mnist_dataset(const char* dir, bool shuffle, uint64_t classImageLimit, bool print=false) {
+  void load_mnist_dataset(const char* dir, bool shuffle, uint64_t classImageLimit, bool print=false, bool useCache=false, unsigned threads=0) {
     
     assert(this->data.size()==0);
-    // Scan all the directories and create a list of labels
     fs::path fullPath = fs::path(dir);
+
+    // A cache built from the same directory listing and options
+    // replaces decoding entirely
+    fs::path cachePath = {};
+    uint64_t fingerprint = 0;
+    if (useCache) {
+      cachePath = DatasetCache::path_for(fullPath);
+      try {
+        fingerprint = DatasetCache::fingerprint(fullPath, classImageLimit, shuffle);
+      } catch (const fs::filesystem_error& e) {
+        std::cerr << "Error accessing directory: " << e.what() << std::endl;
+        exit(1);
+      }
+      if (cache_.open(cachePath, fingerprint)) {
+        bind(cache_.images(), cache_.rows(), cache_.cols());
+        classes = Eigen::Map<const Eigen::Matrix<int32_t, Eigen::Dynamic, 1>>(cache_.labels(), cache_.rows()).cast<int>();
+        n_samples = (int) cache_.rows();
+        if (print)
+          std::cout << "Mapped " << cache_.rows() << " images from " << cachePath.string() << std::endl;
+        return;
+      }
+    }
+
+    // Scan all the directories and create a list of labels
     std::vector<std::string> labels;
     try {
         for (const auto& entry : fs::directory_iterator(fullPath)) {
@@ -243,37 +329,18 @@ public:
         std::cerr << "Error accessing directory: " << e.what() << std::endl;
         exit(1);
     }
-    // Iterate over each label directory
-    std::vector<fs::path> image_paths;
-    Eigen::Index image_rows = 0;
-    Eigen::Index image_cols = 0;
-    // pull in all the image files for this directory using opencv
+    // Iterate over each label directory. Only the file list is built here,
+    // images are decoded after the shuffle.
     for (const auto& label: labels){
       fs::path imgdir = fullPath / label;
       size_t icount = 0;
       try {
         for (const auto& entry : fs::directory_iterator(imgdir)) {
-          MNIST_image_t mnist_image = {};
           // check limit
           if (icount++ >= classImageLimit) 
             break;
-          // save image path
-          std::string path = entry.path().string();
-          image_paths.push_back(path);
-          // Load the image
-          EigenImage eigenImage;
-          eigenImage.load(path.c_str());
-          // And append it and label to the lists
-          mnist_image.data = eigenImage.image_matrix;
-          // consistency checking
-          if (image_rows==0) {
-            image_rows = mnist_image.data.rows();
-            image_cols = mnist_image.data.cols();
-          } else {
-            assert(image_rows == mnist_image.data.rows());
-            assert(image_cols == mnist_image.data.cols());
-          }
-          // update label vector
+          MNIST_image_t mnist_image = {};
+          mnist_image.image_path = entry.path();
           mnist_image.label = std::stoi(label);
           mnist_images.emplace_back(mnist_image);
         }
@@ -288,6 +355,7 @@ public:
     }
 
     // conditionally shuffle the vectors
+    // (the permutation only depends on the number of images)
     if (shuffle) {
       // Create a Mersenne Twister engine
       #if 0
@@ -299,28 +367,31 @@ public:
 
     }
 
-    // convert mnist vector data and labels to a 2D arrays. 
-    // For the data, each row will be an entire serialized image.
+    // Decode each image into its row. For the data, each row will be an
+    // entire serialized image.
+    decode_images(EigenImage::NONE, threads);
     unsigned total_rows = (unsigned) mnist_images.size();
-    unsigned total_cols = (unsigned)(image_rows * image_cols);
-    data.resize(total_rows, total_cols);
     classes.resize(total_rows,1);
-    for ( unsigned mnist_index=0; mnist_index<total_rows; mnist_index++) {
-      for (unsigned row=0; row<image_rows; row++) {
-        classes(mnist_index) = (int) mnist_images[mnist_index].label;
-        for (unsigned col=0; col<image_cols; col++) {
-          data(mnist_index,row*image_cols + col) = mnist_images[mnist_index].data(row,col);
-        }
-      }
-    }
+    for ( unsigned mnist_index=0; mnist_index<total_rows; mnist_index++)
+      classes(mnist_index) = (int) mnist_images[mnist_index].label;
+    n_samples = (int) total_rows;
 
     if (print)
       std::cout << "Loaded " << total_rows << " images" << std::endl;
+
+    if (useCache) {
+      if (DatasetCache::write(cachePath, fingerprint, samples_, classes)) {
+        if (print)
+          std::cout << "Wrote image cache " << cachePath.string() << std::endl;
+      } else {
+        std::cerr << "warning: could not write image cache " << cachePath.string() << std::endl;
+      }
+    }
   
   }
 
   // Evaluation data ( no class info )
-  void load_eval_images(const std::string& pathstring, EigenImage::TRANSFORM invert, EigenImage::TRANSFORM linearize, bool print=false) 
+  void load_eval_images(const std::string& pathstring, EigenImage::TRANSFORM invert, EigenImage::TRANSFORM linearize, bool print=false, unsigned threads=0) 
   {
     dtype_ = DTYPE::IMAGE;
     const char* path = pathstring.c_str();
@@ -333,26 +404,12 @@ public:
     }
     assert(this->data.size()==0);
     fs::path imgdir = pathstring;
-    Eigen::Index image_rows = 0;
-    Eigen::Index image_cols = 0;
     try {
       for (const auto& entry : fs::directory_iterator(imgdir)) {
         MNIST_image_t mnist_image = {};
         mnist_image.image_path = entry;
-        std::string path = entry.path().string();
-        // Load the image
-        EigenImage eigenImage;
-        eigenImage.load(path.c_str(), invert, linearize, true);
-        // And append it and label to the lists
-        mnist_image.data = eigenImage.image_matrix;
-        // consistency checking
-        if (image_rows==0) {
-          image_rows = mnist_image.data.rows();
-          image_cols = mnist_image.data.cols();
-        } else {
-          assert(image_rows == mnist_image.data.rows());
-          assert(image_cols == mnist_image.data.cols());
-        }
+        if (print) 
+          std::cout << "Loading image from " << entry.path().string() << std::endl;
         // push image
         mnist_images.emplace_back(mnist_image);
       }
@@ -361,24 +418,31 @@ public:
         exit(1);
     }
   
-    // convert mnist vector data to a 2D array where each row 
-    // is an entire serialized image.
-    unsigned total_rows = (unsigned) mnist_images.size();
-    unsigned total_cols = (unsigned)(image_rows * image_cols);
-    data.resize(total_rows, total_cols);
-    for ( unsigned mnist_index=0; mnist_index<total_rows; mnist_index++) {
-      for (unsigned row=0; row<image_rows; row++) {
-        for (unsigned col=0; col<image_cols; col++) {
-          data(mnist_index,row*image_cols + col) = mnist_images[mnist_index].data(row,col);
-        }
-      }
-    }
+    // Each row is an entire serialized (linearized) image
+    decode_images(invert, threads);
+    n_samples = (int) mnist_images.size();
 
     if (print)
-      std::cout << "Loaded " << total_rows << " images" << std::endl;
+      std::cout << "Loaded " << mnist_images.size() << " images" << std::endl;
     
   }
 
+private:
+  // Decode every image in mnist_images into the matching row of samples_
+  void decode_images(EigenImage::TRANSFORM invert, unsigned threads) {
+    const Eigen::Index rows = (Eigen::Index) mnist_images.size();
+    samples_.resize(rows, EigenImage::SIZE * EigenImage::SIZE);
+    ThreadPool pool(threads);
+    pool.parallel_for(mnist_images.size(), [&](size_t i) {
+      const std::string path = mnist_images[i].image_path.string();
+      if (!EigenImage::decode(path, invert, samples_.row((Eigen::Index) i).data())) {
+        std::cerr << "error: could not read file from path. [" << path << "]" << std::endl;
+        assert(false);
+      }
+    });
+    bind();
+  }
+
 }; //struct dataset
 
 
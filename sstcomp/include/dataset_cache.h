@@ -0,0 +1,165 @@
+#ifndef _DATASET_CACHE_H_
+#define _DATASET_CACHE_H_
+
+// Binary cache of a decoded image dataset. Decoding every PNG dominates
+// startup so the decoded matrix is written once and memory mapped on
+// later loads, including restarts from a checkpoint.
+//
+// File layout (native byte order):
+//   header_t                 64 bytes
+//   rows x cols nn_scalar_t  row-major, one image per row
+//   rows x int32_t           labels
+//
+// The header holds a fingerprint of the source directory listing and the
+// load options. A cache with a different fingerprint is rebuilt.
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nnscalar.h"
+
+class DatasetCache {
+public:
+  static constexpr uint64_t MAGIC = 0x31484341434e4e53;  // "SNNCACH1"
+
+  struct header_t {
+    uint64_t magic = MAGIC;
+    uint64_t fingerprint = 0;
+    uint64_t rows = 0;
+    uint64_t cols = 0;
+    uint32_t scalar_bytes = sizeof(nn_scalar_t);
+    uint32_t reserved[7] = {};
+  };
+  static_assert(sizeof(header_t) == 64, "cache header must keep the image block aligned");
+
+  DatasetCache() {}
+  ~DatasetCache() { close(); }
+  DatasetCache(const DatasetCache&) = delete;
+  DatasetCache& operator=(const DatasetCache&) = delete;
+
+  // Cache file for an image directory: <dir>.nncache next to the directory
+  static std::filesystem::path path_for(const std::filesystem::path& dir) {
+    std::filesystem::path d = dir.lexically_normal();
+    if (d.filename().empty())
+      d = d.parent_path();
+    return d.parent_path() / (d.filename().string() + ".nncache");
+  }
+
+  // FNV-1a over the class directory listing (names, sizes and modification
+  // times in iteration order, which is also the load order) and the options
+  // that change the decoded result.
+  static uint64_t fingerprint(const std::filesystem::path& dir, uint64_t limit, bool shuffle) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto mix = [&h](const void* p, size_t n) {
+      const unsigned char* c = static_cast<const unsigned char*>(p);
+      for (size_t i = 0; i < n; i++) { h ^= c[i]; h *= 0x100000001b3ull; }
+    };
+    auto mix_u64 = [&mix](uint64_t v) { mix(&v, sizeof(v)); };
+    mix_u64(limit);
+    mix_u64(shuffle);
+    mix_u64(sizeof(nn_scalar_t));
+    for (const auto& label : std::filesystem::directory_iterator(dir)) {
+      const std::string name = label.path().filename().string();
+      mix(name.data(), name.size());
+      if (!label.is_directory())
+        continue;
+      for (const auto& entry : std::filesystem::directory_iterator(label.path())) {
+        const std::string file = entry.path().filename().string();
+        mix(file.data(), file.size());
+        std::error_code ec;
+        mix_u64(static_cast<uint64_t>(entry.file_size(ec)));
+        mix_u64(static_cast<uint64_t>(entry.last_write_time(ec).time_since_epoch().count()));
+      }
+    }
+    return h;
+  }
+
+  // Map a cache file. Returns false if it is missing, truncated or stale.
+  bool open(const std::filesystem::path& file, uint64_t fingerprint) {
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(header_t);
+    if (ok) {
+      bytes_ = static_cast<size_t>(st.st_size);
+      addr_ = mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = addr_ != MAP_FAILED;
+      if (!ok)
+        addr_ = nullptr;
+    }
+    ::close(fd);
+    if (ok) {
+      const header_t& h = header();
+      ok = h.magic == MAGIC && h.fingerprint == fingerprint &&
+           h.scalar_bytes == sizeof(nn_scalar_t) &&
+           bytes_ == file_bytes(h.rows, h.cols);
+    }
+    if (!ok)
+      close();
+    return ok;
+  }
+
+  // Write a cache through a temporary file so a concurrent reader never sees
+  // a partial file. Failure (e.g. a read-only data directory) is not fatal.
+  static bool write(const std::filesystem::path& file, uint64_t fingerprint,
+                    const RowMatrixXs& images, const Eigen::MatrixXi& labels) {
+    header_t h;
+    h.fingerprint = fingerprint;
+    h.rows = static_cast<uint64_t>(images.rows());
+    h.cols = static_cast<uint64_t>(images.cols());
+    std::filesystem::path tmp = file;
+    tmp += "." + std::to_string(getpid());
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f)
+      return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = ok && fwrite(images.data(), sizeof(nn_scalar_t), static_cast<size_t>(images.size()), f) == static_cast<size_t>(images.size());
+    for (Eigen::Index i = 0; ok && i < labels.size(); i++) {
+      const int32_t label = labels(i);
+      ok = fwrite(&label, sizeof(label), 1, f) == 1;
+    }
+    ok = (fclose(f) == 0) && ok;
+    std::error_code ec;
+    if (ok)
+      std::filesystem::rename(tmp, file, ec);
+    if (!ok || ec)
+      std::filesystem::remove(tmp, ec);
+    return ok && !ec;
+  }
+
+  void close() {
+    if (addr_)
+      munmap(addr_, bytes_);
+    addr_ = nullptr;
+    bytes_ = 0;
+  }
+
+  bool mapped() const { return addr_ != nullptr; }
+  Eigen::Index rows() const { return static_cast<Eigen::Index>(header().rows); }
+  Eigen::Index cols() const { return static_cast<Eigen::Index>(header().cols); }
+  const nn_scalar_t* images() const {
+    return reinterpret_cast<const nn_scalar_t*>(static_cast<const char*>(addr_) + sizeof(header_t));
+  }
+  const int32_t* labels() const {
+    return reinterpret_cast<const int32_t*>(images() + rows() * cols());
+  }
+
+private:
+  const header_t& header() const { return *static_cast<const header_t*>(addr_); }
+  static size_t file_bytes(uint64_t rows, uint64_t cols) {
+    return sizeof(header_t) + rows * cols * sizeof(nn_scalar_t) + rows * sizeof(int32_t);
+  }
+  void* addr_ = nullptr;
+  size_t bytes_ = 0;
+};
+
+#endif //_DATASET_CACHE_H_
@@ -0,0 +1,56 @@
+#ifndef _EIGEN_BLOCK_H_
+#define _EIGEN_BLOCK_H_
+
+// Raw coefficient block of an Eigen matrix as checkpointed by
+// eigen_serialize.h. The block is written in the matrix's own storage
+// order at its own scalar width. A block stored as float or double can be
+// read into a matrix of the other width. Nothing here depends on SST, so
+// the conversion can be tested on its own (nn-kernels).
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "EIGEN.h"
+
+class EigenBlock {
+public:
+  // Bytes of the coefficient block of m
+  template<typename M>
+  static size_t bytes(const M& m) {
+    return static_cast<size_t>(m.size()) * sizeof(typename M::Scalar);
+  }
+
+  // Fill m, already sized, from a block of scalar_bytes wide coefficients.
+  // read(void* dst, size_t n) copies the next n bytes of the block. Returns
+  // false when the stored width can not be converted to m's scalar.
+  template<typename M, typename Read>
+  static bool unpack(M& m, uint32_t scalar_bytes, Read&& read) {
+    using Scalar = typename M::Scalar;
+    if (scalar_bytes == sizeof(Scalar)) {
+      read(m.data(), bytes(m));
+      return true;
+    }
+    if constexpr (std::is_floating_point_v<Scalar>) {
+      if (scalar_bytes == sizeof(float))
+        return unpack_converted<float>(m, read);
+      if (scalar_bytes == sizeof(double))
+        return unpack_converted<double>(m, read);
+    }
+    return false;
+  }
+
+private:
+  // Read a block stored with a different floating point width
+  template<typename Stored, typename M, typename Read>
+  static bool unpack_converted(M& m, Read& read) {
+    using S = Eigen::Matrix<Stored, M::RowsAtCompileTime, M::ColsAtCompileTime, M::Options,
+                            M::MaxRowsAtCompileTime, M::MaxColsAtCompileTime>;
+    S tmp(m.rows(), m.cols());
+    read(tmp.data(), bytes(tmp));
+    m = tmp.template cast<typename M::Scalar>();
+    return true;
+  }
+};
+
+#endif //_EIGEN_BLOCK_H_
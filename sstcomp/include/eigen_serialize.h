@@ -0,0 +1,76 @@
+#ifndef _EIGEN_SERIALIZE_H_
+#define _EIGEN_SERIALIZE_H_
+
+// Checkpoint support for Eigen matrices so they can be passed to SST_SER.
+//
+// SIZER/PACK/UNPACK: rows, cols and the scalar size followed by the
+// coefficients as one contiguous block (EigenBlock). A float/double
+// mismatch between the checkpoint and the restoring build is converted on
+// UNPACK.
+//
+// MAP: the matrix is a container whose coefficients (column-major index)
+// are only mapped when the debugger first lists them.
+
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+
+#include "EIGEN.h"
+#include "SST.h"
+#include "eigen_block.h"
+
+namespace SST::Core::Serialization {
+
+template<typename M>
+class ObjectMapEigen : public ObjectMapContainer<M> {
+public:
+  explicit ObjectMapEigen(M* addr) : ObjectMapContainer<M>(addr) {}
+
+  const std::vector<std::pair<std::string, ObjectMap*>>& getVariables() override {
+    if (!materialized_) {
+      materialized_ = true;
+      M& m = *this->addr_;
+      for (Eigen::Index i = 0; i < m.size(); i++)
+        this->addVariable(std::to_string(i), new ObjectMapFundamental<typename M::Scalar>(m.data() + i));
+    }
+    return ObjectMapContainer<M>::getVariables();
+  }
+
+private:
+  bool materialized_ = false;
+};
+
+template<typename Scalar, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+class serialize_impl<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols>> {
+  using M = Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols>;
+
+public:
+  void operator()(M& m, serializer& ser, ser_opt_t options) {
+    if (ser.mode() == serializer::MAP) {
+      ser.mapper().map_hierarchy_start(ser.getMapName(), new ObjectMapEigen<M>(&m));
+      ser.mapper().map_hierarchy_end();
+      return;
+    }
+
+    int64_t rows = m.rows();
+    int64_t cols = m.cols();
+    uint32_t scalar_bytes = sizeof(Scalar);
+    SST_SER(rows);
+    SST_SER(cols);
+    SST_SER(scalar_bytes);
+
+    if (ser.mode() == serializer::UNPACK) {
+      m.resize(rows, cols);
+      if (!EigenBlock::unpack(m, scalar_bytes, [&ser](void* p, size_t n) { ser.raw(p, n); }))
+        Output::getDefaultObject().fatal(CALL_INFO, -1,
+          "checkpointed %s has %" PRIu32 " byte scalars, expected %zu\n",
+          typeid(M).name(), scalar_bytes, sizeof(Scalar));
+      return;
+    }
+    ser.raw(m.data(), EigenBlock::bytes(m));
+  }
+};
+
+} // namespace SST::Core::Serialization
+
+#endif //_EIGEN_SERIALIZE_H_
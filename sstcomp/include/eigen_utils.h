@@ -1,7 +1,9 @@
 #ifndef _EIGEN_UTILS_
 #define _EIGEN_UTILS_
 
+#include <algorithm>
 #include <fstream>
+#include <iostream>
 #include <random>
 #include <vector>
 
@@ -25,27 +27,14 @@ static const std::string rand_normal_100k(std::string(getenv("HOME")).append("/w
 class Eutils {
 public:
 
-  std::string shapestr(const Eigen::MatrixXd& A) {
+  template<typename Derived>
+  std::string shapestr(const Eigen::EigenBase<Derived>& A) {
     std::stringstream s;
     s << "(" << std::dec << A.rows() << ", " << A.cols() << ")";
     std::string ret = s.str();
     return ret;
   }
 
-  std::string shapestr(const Eigen::MatrixXi& A) {
-    std::stringstream s;
-    s << "(" << std::dec << A.rows() << ", " << A.cols() << ")";
-    std::string ret = s.str();
-    return ret;
-  }
-
-  std::string shapestr(const Eigen::RowVectorXd& A) {
-    std::stringstream s;
-    s << "(1, " << std::dec << A.cols() << ")";
-    std::string ret = s.str();
-    return ret;
-  }
-
   void rand0to1flat(Eigen::MatrixXd& result, unsigned rows, unsigned cols,  bool readFromFile=false) {
     if (!readFromFile) {
       // - Add 1 to every element and divide by 2
@@ -128,13 +117,27 @@ public:
     }
   }
 
-  void argmax(Eigen::MatrixXd& result, const Eigen::MatrixXd& in) {
+  // Column of the largest value in each row, the first one on ties.
+  // Rows are handled in blocks a column at a time so the compares run
+  // down contiguous column-major data. The block lives on the stack.
+  template<typename R, typename M>
+  void argmax(Eigen::PlainObjectBase<R>& result, const Eigen::MatrixBase<M>& in) {
+    using S = typename R::Scalar;
+    using V = typename M::Scalar;
+    constexpr Eigen::Index BLOCK = 64;
     result.resize(in.rows(),1);
-    for (int i = 0; i < in.rows(); ++i) {
-        // Find the max value and its column index in the current row
-        long index;
-        in.row(i).maxCoeff(&index);
-        result(i,0) = (int)index;
+    if (in.cols() == 0)
+      return;
+    for (Eigen::Index r = 0; r < in.rows(); r += BLOCK) {
+      const Eigen::Index n = std::min(BLOCK, in.rows() - r);
+      Eigen::Array<V, Eigen::Dynamic, 1, Eigen::ColMajor, BLOCK, 1> best = in.col(0).segment(r, n).array();
+      Eigen::Array<S, Eigen::Dynamic, 1, Eigen::ColMajor, BLOCK, 1> index = Eigen::Array<S, Eigen::Dynamic, 1, Eigen::ColMajor, BLOCK, 1>::Zero(n);
+      for (Eigen::Index c = 1; c < in.cols(); c++) {
+        const auto v = in.col(c).segment(r, n).array();
+        index = (v > best).select(static_cast<S>(c), index);
+        best = best.max(v);
+      }
+      result.col(0).segment(r, n) = index.matrix();
     }
   }
 
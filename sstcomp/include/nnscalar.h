@@ -0,0 +1,35 @@
+#ifndef _NNSCALAR_H
+#define _NNSCALAR_H
+
+#include "EIGEN.h"
+
+// Scalar type for the neural net data path (payloads, weights,
+// activations, losses and datasets). Selected at build time:
+//   -DNN_SCALAR_FLOAT       single precision (SST_TOOLS_NEURALNET_FLOAT)
+//   -DNN_MIXED_PRECISION    with NN_SCALAR_FLOAT, keep the optimizer
+//                           state in double (SST_TOOLS_NEURALNET_MIXED)
+#ifdef NN_SCALAR_FLOAT
+typedef float nn_scalar_t;
+#else
+typedef double nn_scalar_t;
+#endif
+
+#if defined(NN_SCALAR_FLOAT) && defined(NN_MIXED_PRECISION)
+typedef double nn_opt_scalar_t;
+#else
+typedef nn_scalar_t nn_opt_scalar_t;
+#endif
+
+// Data path matrices
+typedef Eigen::Matrix<nn_scalar_t, Eigen::Dynamic, Eigen::Dynamic> MatrixXs;
+typedef Eigen::Matrix<nn_scalar_t, 1, Eigen::Dynamic> RowVectorXs;
+typedef Eigen::Matrix<nn_scalar_t, Eigen::Dynamic, 1> VectorXs;
+typedef Eigen::Array<nn_scalar_t, Eigen::Dynamic, Eigen::Dynamic> ArrayXXs;
+// Datasets, one sample per contiguous row
+typedef Eigen::Matrix<nn_scalar_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXs;
+
+// Optimizer state matrices
+typedef Eigen::Matrix<nn_opt_scalar_t, Eigen::Dynamic, Eigen::Dynamic> MatrixXo;
+typedef Eigen::Matrix<nn_opt_scalar_t, 1, Eigen::Dynamic> RowVectorXo;
+
+#endif //_NNSCALAR_H
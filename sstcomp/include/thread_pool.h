@@ -0,0 +1,105 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+// Fixed set of worker threads for data parallel loops. The calling thread
+// takes part in every loop so a pool of size 1 runs everything inline and
+// starts no threads.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  // threads==0 uses one thread per hardware thread
+  explicit ThreadPool(unsigned threads) {
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 1; t < threads; t++)
+      workers_.emplace_back([this] { work(); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_)
+      w.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // threads taking part in a loop, including the caller
+  unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+  // Call fn(i) for every i in [0,n) and wait for all of them. Indices are
+  // handed out one at a time so uneven items balance across threads.
+  // fn must not call parallel_for on the same pool.
+  void parallel_for(size_t n, const std::function<void(size_t)>& fn) {
+    if (workers_.empty() || n <= 1) {
+      for (size_t i = 0; i < n; i++)
+        fn(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fn_ = &fn;
+      n_ = n;
+      next_.store(0);
+      busy_ = workers_.size();
+      generation_++;
+    }
+    wake_.notify_all();
+    run();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+    fn_ = nullptr;
+  }
+
+private:
+  void run() {
+    for (size_t i = next_.fetch_add(1); i < n_; i = next_.fetch_add(1))
+      (*fn_)(i);
+  }
+
+  void work() {
+    uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+      }
+      run();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0)
+          done_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_ = {};
+  std::mutex mutex_ = {};
+  std::condition_variable wake_ = {};
+  std::condition_variable done_ = {};
+  const std::function<void(size_t)>* fn_ = nullptr;
+  size_t n_ = 0;
+  std::atomic<size_t> next_{0};
+  size_t busy_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+};
+
+#endif //_THREAD_POOL_H_
@@ -9,6 +9,7 @@
 //
 
 #include <assert.h>
+#include <numeric>
 #include "nn_batch_controller.h"
 #include "tcldbg.h"
 
@@ -25,9 +26,15 @@ NNBatchController::NNBatchController(SST::ComponentId_t id, const SST::Params& p
   // parameters
   batch_size = params.find<unsigned>("batchSize", 128);
   classImageLimit = params.find<unsigned>("classImageLimit", 100000);
+  datasetCache = params.find<bool>("datasetCache", true);
   epochs = params.find<unsigned>("epochs", 0);
+  eval_batch_size = params.find<unsigned>("evalBatchSize", 1);
   evalImagesStr = params.find<std::string>("evalImages");
+  loader_threads = params.find<unsigned>("loaderThreads", 0);
+  pipeline_depth = params.find<unsigned>("pipelineDepth", 1);
+  prefetch_depth = params.find<unsigned>("prefetchDepth", 0);
   print_every = params.find<unsigned>("printEvery", 100);
+  shuffle_seed = params.find<uint64_t>("shuffleSeed", 0);
   testImagesStr = params.find<std::string>("testImages");
   trainingImagesStr = params.find<std::string>("trainingImages");
   uint32_t Verbosity = params.find< uint32_t >( "verbose", 0 );
@@ -37,6 +44,11 @@ NNBatchController::NNBatchController(SST::ComponentId_t id, const SST::Params& p
     "NNBatchController[" + getName() + ":@p:@t]: ",
     Verbosity, 0, SST::Output::STDOUT );
 
+  if (pipeline_depth == 0)
+    output.fatal(CALL_INFO, -1, "pipelineDepth must be at least 1\n");
+  if (eval_batch_size == 0)
+    output.fatal(CALL_INFO, -1, "evalBatchSize must be at least 1\n");
+
   // clocking 
   const std::string systemClock = params.find< std::string >("clockFreq", "1GHz");
   clockHandler  = new SST::Clock::Handler<NNBatchController,&NNBatchController::clockTick>(this);
@@ -68,6 +80,7 @@ NNBatchController::NNBatchController(SST::ComponentId_t id, const SST::Params& p
 }
 
 NNBatchController::~NNBatchController(){
+  prefetcher.stop();
 }
 
 void NNBatchController::init( unsigned int phase ){
@@ -85,61 +98,142 @@ void NNBatchController::setup(){
   if (!enableTraining() && !enableValidation() && !enableEvaluation())
     output.fatal(CALL_INFO, -1, "Nothing to do. Please set --trainingImages, --testImages, and/or --evalImages");
 
-  if (enableTraining()) {
-    trainingImages.load(trainingImagesStr, Dataset::DTYPE::IMAGE, classImageLimit, true);
+  loadImages();
+  if (enableTraining())
+    fsmState_ = MODE::TRAINING;
+  else if (enableValidation())
+    fsmState_ = MODE::VALIDATION;
+  else if (enableEvaluation())
+    fsmState_ = MODE::EVALUATION;
+ 
+  output.verbose( CALL_INFO, 0,0, "setup completed. Ready for first clock\n");
+}
+
+void NNBatchController::complete( unsigned int phase ){}
+
+void NNBatchController::finish(){}
+
+void NNBatchController::emergencyShutdown(){}
+
+void NNBatchController::printStatus( Output& out ){}
+
+void NNBatchController::loadImages()
+{
+  // Only the sets still needed are loaded. Validation runs after every
+  // training epoch so the test images stay loaded while training is enabled.
+  if (enableTraining() && trainingImages.data.rows() == 0) {
+    trainingImages.load(trainingImagesStr, Dataset::DTYPE::IMAGE, classImageLimit, true, datasetCache, loader_threads);
     if (output.getVerboseLevel() > 2 ) {
       std::cout << "X" << util.shapestr(trainingImages.data) << "=\n" << HEAD(trainingImages.data) << std::endl;
       std::cout << "y" << util.shapestr(trainingImages.classes) << "=\n" << HEAD(trainingImages.classes.transpose()) << std::endl;
     }
-    fsmState_ = MODE::TRAINING;
   }
 
-  if (enableValidation()) {
-    testImages.load(testImagesStr, Dataset::DTYPE::IMAGE, classImageLimit, true);
+  if ((enableValidation() || enableTraining()) && testImagesStr.size()>0 && testImages.data.rows() == 0) {
+    testImages.load(testImagesStr, Dataset::DTYPE::IMAGE, classImageLimit, true, datasetCache, loader_threads);
     if (output.getVerboseLevel() > 2 ) {
       std::cout << "X_test"   << util.shapestr(testImages.data) << "=\n" << HEAD(testImages.data) << std::endl;
       std::cout << "y_test.T" << util.shapestr(testImages.classes) << ".T=\n" << HEAD(testImages.classes.transpose()) << std::endl;
     }
-    if (fsmState_==MODE::INVALID) fsmState_ = MODE::VALIDATION;
   }
 
-  if (enableEvaluation()) {
+  // With dbgReloadEvaluationImages set the images are loaded by
+  // initEvaluation() once the debug console has set the directory
+  if (enableEvaluation() && !dbgReloadEvaluationImages && evalImages.data.rows() == 0)
     loadEvaluationImages();
-    if (fsmState_==MODE::INVALID) fsmState_ = MODE::EVALUATION;
-  }
- 
-  output.verbose( CALL_INFO, 0,0, "setup completed. Ready for first clock\n");
 }
 
-void NNBatchController::complete( unsigned int phase ){}
-
-void NNBatchController::finish(){}
-
-void NNBatchController::emergencyShutdown(){}
-
-void NNBatchController::printStatus( Output& out ){}
-
 void NNBatchController::loadEvaluationImages()
 {
-    evalImages.load_eval_images(evalImagesStr.c_str(), EigenImage::TRANSFORM::INVERT, EigenImage::TRANSFORM::LINEARIZE, true);
+    evalImages.load_eval_images(evalImagesStr.c_str(), EigenImage::TRANSFORM::INVERT, EigenImage::TRANSFORM::LINEARIZE, true, loader_threads);
     if (output.getVerboseLevel() > 2 ) {
       std::cout << "X_eval"   << util.shapestr(evalImages.data) << "=\n" << HEAD(evalImages.data) << std::endl;
     }
 }
 
-void NNBatchController::forward_o_snd(MODE mode)
+void NNBatchController::forward_o_snd(MODE mode, const batch_view_t& view)
 {
     output.verbose(CALL_INFO, 5, 0,
                    "%s sending %s forward pass data\n",
                    getName().c_str(), mode2str.at(mode).c_str());
-    NNEvent *nnev = new NNEvent({mode, batch_X, batch_y});
+    // The batch buffers are handed to the event rather than copied. The
+    // samples stay in the dataset until a layer gathers them into batch_X.
+    payload_t payload(mode, std::move(batch_X), std::move(batch_y));
+    payload.view = view;
+    payload.batch_id = next_batch_id++;
+    NNEvent *nnev = new NNEvent(std::move(payload));
     linkHandlers.at(PortTypes::forward_o)->send(nnev);
 }
 
+batch_view_t NNBatchController::sliceBatch(const Dataset& ds, const std::vector<uint32_t>* order,
+                                           unsigned first, unsigned rows, Eigen::MatrixXi& y) const
+{
+  assert(first + rows <= ds.data.rows());
+  batch_view_t view;
+  view.samples = ds.data.data();
+  view.cols = ds.data.cols();
+  view.index = order ? order->data() : nullptr;
+  view.first = first;
+  view.rows = rows;
+  // Labels are small so they are copied here
+  if (ds.classes.rows() > 0) {
+    if (!order) {
+      y = ds.classes.block(first, 0, rows, ds.classes.cols());
+    } else {
+      y.resize(rows, ds.classes.cols());
+      for (unsigned r = 0; r < rows; r++)
+        y.row(r) = ds.classes.row((*order)[first + r]);
+    }
+  }
+  return view;
+}
+
+void NNBatchController::shuffleTrainingOrder()
+{
+  // The order depends only on the seed and the epoch so a restarted run
+  // visits the samples exactly as the original did.
+  prefetcher.stop();
+  train_order.resize(static_cast<size_t>(trainingImages.data.rows()));
+  std::iota(train_order.begin(), train_order.end(), 0u);
+  next_step = NO_BATCH;
+  if (shuffle_seed == 0)
+    return;
+  std::seed_seq seq{static_cast<uint32_t>(shuffle_seed), static_cast<uint32_t>(shuffle_seed >> 32), epoch};
+  std::mt19937_64 gen(seq);
+  for (size_t i = train_order.size(); i > 1; i--)
+    std::swap(train_order[i - 1], train_order[gen() % i]);
+}
+
+void NNBatchController::trainingBatch(unsigned s, unsigned& first, unsigned& rows) const
+{
+  // If batch size is not set, train using one step and full dataset
+  rows = (unsigned)trainingImages.data.rows();
+  first = 0;
+  if (batch_size > 0) {
+    // Otherwise slice a batch
+    first = s*batch_size;
+    rows = std::min(rows-first, batch_size);
+    assert(rows);
+  }
+}
+
+void NNBatchController::gatherTrainingBatch(unsigned s, MatrixXs& X, Eigen::MatrixXi& y) const
+{
+  unsigned p, r;
+  trainingBatch(s, p, r);
+  gather_rows(sliceBatch(trainingImages, &train_order, p, r, y), X);
+}
+
+void NNBatchController::prefetchTrainingStep(unsigned s)
+{
+  gatherTrainingBatch(s, next_X, next_y);
+  next_step = s;
+}
+
 void NNBatchController::backward_i_rcv(SST::Event *ev) {
   // check the backward data
   NNEvent* nnev = static_cast<NNEvent*>(ev);
-  payload_t payload = nnev->payload();
+  payload_t payload = nnev->release();
   assert(payload.mode == MODE::TRAINING);
 
   optimizer_data_t opt = payload.optimizer_data;
@@ -165,17 +259,31 @@ void NNBatchController::backward_i_rcv(SST::Event *ev) {
   accumulatedSums.loss.data_loss += payload.losses.data_loss;
   accumulatedSums.loss.regularization_loss += payload.losses.regularization_loss; 
   accumulatedSums.current_learning_rate = opt.current_learning_rate;
+
+  // The returned buffers have the batch shape. Keep them for later batches.
+  spare_X.push_back(std::move(payload.data));
+  spare_y.push_back(std::move(payload.classes));
   
   // Signal to send the next batch
-  readyToSend = true;
+  assert(in_flight > 0);
+  in_flight--;
+  readyToSend++;
+  wakeClock();
+  delete(ev);
+}
+
+void NNBatchController::wakeClock() {
+  // With several batches in flight the clock can still be running
+  if (clockEnabled)
+    return;
   output.verbose(CALL_INFO, 10, 0, "reregister clock: &timeConverter=%p factor=%" PRIx64 "\n", &timeConverter, timeConverter.getFactor());
   reregisterClock(timeConverter, clockHandler);
-  delete(ev);
+  clockEnabled = true;
 }
 
 void NNBatchController::monitor_rcv(SST::Event *ev) {
   NNEvent* nnev = static_cast<NNEvent*>(ev);
-  monitor_payload = nnev->payload();
+  monitor_payload = nnev->release();
   output.verbose(CALL_INFO, 5, 0, "Monitor Data Received: %s\n", monitor_payload.str().c_str());
 
   // Signal to send the next batch
@@ -189,14 +297,12 @@ void NNBatchController::monitor_rcv(SST::Event *ev) {
     accumulatedSums.loss.regularization_loss += monitor_payload.losses.regularization_loss; 
     accumulatedSums.current_learning_rate = monitor_payload.optimizer_data.current_learning_rate;
   
-    readyToSend = true;
-    output.verbose(CALL_INFO, 10, 0, "reregister clock: &timeConverter=%p factor=%" PRIx64 "\n", &timeConverter, timeConverter.getFactor());
-    reregisterClock(timeConverter, clockHandler);
+    readyToSend++;
+    wakeClock();
   } else if (mode == MODE::EVALUATION) {
     // std::cout << "predictions=" << monitor_payload.predictions.transpose() << std::endl;
-    readyToSend = true;
-    output.verbose(CALL_INFO, 10, 0, "reregister clock: &timeConverter=%p factor=%" PRIx64 "\n", &timeConverter, timeConverter.getFactor());
-    reregisterClock(timeConverter, clockHandler);
+    readyToSend++;
+    wakeClock();
   } else {
     assert(mode == MODE::TRAINING);
   }
@@ -211,9 +317,11 @@ bool NNBatchController::initTraining()
   epoch = 0;
   accumulatedSums = {};
   step = 0;
+  launch_step = 0;
 
   // Calculate number of steps
   unsigned rows = (unsigned) trainingImages.data.rows();
+  shuffleTrainingOrder();
   if (batch_size > 0) {
     train_steps = rows / batch_size;
     // Dividing rounds down. If there are some remaining
@@ -228,6 +336,8 @@ bool NNBatchController::initTraining()
   output.verbose(CALL_INFO, 1, 0, "X.rows()=%" PRId32 "\n", rows);
   output.verbose(CALL_INFO, 1, 0, "batch_size=%" PRId32 "\n", batch_size);
   output.verbose(CALL_INFO, 1, 0, "train_steps=%" PRId32 "\n", train_steps);
+  output.verbose(CALL_INFO, 1, 0, "pipeline_depth=%" PRId32 "\n", pipeline_depth);
+  output.verbose(CALL_INFO, 1, 0, "shuffle_seed=%" PRIu64 "\n", shuffle_seed);
 
   assert(epochs > 0);
 
@@ -298,59 +408,82 @@ bool NNBatchController::continueTraining()
     accumulatedSums = {};
     // Reset step counter
     step = 0;
+    launch_step = 0;
+    shuffleTrainingOrder();
     return launchTrainingStep();
 }
 
 bool NNBatchController::launchTrainingStep() {
-  // If batch size is not set, train using one step and full dataset
-  if (batch_size==0) {
-      batch_X = trainingImages.data;
-      batch_y = trainingImages.classes;
-  } else { 
-      // Otherwise slice a batch
-      unsigned p = step*batch_size;
-      assert(trainingImages.data.rows()==trainingImages.data.rows());
-      unsigned r = std::min((unsigned)trainingImages.data.rows()-p, batch_size);
-      assert(r);
-      batch_X = trainingImages.data.block(p, 0, r, trainingImages.data.cols());
-      batch_y = trainingImages.classes.block(p, 0, r, trainingImages.classes.cols());
-  }
-
-  // std::cout << "batch_X" << util.shapestr(batch_X) << "=\n" << HEAD(batch_X) << std::endl;
-  // std::cout << "batch_y" << util.shapestr(batch_y) << "=\n" << HEAD(batch_y) << std::endl;
-  output.verbose(CALL_INFO, 5, 0, "batch_X %s\n", util.shapestr(batch_X).c_str());
-  output.verbose(CALL_INFO, 5, 0, "batch_y %s\n", util.shapestr(batch_y).c_str());
+  // Keep up to pipeline_depth batches of this epoch in flight. Each
+  // returned batch frees a slot for the next one.
+  while (in_flight < pipeline_depth && launch_step < train_steps) {
+    unsigned p, r;
+    trainingBatch(launch_step, p, r);
+    batch_view_t view = {};
+    // Send a returned buffer pair rather than an empty one so the batch is
+    // gathered without allocating
+    if (batch_X.size() == 0 && !spare_X.empty()) {
+      batch_X.swap(spare_X.back());
+      batch_y.swap(spare_y.back());
+      spare_X.pop_back();
+      spare_y.pop_back();
+    }
+    if (prefetch_depth > 0) {
+        // Batches are gathered on the prefetch thread. It is (re)started
+        // here after an epoch change or a checkpoint.
+        if (!prefetcher.running()) {
+          assert(train_order.size() == (size_t)trainingImages.data.rows());
+          prefetcher.start(prefetch_depth, launch_step, train_steps,
+                           [this](unsigned s, MatrixXs& X, Eigen::MatrixXi& y) { gatherTrainingBatch(s, X, y); });
+        }
+        prefetcher.take(launch_step, batch_X, batch_y);
+    } else if (next_step == launch_step) {
+        // Gathered while the previous batch was in flight
+        batch_X.swap(next_X);
+        batch_y.swap(next_y);
+        next_step = NO_BATCH;
+    } else {
+        // Samples are visited through train_order
+        view = sliceBatch(trainingImages, &train_order, p, r, batch_y);
+    }
 
-  // Initiate the forward pass (backward pass included)
-  output.verbose(CALL_INFO, 5, 0, "epoch:%" PRId32 " step:%" PRId32 "\n", epoch, step);
-  forward_o_snd(MODE::TRAINING);
+    output.verbose(CALL_INFO, 5, 0, "batch_X (%u,%" PRId64 ")\n", r, (int64_t)trainingImages.data.cols());
+    output.verbose(CALL_INFO, 5, 0, "batch_y %s\n", util.shapestr(batch_y).c_str());
+
+    // Initiate the forward pass (backward pass included)
+    output.verbose(CALL_INFO, 5, 0, "epoch:%" PRId32 " step:%" PRId32 "\n", epoch, launch_step);
+    forward_o_snd(MODE::TRAINING, view);
+    launch_step++;
+    in_flight++;
+    // Gather the next batch into the spare buffers while this one is in
+    // flight. Deeper pipelines send the next batch right away and leave the
+    // gather to the first layer.
+    if (prefetch_depth == 0 && pipeline_depth == 1 && launch_step < train_steps)
+      prefetchTrainingStep(launch_step);
+  }
   busy = true;  // lock controller
   return true;  // disable controller clock
 }
 
 bool NNBatchController::launchValidationStep() {
   // If batch size is not set, train using one step and full dataset
-  if (batch_size==0) {
-      batch_X = testImages.data;
-      batch_y = testImages.classes;
-  } else { 
+  unsigned rows = (unsigned)testImages.data.rows();
+  unsigned p = 0;
+  unsigned r = rows;
+  if (batch_size > 0) {
       // Otherwise slice a batch
-      unsigned p = step*batch_size;
-      assert(testImages.data.rows()==testImages.data.rows());
-      unsigned r = std::min((unsigned)testImages.data.rows()-p, batch_size);
+      p = step*batch_size;
+      r = std::min(rows-p, batch_size);
       assert(r);
-      batch_X = testImages.data.block(p, 0, r, testImages.data.cols());
-      batch_y = testImages.classes.block(p, 0, r, testImages.classes.cols());
   }
+  batch_view_t view = sliceBatch(testImages, nullptr, p, r, batch_y);
 
-  // std::cout << "batch_X" << util.shapestr(batch_X) << "=\n" << HEAD(batch_X) << std::endl;
-  // std::cout << "batch_y" << util.shapestr(batch_y) << "=\n" << HEAD(batch_y) << std::endl;
-  output.verbose(CALL_INFO, 5, 0, "batch_X %s\n", util.shapestr(batch_X).c_str());
+  output.verbose(CALL_INFO, 5, 0, "batch_X (%u,%" PRId64 ")\n", r, (int64_t)view.cols);
   output.verbose(CALL_INFO, 5, 0, "batch_y %s\n", util.shapestr(batch_y).c_str());
 
   // Initiate the forward pass (completed on monitor_rcv)
   output.verbose(CALL_INFO, 5, 0, "step:%" PRId32 "\n", step);
-  forward_o_snd(MODE::VALIDATION);
+  forward_o_snd(MODE::VALIDATION, view);
   busy = true;  // lock controller
   return true;  // disable controller clock
 }
@@ -428,7 +561,7 @@ bool NNBatchController::initEvaluation() {
 
   if (dbgReloadEvaluationImages) {
     std::cout << "### Reloading evaluation images" << std::endl;
-    evalImages = {};
+    evalImages.clear();
     loadEvaluationImages();
   }
 
@@ -438,19 +571,15 @@ bool NNBatchController::initEvaluation() {
   step=0;
 
   // Calculate number of steps
-  prediction_steps = 1;
   unsigned rows = (unsigned) evalImages.data.rows();
   assert(rows>0);
-  if (eval_batch_size > 0) {
-    prediction_steps = (unsigned int) rows / eval_batch_size;
-    // Dividing rounds down. If there are some remaining
-    // data but nor full batch, this won't include it
-    // Add `1` to include this not full batch
-    if (prediction_steps * eval_batch_size < rows)
-      prediction_steps += 1;
-  } else {
-    assert(false); //TODO
-  }
+  assert(eval_batch_size > 0);
+  prediction_steps = (unsigned int) rows / eval_batch_size;
+  // Dividing rounds down. If there are some remaining
+  // data but nor full batch, this won't include it
+  // Add `1` to include this not full batch
+  if (prediction_steps * eval_batch_size < rows)
+    prediction_steps += 1;
 
   output.verbose(CALL_INFO, 5, 0, "### Evaluation setup\n");
   output.verbose(CALL_INFO, 5, 0, "X.rows()=%" PRId32 "\n", rows);
@@ -463,23 +592,18 @@ bool NNBatchController::initEvaluation() {
 
 bool NNBatchController::launchEvaluationStep() {
 
-  // If batch size is not set, train using one step and full dataset
-  if (eval_batch_size==0) {
-      assert(false);
-  } else {
-      // Otherwise slice a batch
-      unsigned p = step*eval_batch_size;
-      unsigned r = std::min((unsigned)evalImages.data.rows()-p, eval_batch_size);
-      assert(r);
-      batch_X = evalImages.data.block(p, 0, r, evalImages.data.cols());
-  }
+  // Evaluation always runs in batches
+  assert(eval_batch_size > 0);
+  unsigned p = step*eval_batch_size;
+  unsigned r = std::min((unsigned)evalImages.data.rows()-p, eval_batch_size);
+  assert(r);
+  batch_view_t view = sliceBatch(evalImages, nullptr, p, r, batch_y);
 
-  // std::cout << "batch_X" << util.shapestr(batch_X) << "=\n" << HEAD(batch_X) << std::endl;
-  output.verbose(CALL_INFO, 5, 0, "batch_X %s\n", util.shapestr(batch_X).c_str());
+  output.verbose(CALL_INFO, 5, 0, "batch_X (%u,%" PRId64 ")\n", r, (int64_t)view.cols);
 
   // Initiate the forward pass (completed on monitor_rcv)
   output.verbose(CALL_INFO, 5, 0, "step: %" PRId32 "\n", step);
-  forward_o_snd(MODE::EVALUATION);
+  forward_o_snd(MODE::EVALUATION, view);
   busy = true;  // lock controller
   return true;  // disable controller clock
 }
@@ -487,12 +611,25 @@ bool NNBatchController::launchEvaluationStep() {
 void NNBatchController::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   NNLayerBase::serialize_order(ser);
+  // Prefetched batches are not saved. Dropping them here keeps the saved
+  // state identical with and without prefetch; the ring refills on the
+  // next launch. After a restart it refills from the datasets and order
+  // rebuilt at the end of UNPACK.
+  if (ser.mode() != SST::Core::Serialization::serializer::MAP)
+    prefetcher.stop();
   SST_SER(output);
   SST_SER(timeConverter);
   SST_SER(clockHandler);
   SST_SER(batch_size);
+  SST_SER(classImageLimit);
   SST_SER(epochs);
+  SST_SER(eval_batch_size);
+  SST_SER(datasetCache);
+  SST_SER(loader_threads);
+  SST_SER(pipeline_depth);
+  SST_SER(prefetch_depth);
   SST_SER(print_every);
+  SST_SER(shuffle_seed);
   SST_SER(evalImagesStr);
   SST_SER(testImagesStr);
   SST_SER(trainingImagesStr);
@@ -505,31 +642,56 @@ void NNBatchController::serialize_order(SST::Core::Serialization::serializer &se
   SST_SER(epoch);
   SST_SER(epoch_accuracy);
   SST_SER(step);
+  SST_SER(launch_step);
+  SST_SER(in_flight);
+  SST_SER(next_batch_id);
   SST_SER(train_steps);
   SST_SER(validation_steps);
   SST_SER(prediction_steps);
   SST_SER(linkHandlers);
   SST_SER(readyToSend);
   SST_SER(busy);
+  SST_SER(clockEnabled);
+  SST_SER(accumulatedSums.accuracy);
+  SST_SER(accumulatedSums.loss.data_loss);
+  SST_SER(accumulatedSums.loss.regularization_loss);
+  SST_SER(accumulatedSums.count);
+  SST_SER(accumulatedSums.current_learning_rate);
+  SST_SER(monitor_payload);
   #ifdef NN_SERIALIZE_ALL
   // Controller object containing large matrices
   // not required to save after training
-  SST_SER(monitor_payload);
   SST_SER(batch_X);
-  SST_SER(batch_Y);
+  SST_SER(batch_y);
   SST_SER(trainingImages);
+  SST_SER(train_order);
+  SST_SER(next_X);
+  SST_SER(next_y);
+  SST_SER(next_step);
   SST_SER(testImages);
   SST_SER(evalImages);
   #endif
+  if (ser.mode() == SST::Core::Serialization::serializer::UNPACK) {
+    // The datasets and the epoch order are rebuilt rather than saved. The
+    // order depends only on the seed and the restored epoch, so training
+    // resumes at launch_step with the batches of the original run.
+    loadImages();
+    if (trainingImages.data.rows() > 0)
+      shuffleTrainingOrder();
+  }
 }
 
 bool NNBatchController::stepEvaluation() { 
   assert(step < prediction_steps);
 
-  // Show prediction ( each step is 1 image )
+  // Show the prediction for each image in the batch
   MNISTinfo info;
-  std::cout << "Prediction for " << evalImages.imagePath(step) << " ... \t";
-  std::cout << "Survey says ### " << info.toString((int) monitor_payload.predictions(0)) << std::endl;
+  const unsigned first = step*eval_batch_size;
+  assert(monitor_payload.predictions.rows() == (Eigen::Index)std::min((unsigned)evalImages.data.rows()-first, eval_batch_size));
+  for (Eigen::Index i = 0; i < monitor_payload.predictions.rows(); i++) {
+    std::cout << "Prediction for " << evalImages.imagePath(first + (unsigned)i) << " ... \t";
+    std::cout << "Survey says ### " << info.toString((int) monitor_payload.predictions(i)) << std::endl;
+  }
 
   if (++step == prediction_steps) {
     // Finished all evaluation steps.
@@ -555,11 +717,18 @@ bool NNBatchController::complete()
 }
 
 bool NNBatchController::clockTick( SST::Cycle_t currentCycle ) {
+  bool disable = advance();
+  // Keep clocking while returned batches are waiting
+  clockEnabled = !disable || readyToSend>0;
+  return !clockEnabled;
+}
+
+bool NNBatchController::advance() {
   // Clocking control should ensure we have something to do.
   assert( !busy || readyToSend);
 
   if (!busy) {
-    assert(readyToSend==false); 
+    assert(readyToSend==0); 
     // not busy so what's next
     switch (fsmState_) {
       
@@ -601,8 +770,9 @@ bool NNBatchController::clockTick( SST::Cycle_t currentCycle ) {
   }
 
   // OK we are busy so must be sending something.
-  assert(readyToSend==true);
-  readyToSend = false;
+  // Returned batches are stepped one per clock.
+  assert(readyToSend>0);
+  readyToSend--;
 
   switch (fsmState_) {
     case MODE::TRAINING:
@@ -24,6 +24,7 @@
 #include "dataset.h"
 #include "nn_event.h"
 #include "nn_layer_base.h"
+#include "nn_prefetcher.h"
 // clang-format on
 
 namespace SST::NeuralNet{
@@ -73,9 +74,15 @@ public:
   SST_ELI_DOCUMENT_PARAMS(
     {"batchSize",       "Number of images per batch", "128"},
     {"classImageLimit", "Maximum images per class to load [100000]", "100000"},
+    {"datasetCache",    "Keep decoded training and test images in a <dir>.nncache file next to each image directory", "1"},
     {"epochs",          "Training iterations", "1"},
+    {"evalBatchSize",   "Number of images per evaluation batch", "1"},
     {"evalImages",      "Path to directory containing evaluation images", NULL},
+    {"loaderThreads",   "Image decoding threads. 0 uses one per hardware thread", "0"},
+    {"pipelineDepth",   "Training batches in flight at once. 1 waits for each backward pass", "1"},
+    {"prefetchDepth",   "Training batches gathered ahead on a background thread. 0 gathers the next batch on the simulation thread", "0"},
     {"printEvery",      "Epochs between printed summary information", "100"},
+    {"shuffleSeed",     "Seed for the training image order of each epoch. 0 keeps the load order", "0"},
     {"testImages",      "Directory containing test images in class subdirs", NULL},
     {"trainingImages",  "Directory containing training images in class subdirs", NULL},
   )
@@ -88,10 +95,15 @@ private:
 
   // -- Component Parameters  
   unsigned batch_size = 128;                      ///< number of images per batch
-  const unsigned eval_batch_size = 1;             ///< Predictions ship 1 image at time (for now?)
+  unsigned eval_batch_size = 1;                   ///< number of images per evaluation batch
   unsigned classImageLimit = 100000;              ///< maximum images to load for each classification set
+  bool datasetCache = true;                       ///< map decoded images from a binary cache
+  unsigned loader_threads = 0;                    ///< image decoding threads (0: hardware threads)
   unsigned epochs = 1;                            ///< training epochs
+  unsigned pipeline_depth = 1;                    ///< training batches in flight
+  unsigned prefetch_depth = 0;                    ///< batches gathered ahead by the prefetch thread
   unsigned print_every = 100;                     ///< epochs between printing summary information
+  uint64_t shuffle_seed = 0;                      ///< training order seed (0: load order every epoch)
   std::string evalImagesStr = {};                 ///< path to directory containing evaluation images
   std::string testImagesStr = {};                 ///< path to directory containing test images in class subdirs
   std::string trainingImagesStr = {};             ///< path to directory containing training images in class subdirs
@@ -99,6 +111,7 @@ private:
   // -- Interactive debug console helpers for synchronized checkpoint
   bool dbgPauseBeforeEvaluation = false;
   bool dbgReloadEvaluationImages = false;
+  void loadImages();                              ///< load the datasets still needed (setup and restart)
   void loadEvaluationImages();
 
   // -- Internal State
@@ -112,7 +125,10 @@ private:
   double epoch_accuracy = 0.0;
 
   unsigned epoch = 0;                             ///< training interations counter
-  unsigned step = 0;                              ///< step counter
+  unsigned step = 0;                              ///< step counter (completed batches)
+  unsigned launch_step = 0;                       ///< next training batch to send
+  unsigned in_flight = 0;                         ///< training batches sent but not returned
+  uint64_t next_batch_id = 0;                     ///< id carried by the next batch sent
   unsigned train_steps = 1;                       ///< total steps per training epoch
   unsigned validation_steps = 1;                  ///< total steps for validation run
   unsigned prediction_steps = 1;                  ///< total steps for evaluation run
@@ -123,7 +139,7 @@ private:
   std::map<SST::NeuralNet::PortTypes,SST::Link*> linkHandlers = {};
   void forward_i_snd() { assert(false); }
   void forward_i_rcv(SST::Event *ev) {assert(false);}
-  void forward_o_snd(MODE mode);
+  void forward_o_snd(MODE mode, const batch_view_t& view);
   void forward_o_rcv(SST::Event *ev) { assert(false);}
   void backward_i_snd() { assert(false); }
   void backward_i_rcv(SST::Event *ev);
@@ -132,22 +148,42 @@ private:
   void monitor_rcv(SST::Event *ev);
   void monitor_snd() { assert(false); }
 
-  //-- Payload - Do not serialize
-  Eigen::MatrixXd batch_X = {};
+  //-- Payload - Do not serialize. Moved into the outgoing event on send.
+  MatrixXs batch_X = {};                          ///< spare buffer the first layer gathers samples into
   Eigen::MatrixXi batch_y = {};
+  std::vector<MatrixXs> spare_X = {};             ///< buffers of returned training batches
+  std::vector<Eigen::MatrixXi> spare_y = {};
+  batch_view_t sliceBatch(const Dataset& ds, const std::vector<uint32_t>* order,
+                          unsigned first, unsigned rows, Eigen::MatrixXi& y) const;
+
+  //-- Batch assembler. The next training batch is gathered into a second
+  //-- pair of buffers while the current one is in flight.
+  static constexpr unsigned NO_BATCH = ~0u;
+  MatrixXs next_X = {};
+  Eigen::MatrixXi next_y = {};
+  unsigned next_step = NO_BATCH;                  ///< training step held in next_X/next_y
+  void trainingBatch(unsigned s, unsigned& first, unsigned& rows) const;
+  void gatherTrainingBatch(unsigned s, MatrixXs& X, Eigen::MatrixXi& y) const;
+  void prefetchTrainingStep(unsigned s);
+  NNPrefetcher prefetcher = {};                   ///< prefetch thread (prefetch_depth>0), not serialized
 
   //-- Flow Control
-  bool readyToSend=false;
+  unsigned readyToSend=0;                         ///< returned batches not yet stepped
   bool busy=false;
+  bool clockEnabled=true;
+  void wakeClock();
 
   //-- Image Management - Do not serialize
   //-- training and validation load everything by class directory
   Dataset trainingImages = {};
+  std::vector<uint32_t> train_order = {};         ///< training sample for each position in the epoch
+  void shuffleTrainingOrder();                    ///< build train_order for the current epoch
   Dataset testImages = {};
   //-- evaluation/prediction load images from a single directory (no class info)
   Dataset evalImages = {};
   
   //-- FSM support ( call from clocktick )
+  bool advance();       // one FSM step, returns true to disable clocking
   bool initTraining();  // returns true to disable clocking
   bool stepTraining();
   bool continueTraining(); // resume after validation step
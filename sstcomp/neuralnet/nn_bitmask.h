@@ -0,0 +1,123 @@
+//
+// _nn_bitmask_h_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+
+#ifndef _SST_NN_BITMASK_H_
+#define _SST_NN_BITMASK_H_
+
+// clang-format off
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "nnscalar.h"
+// clang-format on
+
+namespace SST::NeuralNet{
+
+// -------------------------------------------------------
+// NNBitMask
+// One bit per element of a column-major matrix. Used by activation
+// layers to remember which elements pass the gradient instead of
+// keeping the full forward input around for the backward pass.
+// -------------------------------------------------------
+class NNBitMask {
+public:
+  static constexpr Eigen::Index bits = 64;
+
+  Eigen::Index rows() const { return rows_; }
+  Eigen::Index cols() const { return cols_; }
+  Eigen::Index size() const { return rows_ * cols_; }
+
+  // Shape the mask. Contents are undefined until rewritten.
+  void resize(Eigen::Index rows, Eigen::Index cols) {
+    rows_ = rows;
+    cols_ = cols;
+    words_.resize(static_cast<size_t>((rows * cols + bits - 1) / bits));
+  }
+
+  bool test(Eigen::Index i) const {
+    return (words_[static_cast<size_t>(i / bits)] >> (i % bits)) & 1;
+  }
+
+  // Raw packed storage, element i is bit i%64 of word i/64
+  uint64_t* words() { return words_.data(); }
+  const uint64_t* words() const { return words_.data(); }
+  size_t bytes() const { return words_.size() * sizeof(uint64_t); }
+
+  // ReLU in place: clamp m at zero and set the bits of the elements that
+  // pass the gradient (!(x <= 0)). The mask takes m's shape.
+  void relu(MatrixXs& m) {
+    resize(m.rows(), m.cols());
+    nn_scalar_t* d = m.data();
+    const Eigen::Index n = size();
+    for (Eigen::Index i = 0; i < n; i += bits) {
+      const Eigen::Index end = std::min(n, i + bits);
+      uint64_t w = 0;
+      for (Eigen::Index j = i; j < end; j++) {
+        const bool active = !(d[j] <= 0);
+        d[j] = active ? d[j] : 0;
+        w |= static_cast<uint64_t>(active) << (j - i);
+      }
+      words_[static_cast<size_t>(i / bits)] = w;
+    }
+  }
+
+  // Zero every element of m whose bit is clear. m must match the mask shape.
+  // Each byte of the mask picks eight all-ones/all-zeros lanes that are
+  // ANDed with the element bits, so the inner loop is a plain vector AND.
+  void apply(MatrixXs& m) const {
+    eigen_assert(m.rows() == rows_ && m.cols() == cols_);
+    nn_scalar_t* d = m.data();
+    const Eigen::Index n = size();
+    const auto& table = lanes();
+    Eigen::Index i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const uint64_t byte = (words_[static_cast<size_t>(i / bits)] >> (i % bits)) & 0xff;
+      const lane_t* sel = table[byte].data();
+      lane_t v[8];
+      std::memcpy(v, d + i, sizeof(v));
+      for (int k = 0; k < 8; k++)
+        v[k] &= sel[k];
+      std::memcpy(d + i, v, sizeof(v));
+    }
+    for (; i < n; i++)
+      if (!test(i)) d[i] = 0;
+  }
+
+private:
+  // Unsigned integer with the width of nn_scalar_t
+  using lane_t = std::conditional_t<sizeof(nn_scalar_t) == 8, uint64_t, uint32_t>;
+  static_assert(sizeof(lane_t) == sizeof(nn_scalar_t), "no lane type for nn_scalar_t");
+
+  // Lane masks for every byte value
+  static const std::array<std::array<lane_t, 8>, 256>& lanes() {
+    static const auto table = [] {
+      std::array<std::array<lane_t, 8>, 256> t{};
+      for (unsigned b = 0; b < 256; b++)
+        for (unsigned k = 0; k < 8; k++)
+          t[b][k] = ((b >> k) & 1) ? ~lane_t(0) : lane_t(0);
+      return t;
+    }();
+    return table;
+  }
+
+  Eigen::Index rows_ = 0;
+  Eigen::Index cols_ = 0;
+  std::vector<uint64_t> words_ = {};
+};
+
+} //namespace SST::NeuralNet
+
+#endif  // _SST_NN_BITMASK_H_
+
+// EOF
@@ -1,6 +1,63 @@
 #include "nn_event.h"
 
-void SST::NeuralNet::NNEvent::serialize_order(SST::Core::Serialization::serializer &ser)
+namespace SST::NeuralNet{
+
+void gather_rows(const batch_view_t& view, MatrixXs& m)
+{
+  if (m.rows() != view.rows || m.cols() != view.cols)
+    m.resize(view.rows, view.cols);
+  if (!view.index) {
+    m = Eigen::Map<const RowMatrixXs>(view.samples + view.first * view.cols, view.rows, view.cols);
+  } else {
+    for (Eigen::Index r = 0; r < view.rows; r++) {
+      const Eigen::Index sample = view.index[view.first + r];
+      m.row(r) = Eigen::Map<const RowVectorXs>(view.samples + sample * view.cols, view.cols);
+    }
+  }
+}
+
+void payload_t::gather()
+{
+  if (view.empty())
+    return;
+  gather_rows(view, data);
+  view = {};
+}
+
+void NNEvent::serialize_order(SST::Core::Serialization::serializer &ser)
 {
     Event::serialize_order(ser);
-}
\ No newline at end of file
+    // A checkpoint can catch an event on a link so the payload travels with it
+    SST_SER(payload_);
+}
+
+} // namespace SST::NeuralNet
+
+namespace SST::Core::Serialization {
+
+void serialize_impl<SST::NeuralNet::payload_t>::operator()(
+  SST::NeuralNet::payload_t& p, serializer& ser, ser_opt_t options)
+{
+  const bool mapping = ser.mode() == serializer::MAP;
+  // Views point into the sender's memory. Ship the values instead.
+  if (!mapping)
+    p.gather();
+  if (mapping)
+    ser.mapper().map_hierarchy_start(ser.getMapName(), new ObjectMapClass(&p, typeid(p).name()));
+  SST_SER_NAME(p.mode, "mode");
+  SST_SER_NAME(p.batch_id, "batch_id");
+  SST_SER_NAME(p.data, "data");
+  SST_SER_NAME(p.classes, "classes");
+  SST_SER_NAME(p.optimizer_data.optimizerState, "optimizerState");
+  SST_SER_NAME(p.optimizer_data.learning_rate, "learning_rate");
+  SST_SER_NAME(p.optimizer_data.current_learning_rate, "current_learning_rate");
+  SST_SER_NAME(p.optimizer_data.iterations, "iterations");
+  SST_SER_NAME(p.accuracy, "accuracy");
+  SST_SER_NAME(p.losses.data_loss, "data_loss");
+  SST_SER_NAME(p.losses.regularization_loss, "regularization_loss");
+  SST_SER_NAME(p.predictions, "predictions");
+  if (mapping)
+    ser.mapper().map_hierarchy_end();
+}
+
+} // namespace SST::Core::Serialization
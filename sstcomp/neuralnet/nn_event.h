@@ -23,6 +23,8 @@
 
 // -- External Headers
 #include "EIGEN.h"
+#include "nnscalar.h"
+#include "eigen_serialize.h"
 #include "SST.h"
 
 // clang-format on
@@ -74,7 +76,7 @@ struct optimizer_data_t {
 struct Losses {
   double data_loss = 0;
   double regularization_loss = 0;
-  double total_loss() { return data_loss + regularization_loss; }
+  double total_loss() const { return data_loss + regularization_loss; }
   Losses() {}
   Losses(double d, double r) : data_loss(d), regularization_loss(r) {}
   friend std::ostream& operator<<(std::ostream& os, const Losses losses ) {
@@ -83,48 +85,101 @@ struct Losses {
   }
 };
 
+// Read-only window onto rows of a sample matrix owned by the batch
+// controller. The source must stay in place until the batch is gathered.
+struct batch_view_t {
+  const nn_scalar_t* samples = nullptr;   // row-major, one sample per row
+  Eigen::Index cols = 0;                  // values per sample
+  const uint32_t* index = nullptr;        // sample for each position, nullptr for consecutive rows
+  Eigen::Index first = 0;                 // position of the first batch row
+  Eigen::Index rows = 0;                  // batch rows
+  bool empty() const { return samples == nullptr; }
+};
+
+// Copy the rows of a view into m, reusing m's buffer when the shape matches
+void gather_rows(const batch_view_t& view, MatrixXs& m);
+
 struct payload_t {
   MODE mode = MODE::INVALID;
-  Eigen::MatrixXd data = {};
+  uint64_t batch_id = 0;          // assigned by the batch controller, follows the batch through every layer
+  MatrixXs data = {};             // only a spare buffer while view is set
+  batch_view_t view = {};         // batch rows not yet copied into data
   Eigen::MatrixXi classes = {};
   optimizer_data_t optimizer_data = {};
   double accuracy = 0;
   Losses losses = {};
-  Eigen::MatrixXd predictions = {};
+  MatrixXs predictions = {};
   payload_t() {};
-  payload_t(MODE m, Eigen::MatrixXd X, Eigen::MatrixXi y) :
-    mode(m), data(X), classes(y) {};
+  // Matrices are taken by value so callers can move batches in without a copy
+  payload_t(MODE m, MatrixXs X, Eigen::MatrixXi y) :
+    mode(m), data(std::move(X)), classes(std::move(y)) {};
+  // Copy the viewed rows into data and drop the view. The data buffer is
+  // reused when it already has the batch shape.
+  void gather();
   void copyWithNoData(const payload_t& in) {
     mode = in.mode;
+    batch_id = in.batch_id;
     classes = in.classes;
     optimizer_data = in.optimizer_data;
     accuracy = in.accuracy;
     losses = in.losses;
     predictions = in.predictions;
   }
-  friend std::ostream& operator<<(std::ostream& os, const payload_t p) {
+  // As above but takes over the label and prediction buffers
+  void copyWithNoData(payload_t&& in) {
+    mode = in.mode;
+    batch_id = in.batch_id;
+    classes.swap(in.classes);
+    optimizer_data = in.optimizer_data;
+    accuracy = in.accuracy;
+    losses = in.losses;
+    predictions.swap(in.predictions);
+  }
+  friend std::ostream& operator<<(std::ostream& os, const payload_t& p) {
     os << "MODE=" << mode2str.at(p.mode) 
-      << " data(" << p.data.rows() << "," << p.data.cols() << ")"
+      << " batch=" << p.batch_id
+      << " data(" << p.data.rows() << "," << p.data.cols() << ")";
+    if (!p.view.empty())
+      os << " view(" << p.view.rows << "," << p.view.cols << ")";
+    os
       << " classes(" << p.classes.rows() << "," << p.classes.cols() << ")"
       << " accuracy=" << p.accuracy
       << " losses={" << p.losses <<  "}";
       return os;
   }
-  std::string str() {
+  std::string str() const {
     std::stringstream s;
     s << *this;
     return s.str();
   }
 };
 
+} //namespace SST::NeuralNet
+
+namespace SST::Core::Serialization {
+// Payloads travel in events and are buffered by the layers between
+// clock ticks so both need to checkpoint them.
+template<>
+class serialize_impl<SST::NeuralNet::payload_t> {
+public:
+  void operator()(SST::NeuralNet::payload_t& p, serializer& ser, ser_opt_t options);
+};
+} //namespace SST::Core::Serialization
+
+namespace SST::NeuralNet{
+
 // -------------------------------------------------------
 // NNEvent
 // -------------------------------------------------------
 class NNEvent : public SST::Event{
 public:
   NNEvent(const payload_t& p) : SST::Event(), payload_(p) {}
+  // Preferred: the sender hands its payload buffers over to the event
+  NNEvent(payload_t&& p) : SST::Event(), payload_(std::move(p)) {}
   virtual ~NNEvent() {}
-  const payload_t& payload() { return payload_; }
+  const payload_t& payload() const { return payload_; }
+  // Move the payload out of the event. The event is left empty.
+  payload_t release() { return std::move(payload_); }
 private:
   payload_t payload_;
 public:
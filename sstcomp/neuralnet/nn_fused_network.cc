@@ -0,0 +1,263 @@
+//
+// _nn_fused_network_cc_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+
+#include <algorithm>
+#include <assert.h>
+#include "nn_fused_network.h"
+
+namespace SST::NeuralNet{
+
+//------------------------------------------
+// NNFusedNetwork
+//------------------------------------------
+NNFusedNetwork::NNFusedNetwork(SST::ComponentId_t id, const SST::Params& params ) :
+  NNLayerBase( id )
+{
+
+  // parameters
+  uint32_t Verbosity = params.find< uint32_t >( "verbose", 0 );
+  sstout_.init(
+    "NNFusedNetwork[" + getName() + ":@p:@t]: ",
+    Verbosity, 0, SST::Output::STDOUT );
+
+  // clocking. An event will wake up the clocking.
+  const std::string systemClock = params.find< std::string >("clockFreq", "1GHz");
+  clockHandler_  = new SST::Clock::Handler<NNFusedNetwork,&NNFusedNetwork::clockTick>(this);
+  timeConverter_ = registerClock(systemClock, clockHandler_);
+  unregisterClock(timeConverter_, clockHandler_);
+
+  // subcomponents. Layers fill slots 0..n-1 in forward order.
+  SubComponentSlotInfo* layers = getSubComponentSlotInfo("transfer_function");
+  if (!layers)
+    sstout_.fatal(CALL_INFO, -1, "no transfer_function subcomponents\n");
+  const int nLayers = layers->getMaxPopulatedSlotNumber() + 1;
+  SubComponentSlotInfo* optimizers = getSubComponentSlotInfo("optimizer");
+  if (optimizers && optimizers->getMaxPopulatedSlotNumber() >= nLayers)
+    sstout_.fatal(CALL_INFO, -1, "optimizer slot %d has no transfer_function\n",
+                  optimizers->getMaxPopulatedSlotNumber());
+  for (int i = 0; i < nLayers; i++) {
+    if (!layers->isPopulated(i))
+      sstout_.fatal(CALL_INFO, -1, "transfer_function slot %d is empty\n", i);
+    layers_.push_back(layers->create<NNSubComponentAPI>(i, ComponentInfo::SHARE_NONE));
+    assert(layers_.back());
+    // optimizer associated with layers with weights only
+    NNOptimizerAPI* optimizer = nullptr;
+    if (optimizers && optimizers->isPopulated(i))
+      optimizer = optimizers->create<NNOptimizerAPI>(i, ComponentInfo::SHARE_NONE);
+    optimizers_.push_back(optimizer);
+  }
+  delete layers;
+  delete optimizers;
+  // The loss level optimizer turns the PRE_UPDATE handshake into ACTIVE
+  // hyperparameters for the layer optimizers (NNOptimizerAPI::step)
+  optimizer_ = loadUserSubComponent<NNOptimizerAPI>("loss_optimizer");
+  if (!optimizer_ && std::any_of(optimizers_.begin(), optimizers_.end(),
+                                 [](NNOptimizerAPI* o) { return o != nullptr; }))
+    sstout_.fatal(CALL_INFO, -1, "layer optimizers require a loss_optimizer\n");
+  loss_function_ = loadUserSubComponent<NNLossLayerAPI>("loss_function");
+  assert(loss_function_);
+  accuracy_function_ = loadUserSubComponent<NNAccuracyAPI>("accuracy_function");
+  assert(accuracy_function_);
+
+  // Configure Links
+  linkHandlers[PortTypes::forward_i] =
+    configureLink(PortNames.at(PortTypes::forward_i),
+              new Event::Handler<NNFusedNetwork, &NNFusedNetwork::forward_i_rcv>(this));
+  linkHandlers[PortTypes::backward_o] =
+    configureLink(PortNames.at(PortTypes::backward_o));
+  linkHandlers[PortTypes::monitor] =
+    configureLink(PortNames.at(PortTypes::monitor));
+}
+
+NNFusedNetwork::~NNFusedNetwork(){
+}
+
+void NNFusedNetwork::init( unsigned int phase ){
+}
+
+void NNFusedNetwork::setup(){
+}
+
+void NNFusedNetwork::complete( unsigned int phase ){
+}
+
+void NNFusedNetwork::finish(){
+  if (trainingSteps_ > 0) {
+    sstout_.verbose(CALL_INFO, 1, 0,
+      "buffer allocations: %" PRIu64 " in first training step, %" PRIu64 " in %" PRIu64 " later steps\n",
+      firstStepAllocations_, trainingAllocations_ - firstStepAllocations_, trainingSteps_ - 1);
+  }
+}
+
+void NNFusedNetwork::emergencyShutdown(){
+}
+
+void NNFusedNetwork::printStatus( Output& out ){
+}
+
+bool NNFusedNetwork::clockTick( SST::Cycle_t currentCycle ) {
+  // Clocking control should ensure we always have something to do here
+  assert(!forwardData_i.empty());
+
+  // One batch per tick, forward through backward
+  auto it = forwardData_i.begin();
+  payload_t p = std::move(it->second);
+  forwardData_i.erase(it);
+  forwardPass(p);
+  monitorPass(p);
+
+  // Keep clocking while batches are waiting
+  clockEnabled_ = !forwardData_i.empty();
+  return !clockEnabled_;
+}
+
+uint64_t NNFusedNetwork::allocations() const {
+  uint64_t n = 0;
+  for (const auto* layer : layers_)
+    n += layer->allocations();
+  return n;
+}
+
+void NNFusedNetwork::forwardPass(payload_t& p) {
+  const uint64_t allocations_before = allocations();
+  // Training passes after the first one must not touch the heap
+  const bool steady = p.mode == MODE::TRAINING && trainingSteps_ > 0;
+  for (auto* layer : layers_) {
+    if (!layer->acceptsView())
+      p.gather();
+    payload_t o;
+    {
+      NNMallocScope scope(!steady);
+      layer->forward(std::move(p), o);
+    }
+    p = std::move(o);
+  }
+  if (p.mode == MODE::TRAINING)
+    trainingAllocations_ += allocations() - allocations_before;
+}
+
+void NNFusedNetwork::monitorPass(payload_t& p) {
+  MODE mode = p.mode;
+  p.gather();
+  if (mode==MODE::VALIDATION || mode==MODE::TRAINING) {
+    NNMallocScope steady(mode != MODE::TRAINING || trainingSteps_ == 0);
+    // Loss calculation at end of the forward pass
+    loss_function_->forward(p, sampleLosses_);
+    Losses losses = loss_function_->calculate(sampleLosses_.data);
+    // Predictions and accuracy
+    const MatrixXs& predictions = loss_function_->predictions(p.data);
+    double accuracy = loss_function_->fused() ? loss_function_->accuracy()
+                                              : accuracy_function_->calculate(predictions, p.classes);
+
+    if (sstout_.getVerboseLevel() > 2 ) {
+      std::cout << "### Forward pass result ###" << std::endl;
+      std::cout << std::fixed << std::setprecision(3)
+        << "acc: " << accuracy
+        << ", loss: "  << losses.total_loss()
+        << " (data_loss: "  << losses.data_loss
+        << ", reg_loss: "  << losses.regularization_loss << ")" << std::endl;
+    }
+
+    // Send results to batch_controller. The controller only needs the scalars.
+    monitorData_o.mode = mode;
+    monitorData_o.batch_id = p.batch_id;
+    monitorData_o.optimizer_data = p.optimizer_data;
+    monitorData_o.accuracy = accuracy;
+    monitorData_o.losses = losses;
+    monitor_snd();
+    if (mode==MODE::TRAINING) {
+      // Provide accuracy and losses through backward passes to batch controller
+      p.optimizer_data.optimizerState = OPTIMIZER_STATE::PRE_UPDATE;
+      p.accuracy = accuracy;
+      p.losses = losses;
+      // A fused loss already has the gradient for the last layer
+      if (loss_function_->fused())
+        loss_function_->gradient(p);
+      // As the loss component's optimizer does in the layered network
+      if (optimizer_)
+        optimizer_->step(nullptr, p.optimizer_data);
+      backwardPass(p);
+    }
+  } else if (mode==MODE::EVALUATION) {
+    monitorData_o = std::move(p);
+    monitorData_o.predictions = loss_function_->predictions(monitorData_o.data);
+    monitor_snd();
+  } else {
+    assert(false);
+  }
+}
+
+void NNFusedNetwork::backwardPass(payload_t& p) {
+  const uint64_t allocations_before = allocations();
+  NNMallocScope steady(trainingSteps_ == 0);
+  for (size_t i = layers_.size(); i-- > 0; ) {
+    payload_t o;
+    layers_[i]->backward(std::move(p), o);
+    // Optimizer for layers with weights
+    if (optimizers_[i])
+      optimizers_[i]->step(layers_[i], o.optimizer_data);
+    p = std::move(o);
+  }
+  trainingAllocations_ += allocations() - allocations_before;
+  if (trainingSteps_++ == 0)
+    firstStepAllocations_ = trainingAllocations_;
+  // the controller reuses the returned buffers for its next batch
+  backwardData_o = std::move(p);
+  backward_o_snd();
+}
+
+void NNFusedNetwork::wakeClock() {
+  // Events can arrive while the clock is still running on queued batches
+  if (clockEnabled_)
+    return;
+  reregisterClock(timeConverter_, clockHandler_);
+  clockEnabled_ = true;
+}
+
+void NNFusedNetwork::forward_i_rcv(SST::Event *ev){
+  NNEvent *nnev = static_cast<NNEvent*>(ev);
+  payload_t in = nnev->release();
+  const uint64_t batch_id = in.batch_id;
+  assert(forwardData_i.count(batch_id) == 0);
+  forwardData_i.emplace(batch_id, std::move(in));
+  wakeClock();
+  delete ev;
+}
+
+void NNFusedNetwork::backward_o_snd() {
+  sstout_.verbose(CALL_INFO, 5, 0, "%s sending backward pass data\n", getName().c_str());
+  NNEvent* nnev = new NNEvent(std::move(backwardData_o));
+  linkHandlers.at(PortTypes::backward_o)->send(nnev);
+}
+
+void NNFusedNetwork::monitor_snd() {
+  sstout_.verbose(CALL_INFO, 5, 0, "%s sending monitor data\n", getName().c_str());
+  NNEvent* nnev = new NNEvent(std::move(monitorData_o));
+  linkHandlers.at(PortTypes::monitor)->send(nnev);
+}
+
+void NNFusedNetwork::serialize_order(SST::Core::Serialization::serializer &ser)
+{
+  NNLayerBase::serialize_order(ser);
+  SST_SER(layers_);
+  SST_SER(optimizers_);
+  SST_SER(linkHandlers);
+  SST_SER(forwardData_i);
+  SST_SER(backwardData_o);
+  SST_SER(monitorData_o);
+  SST_SER(sstout_);
+  SST_SER(timeConverter_);
+  SST_SER(clockHandler_);
+  SST_SER(clockEnabled_);
+}
+
+} // namespace SST::NeuralNet
+
+// EOF
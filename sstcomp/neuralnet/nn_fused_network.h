@@ -0,0 +1,130 @@
+//
+// _nn_fused_network_h_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+
+#ifndef _SST_NN_FUSED_NETWORK_H_
+#define _SST_NN_FUSED_NETWORK_H_
+
+// clang-format off
+#include <map>
+#include <vector>
+
+#include "nn_layer_base.h"
+#include "nn_event.h"
+// clang-format on
+
+namespace SST::NeuralNet{
+
+// -------------------------------------------------------
+// NNFusedNetwork
+// Runs a whole layer stack inside one component. The transfer functions
+// are loaded into numbered "transfer_function" slots in forward order and
+// each layer with weights has an "optimizer" in the slot with the same
+// number. The "loss_optimizer" takes the place of the loss component's
+// optimizer in the layered network: it starts each update and hands its
+// learning rate to the layer optimizers. A batch from the controller goes through the forward passes,
+// the loss and the backward passes in a single clock tick so no events
+// or clock reregistrations pass between layers.
+//
+// Batches are retired one at a time, so with several in flight each
+// forward pass sees the weights of every earlier batch (pipelineDepth=1
+// results). Use one NNLayer component per layer to watch the individual
+// events in the debug console.
+// -------------------------------------------------------
+class NNFusedNetwork : public NNLayerBase {
+public:
+  NNFusedNetwork( SST::ComponentId_t id, const SST::Params& params );
+  ~NNFusedNetwork();
+
+  // Component Lifecycle
+  void init( unsigned int phase ) override;     // post-construction, polled events
+  void setup() override;                        // pre-simulation, called once per component
+  void complete( unsigned int phase ) override; // post-simulation, polled events
+  void finish() override;                       // pre-destruction, called once per component
+  void emergencyShutdown() override;            // SIGINT, SIGTERM
+  void printStatus(Output& out) override;       // SIGUSR2
+
+  // Clocking
+  bool clockTick( SST::Cycle_t currentCycle );  // return true if clock should be disabled
+
+  SST_ELI_REGISTER_COMPONENT( NNFusedNetwork,    // component class
+                              "neuralnet",       // component library
+                              "NNFusedNetwork",  // component name
+                              SST_ELI_ELEMENT_VERSION( 1, 0, 0 ),
+                              "Layer stack in a single SST Component",
+                              COMPONENT_CATEGORY_UNCATEGORIZED )
+
+  SST_ELI_DOCUMENT_PARAMS(
+    {"clockFreq", "Clock that runs the passes of the layer stack", "1GHz"},
+    {"verbose",   "Sets the verbosity level of output", "0"}
+  )
+
+  SST_ELI_DOCUMENT_SUBCOMPONENT_SLOTS(
+    { "loss_optimizer",
+      "Optimizer that starts each update. Required with layer optimizers",
+      "SST::NeuralNet::NNOptimizerAPI" }
+  )
+
+private:
+
+  // event handling. Only forward_i, backward_o and monitor are connected.
+  std::map<SST::NeuralNet::PortTypes,SST::Link*> linkHandlers = {};
+  void forward_i_rcv(SST::Event *ev);
+  void backward_o_snd();
+  void monitor_snd();
+
+  // Inputs are queued by batch id while several batches are in flight
+  std::map<uint64_t, payload_t> forwardData_i = {};
+  payload_t backwardData_o = {};
+  payload_t monitorData_o = {};
+
+  // The layer stack, in forward order. optimizers_[i] is null for layers
+  // without weights.
+  std::vector<NNSubComponentAPI*> layers_ = {};
+  std::vector<NNOptimizerAPI*> optimizers_ = {};
+
+  // per batch work ( call from clocktick )
+  void forwardPass(payload_t& p);
+  void monitorPass(payload_t& p);   // includes the backward pass when training
+  void backwardPass(payload_t& p);
+
+  // -- SST handlers
+  SST::Output    sstout_;
+  TimeConverter timeConverter_;
+  SST::Clock::HandlerBase* clockHandler_;
+
+  // internals
+  bool clockEnabled_ = false;
+  void wakeClock();
+  payload_t sampleLosses_ = {};
+  uint64_t allocations() const;
+
+  // transfer function buffer allocations during training
+  uint64_t trainingSteps_ = 0;
+  uint64_t firstStepAllocations_ = 0;
+  uint64_t trainingAllocations_ = 0;
+
+public:
+  // -------------------------------------------------------
+  // Serialization support
+  // -------------------------------------------------------
+  // Default constructor required for serialization
+  NNFusedNetwork() : NNLayerBase() {}
+  // Serialization function
+  void serialize_order(SST::Core::Serialization::serializer& ser) override;
+  // Serialization implementation
+  ImplementSerializable(SST::NeuralNet::NNFusedNetwork)
+
+};  //class NNFusedNetwork
+
+} //namespace SST::NeuralNet
+
+#endif  // _SST_NN_FUSED_NETWORK_H_
+
+// EOF
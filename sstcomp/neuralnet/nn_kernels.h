@@ -0,0 +1,322 @@
+//
+// _nn_kernels_h_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+
+#ifndef _SST_NN_KERNELS_H_
+#define _SST_NN_KERNELS_H_
+
+// Hand fused kernels used by the neural net layers.
+// Only depends on Eigen so they can be tested and benchmarked standalone.
+
+// clang-format off
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <type_traits>
+
+#include "EIGEN.h"
+// clang-format on
+
+namespace SST::NeuralNet::Kernels{
+
+// -------------------------------------------------------
+// Adam
+// -------------------------------------------------------
+// Per step constants. Computed once per update, not per element.
+struct adam_step_t {
+  double beta_1 = 0.9;
+  double beta_2 = 0.999;
+  double momentum_correction = 1;   // 1 - beta_1^(t+1)
+  double cache_correction = 1;      // 1 - beta_2^(t+1)
+  double learning_rate = 0.001;
+  double epsilon = 1e-7;
+  adam_step_t() {}
+  adam_step_t(double b1, double b2, double lr, double eps, unsigned iterations) :
+    beta_1(b1), beta_2(b2),
+    momentum_correction(1. - std::pow(b1, (iterations + 1.))),
+    cache_correction(1 - std::pow(b2, (iterations + 1))),
+    learning_rate(lr), epsilon(eps) {}
+};
+
+// Single pass Adam update over n contiguous elements.
+// Reads each of w, m, v, g once and writes w, m, v once.
+// The operation order per element matches the multi-pass Eigen
+// expressions it replaces so results do not drift:
+//   m = b1*m + (1-b1)*g
+//   v = b2*v + (1-b2)*g*g
+//   w = w - lr*(m/mc) / (sqrt(v/vc) + eps)
+// T is the parameter/gradient type and S the optimizer state type.
+// The update is computed in S. Mixed types (float parameters with
+// double state) use the scalar loop only.
+template<typename T, typename S>
+inline void adam_update(T* w, S* m, S* v, const T* g,
+                        Eigen::Index n, const adam_step_t& s)
+{
+  const S beta_1 = static_cast<S>(s.beta_1);
+  const S beta_2 = static_cast<S>(s.beta_2);
+  const S one_minus_b1 = static_cast<S>(1. - s.beta_1);
+  const S one_minus_b2 = static_cast<S>(1 - s.beta_2);
+  const S momentum_correction = static_cast<S>(s.momentum_correction);
+  const S cache_correction = static_cast<S>(s.cache_correction);
+  const S learning_rate = static_cast<S>(s.learning_rate);
+  const S epsilon = static_cast<S>(s.epsilon);
+
+  Eigen::Index i = 0;
+  if constexpr (std::is_same_v<T, S>) {
+    using namespace Eigen::internal;
+    using Packet = typename packet_traits<S>::type;
+    constexpr Eigen::Index PS = packet_traits<S>::size;
+
+    const Packet b1  = pset1<Packet>(beta_1);
+    const Packet b2  = pset1<Packet>(beta_2);
+    const Packet cb1 = pset1<Packet>(one_minus_b1);
+    const Packet cb2 = pset1<Packet>(one_minus_b2);
+    const Packet mc  = pset1<Packet>(momentum_correction);
+    const Packet vc  = pset1<Packet>(cache_correction);
+    const Packet lr  = pset1<Packet>(learning_rate);
+    const Packet eps = pset1<Packet>(epsilon);
+
+    for (; i + PS <= n; i += PS) {
+      Packet gi = ploadu<Packet>(g + i);
+      Packet mi = padd(pmul(b1, ploadu<Packet>(m + i)), pmul(cb1, gi));
+      Packet vi = padd(pmul(b2, ploadu<Packet>(v + i)), pmul(cb2, pmul(gi, gi)));
+      Packet step = pdiv(pmul(lr, pdiv(mi, mc)), padd(psqrt(pdiv(vi, vc)), eps));
+      pstoreu(m + i, mi);
+      pstoreu(v + i, vi);
+      pstoreu(w + i, psub(ploadu<Packet>(w + i), step));
+    }
+  }
+  for (; i < n; i++) {
+    const S gi = static_cast<S>(g[i]);
+    const S mi = beta_1 * m[i] + one_minus_b1 * gi;
+    const S vi = beta_2 * v[i] + one_minus_b2 * (gi * gi);
+    m[i] = mi;
+    v[i] = vi;
+    w[i] = static_cast<T>(static_cast<S>(w[i]) - learning_rate * (mi / momentum_correction) /
+                                                 (std::sqrt(vi / cache_correction) + epsilon));
+  }
+}
+
+// Matrix convenience wrapper. All operands must have the same shape.
+template<typename W, typename S, typename G>
+inline void adam_update(Eigen::PlainObjectBase<W>& w, Eigen::PlainObjectBase<S>& m,
+                        Eigen::PlainObjectBase<S>& v, const Eigen::PlainObjectBase<G>& g,
+                        const adam_step_t& s)
+{
+  eigen_assert(w.size() == m.size() && w.size() == v.size() && w.size() == g.size());
+  adam_update(w.data(), m.data(), v.data(), g.data(), w.size(), s);
+}
+
+// -------------------------------------------------------
+// Banded GEMM
+// -------------------------------------------------------
+// Dense layer products split over a thread pool. Pool is any type with
+// size() and parallel_for(n, fn) (ThreadPool). Each thread writes its own
+// band of the result with a plain Eigen product, so every element is
+// summed in the same order as the single product over the whole matrix.
+
+// Rows (or columns) per band when n are split into parts. Bands are kept
+// to a multiple of 8 so they start on vector boundaries, and of the GEMM
+// kernel's panel (mr rows or nr columns) so every band is cut into the
+// same panels as the whole product.
+inline Eigen::Index gemm_band(Eigen::Index n, size_t parts, Eigen::Index panel)
+{
+  const Eigen::Index p = static_cast<Eigen::Index>(parts);
+  const Eigen::Index align = std::lcm(Eigen::Index(8), panel);
+  return ((n + p - 1) / p + align - 1) / align * align;
+}
+
+// Eigen sums small products coefficient by coefficient and single row or
+// column products as a GEMV, each in a different order than its blocked
+// GEMM. True when a band x depth x other product takes the GEMM path.
+inline bool gemm_path(Eigen::Index band, Eigen::Index depth, Eigen::Index other)
+{
+  return band > 1 && other > 1 && band + depth + other >= EIGEN_GEMM_TO_COEFFBASED_THRESHOLD;
+}
+
+// Bands of chunk that n is cut into. Only 1 when a band would leave the
+// GEMM path of the whole product. A short last band joins the one before.
+inline Eigen::Index gemm_band_count(Eigen::Index n, Eigen::Index chunk,
+                                    Eigen::Index depth, Eigen::Index other)
+{
+  if (!gemm_path(n, depth, other) || !gemm_path(std::min(chunk, n), depth, other))
+    return 1;
+  Eigen::Index bands = (n + chunk - 1) / chunk;
+  if (bands > 1 && !gemm_path(n - (bands - 1) * chunk, depth, other))
+    bands--;
+  return bands;
+}
+
+// out = a * b, each thread computing a band of output rows.
+// out must already have a's rows and b's columns.
+template<typename Pool, typename T>
+inline void gemm_rows(Pool& pool, Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& out,
+                      const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& a,
+                      const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& b)
+{
+  const Eigen::Index rows = a.rows();
+  const Eigen::Index mr = Eigen::internal::gebp_traits<T, T>::mr;
+  const Eigen::Index chunk = gemm_band(rows, pool.size(), mr);
+  const Eigen::Index bands = gemm_band_count(rows, chunk, a.cols(), b.cols());
+  pool.parallel_for(static_cast<size_t>(bands), [&](size_t p) {
+    const Eigen::Index r = static_cast<Eigen::Index>(p) * chunk;
+    const Eigen::Index n = static_cast<Eigen::Index>(p) + 1 == bands ? rows - r : chunk;
+    out.middleRows(r, n).noalias() = a.middleRows(r, n) * b;
+  });
+}
+
+// Dense layer backward products, which are independent:
+//   dweights = inputs^T * dvalues   banded by columns
+//   dinputs  = dvalues * weights^T  banded by rows
+// The pool takes bands of both at once. dweights and dinputs must already
+// have their shapes and dinputs must not alias inputs.
+template<typename Pool, typename T>
+inline void gemm_dense_backward(Pool& pool,
+                                Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& dweights,
+                                Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& dinputs,
+                                const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& inputs,
+                                const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& dvalues,
+                                const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& weights)
+{
+  const size_t parts = pool.size();
+  const Eigen::Index cols = dweights.cols();
+  const Eigen::Index rows = dinputs.rows();
+  const Eigen::Index mr = Eigen::internal::gebp_traits<T, T>::mr;
+  const Eigen::Index nr = Eigen::internal::gebp_traits<T, T>::nr;
+  const Eigen::Index wchunk = gemm_band(cols, parts, nr);
+  const Eigen::Index ichunk = gemm_band(rows, parts, mr);
+  const Eigen::Index wbands = gemm_band_count(cols, wchunk, inputs.rows(), inputs.cols());
+  const Eigen::Index ibands = gemm_band_count(rows, ichunk, dvalues.cols(), weights.rows());
+  pool.parallel_for(static_cast<size_t>(wbands + ibands), [&](size_t t) {
+    const Eigen::Index b = static_cast<Eigen::Index>(t);
+    if (b < wbands) {
+      const Eigen::Index c = b * wchunk;
+      const Eigen::Index n = b + 1 == wbands ? cols - c : wchunk;
+      dweights.middleCols(c, n).noalias() = inputs.transpose() * dvalues.middleCols(c, n);
+    } else {
+      const Eigen::Index r = (b - wbands) * ichunk;
+      const Eigen::Index n = b - wbands + 1 == ibands ? rows - r : ichunk;
+      dinputs.middleRows(r, n).noalias() = dvalues.middleRows(r, n) * weights.transpose();
+    }
+  });
+}
+
+// -------------------------------------------------------
+// Dense + ReLU
+// -------------------------------------------------------
+// Bias, activation and mask in one pass over the column-major rows x cols
+// GEMM output z:
+//   z = max(0, z + b)   b broadcast down each column
+// Element i passes the gradient when !(z+b <= 0) and sets bit i%64 of
+// mask[i/64], the NNBitMask layout. Gives the same bits as adding the
+// biases and then running NNBitMask::relu.
+template<typename T>
+inline void bias_relu(T* z, Eigen::Index rows, Eigen::Index cols, const T* b, uint64_t* mask)
+{
+  constexpr Eigen::Index bits = 64;
+  uint64_t word = 0;
+  Eigen::Index i = 0;
+  for (Eigen::Index c = 0; c < cols; c++) {
+    const T bc = b[c];
+    for (Eigen::Index r = 0; r < rows; r++, i++) {
+      const T v = z[i] + bc;
+      const bool active = !(v <= 0);
+      z[i] = active ? v : 0;
+      word |= static_cast<uint64_t>(active) << (i % bits);
+      if (i % bits == bits - 1) {
+        *mask++ = word;
+        word = 0;
+      }
+    }
+  }
+  if (i % bits)
+    *mask = word;
+}
+
+// -------------------------------------------------------
+// Softmax + categorical cross-entropy
+// -------------------------------------------------------
+// Losses, predictions and gradient of a softmax activation followed by the
+// categorical cross-entropy loss, from the samples x classes logits z and
+// the class of each sample:
+//   losses(i)      = -log(softmax(z)(i, labels(i)))
+//   predictions(i) = column of the row maximum, the first one on ties
+//   dinputs        = (softmax(z) - one_hot(labels)) / samples
+// log(softmax(z)) = z - max - log(sum(exp(z - max))) so large logits
+// neither overflow nor round a probability to zero. It is clipped to
+// [log(1e-7), log(1-1e-7)] like the unfused loss clips probabilities.
+// The gradient is only computed when dinputs is given. losses, predictions
+// and dinputs must already have their shapes.
+// Returns the number of correct predictions.
+template<typename T>
+inline Eigen::Index softmax_cce(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& z,
+                                const Eigen::MatrixXi& labels,
+                                Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& losses,
+                                Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& predictions,
+                                Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>* dinputs)
+{
+  const Eigen::Index samples = z.rows();
+  const Eigen::Index classes = z.cols();
+
+  // Rows are taken in blocks small enough to stay in cache while the
+  // max/argmax, exp/sum and gradient steps run over them. Each step works
+  // a column at a time so it vectorizes down the column-major logits.
+  constexpr Eigen::Index BLOCK = 64;
+  using Block = Eigen::Array<T, Eigen::Dynamic, 1, Eigen::ColMajor, BLOCK, 1>;
+  const T log_min = std::log(static_cast<T>(1e-7));
+  const T log_max = std::log(static_cast<T>(1-1e-7));
+  const T inv_samples = static_cast<T>(1) / static_cast<T>(samples);
+  Eigen::Index correct = 0;
+  for (Eigen::Index r = 0; r < samples; r += BLOCK) {
+    const Eigen::Index n = std::min(BLOCK, samples - r);
+    // Row max and its column
+    Block row_max = z.col(0).segment(r, n).array();
+    Block index = Block::Zero(n);
+    for (Eigen::Index c = 1; c < classes; c++) {
+      const auto v = z.col(c).segment(r, n).array();
+      index = (v > row_max).select(static_cast<T>(c), index);
+      row_max = row_max.max(v);
+    }
+    // Exponentials, kept for the gradient. They are evaluated into the
+    // block either way so losses do not depend on whether the gradient is
+    // wanted.
+    Block row_sum = Block::Zero(n);
+    for (Eigen::Index c = 0; c < classes; c++) {
+      const Block e = (z.col(c).segment(r, n).array() - row_max).exp();
+      row_sum += e;
+      if (dinputs)
+        dinputs->col(c).segment(r, n).array() = e;
+    }
+    // Losses, predictions and accuracy
+    const Block log_sum = row_sum.log();
+    for (Eigen::Index i = 0; i < n; i++) {
+      const int label = labels(r + i, 0);
+      const T log_p = z(r + i, label) - row_max(i) - log_sum(i);
+      losses(r + i, 0) = -std::min(std::max(log_p, log_min), log_max);
+      predictions(r + i, 0) = index(i);
+      correct += (static_cast<int>(index(i)) == label);
+    }
+    if (dinputs) {
+      // (softmax - one_hot) / samples
+      const Block scale = inv_samples / row_sum;
+      for (Eigen::Index c = 0; c < classes; c++)
+        dinputs->col(c).segment(r, n).array() *= scale;
+      for (Eigen::Index i = 0; i < n; i++)
+        (*dinputs)(r + i, labels(r + i, 0)) -= inv_samples;
+    }
+  }
+  return correct;
+}
+
+} //namespace SST::NeuralNet::Kernels
+
+#endif  // _SST_NN_KERNELS_H_
+
+// EOF
@@ -10,6 +10,7 @@
 
 #include <assert.h>
 #include "nn_layer.h"
+#include "nn_kernels.h"
 #include "tcldbg.h"
 #include "nn_layer_base.h"
 
@@ -39,15 +40,35 @@ NNLayer::NNLayer(SST::ComponentId_t id, const SST::Params& params ) :
     "NNLayer[" + getName() + ":@p:@t]: ",
     Verbosity, 0, SST::Output::STDOUT );
   lastComponent_ = params.find<bool>("lastComponent", false);
-
-  // clocking 
-  const std::string systemClock = params.find< std::string >("clockFreq", "1GHz");
-  clockHandler_  = new SST::Clock::Handler<NNLayer,&NNLayer::clockTick>(this);
-  timeConverter_ = registerClock(systemClock, clockHandler_);
-  sstout_.verbose(CALL_INFO, 10, 0, "register clock: &timeConverter_=%p factor=%" PRIx64 "\n", &timeConverter_, timeConverter_.getFactor());
-  // an event will wake up the clocking
-  sstout_.verbose(CALL_INFO, 10, 0, "unregister clock: &timeConverter_=%p factor=%" PRIx64 "\n", &timeConverter_, timeConverter_.getFactor());
-  unregisterClock(timeConverter_, clockHandler_);
+  eventDriven_ = params.find<bool>("eventDriven", false);
+
+  // device latency model
+  peak_flops_ = params.find<double>("peakFlops", 0);
+  mem_bandwidth_ = params.find<double>("memBandwidth", 0);
+  UnitAlgebra overhead(params.find<std::string>("layerOverhead", "0ns"));
+  if (!overhead.hasUnits("s"))
+    sstout_.fatal(CALL_INFO, -1, "layerOverhead must be a time\n");
+  layer_overhead_ = static_cast<SimTime_t>((overhead / UnitAlgebra("1ps")).getRoundedValue());
+  statForwardMacs_ = registerStatistic<uint64_t>("forward_macs");
+  statBackwardMacs_ = registerStatistic<uint64_t>("backward_macs");
+  statBytes_ = registerStatistic<uint64_t>("bytes_moved");
+  statBusyTime_ = registerStatistic<uint64_t>("busy_time");
+
+  if (eventDriven_) {
+    // each arriving batch schedules a compute event computeLatency ahead
+    const std::string computeLatency = params.find< std::string >("computeLatency", "1ns");
+    computeLink_ = configureSelfLink("compute", computeLatency,
+              new Event::Handler<NNLayer, &NNLayer::compute_rcv>(this));
+  } else {
+    // clocking 
+    const std::string systemClock = params.find< std::string >("clockFreq", "1GHz");
+    clockHandler_  = new SST::Clock::Handler<NNLayer,&NNLayer::clockTick>(this);
+    timeConverter_ = registerClock(systemClock, clockHandler_);
+    sstout_.verbose(CALL_INFO, 10, 0, "register clock: &timeConverter_=%p factor=%" PRIx64 "\n", &timeConverter_, timeConverter_.getFactor());
+    // an event will wake up the clocking
+    sstout_.verbose(CALL_INFO, 10, 0, "unregister clock: &timeConverter_=%p factor=%" PRIx64 "\n", &timeConverter_, timeConverter_.getFactor());
+    unregisterClock(timeConverter_, clockHandler_);
+  }
 
   // subcomponents
   if (lastComponent_) {
@@ -61,21 +82,21 @@ NNLayer::NNLayer(SST::ComponentId_t id, const SST::Params& params ) :
   // optimizer associated with layers with weights only
   optimizer_ = loadUserSubComponent<NNOptimizerAPI>("optimizer");
 
-  // Configure Links
+  // Configure Links. Output delays are in ps.
   linkHandlers[PortTypes::forward_i] = 
-    configureLink(PortNames.at(PortTypes::forward_i),
+    configureLink(PortNames.at(PortTypes::forward_i), "1ps",
               new Event::Handler<NNLayer, &NNLayer::forward_i_rcv>(this));
   linkHandlers[PortTypes::forward_o] = 
-    configureLink(PortNames.at(PortTypes::forward_o),
+    configureLink(PortNames.at(PortTypes::forward_o), "1ps",
               new Event::Handler<NNLayer, &NNLayer::forward_o_rcv>(this));
   linkHandlers[PortTypes::backward_i] = 
-    configureLink(PortNames.at(PortTypes::backward_i),
+    configureLink(PortNames.at(PortTypes::backward_i), "1ps",
               new Event::Handler<NNLayer, &NNLayer::backward_i_rcv>(this));
   linkHandlers[PortTypes::backward_o] = 
-    configureLink(PortNames.at(PortTypes::backward_o),
+    configureLink(PortNames.at(PortTypes::backward_o), "1ps",
               new Event::Handler<NNLayer, &NNLayer::backward_o_rcv>(this));
   linkHandlers[PortTypes::monitor] = 
-    configureLink(PortNames.at(PortTypes::monitor),
+    configureLink(PortNames.at(PortTypes::monitor), "1ps",
     new Event::Handler<NNLayer, &NNLayer::monitorEvent>(this));
 }
 
@@ -94,6 +115,11 @@ void NNLayer::complete( unsigned int phase ){
 }
 
 void NNLayer::finish(){
+  if (trainingSteps_ > 0) {
+    sstout_.verbose(CALL_INFO, 1, 0,
+      "buffer allocations: %" PRIu64 " in first training step, %" PRIu64 " in %" PRIu64 " later steps\n",
+      firstStepAllocations_, trainingAllocations_ - firstStepAllocations_, trainingSteps_ - 1);
+  }
 }
 
 void NNLayer::emergencyShutdown(){
@@ -103,161 +129,254 @@ void NNLayer::printStatus( Output& out ){
 }
 
 bool NNLayer::clockTick( SST::Cycle_t currentCycle ) {
+  clockEnabled_ = runPasses();
+  return !clockEnabled_;
+}
+
+void NNLayer::compute_rcv(SST::Event *ev) {
+  delete ev;
+  computePending_ = runPasses();
+  if (computePending_)
+    computeLink_->send(new NNEvent(payload_t()));
+}
+
+bool NNLayer::runPasses() {
   // Clocking control should ensure we always have something to do here
-  assert(driveForwardPass_ || driveMonitor_ || driveBackwardPass_);
-  if (driveForwardPass_) {
-    transfer_function_->forward(forwardData_i, forwardData_o);
-    forward_o_snd();
-    driveForwardPass_=false;
-  }
-
-  if (driveMonitor_) {
-    MODE mode = forwardData_i.mode;
-    assert(lastComponent_);
-    if (mode==MODE::VALIDATION || mode==MODE::TRAINING) {
-      // Loss calculation at end of first pass
-      assert(loss_function_);
-      payload_t sampleLosses = {};
-      loss_function_->forward(forwardData_i, sampleLosses);
-      // sampleLosses.X_batch is sample_losses
-      // sampleLosses.y_batch is y_true
-      Losses losses = loss_function_->calculate(sampleLosses.data);
-      // Predictions and accuracy
-      Eigen::MatrixXd predictions = loss_function_->predictions(forwardData_i.data);
-      double accuracy = accuracy_function_->calculate(predictions, forwardData_i.classes);
-
-      if (sstout_.getVerboseLevel() > 2 ) {
-        std::cout << "### Forward pass result ###" << std::endl;
-        std::cout << std::fixed << std::setprecision(3) 
-          << "acc: " << accuracy
-          << ", loss: "  << losses.total_loss()
-          << " (data_loss: "  << losses.data_loss
-          << ", reg_loss: "  << losses.regularization_loss << ")" << std::endl;
-      }
+  assert(!forwardData_i.empty() || !backwardData_i.empty());
+
+  // 1F1B ordering: retire the oldest batch waiting for its backward pass
+  // first so its weight update is in place before the next forward pass.
+  // Batches are taken in batch id order so updates are applied in the
+  // order the controller launched them.
+  if (!backwardData_i.empty()) {
+    auto it = backwardData_i.begin();
+    payload_t in = std::move(it->second);
+    backwardData_i.erase(it);
+    backwardPass(std::move(in));
+  }
 
-      // Send results to batch_controller
-      monitorData_o = sampleLosses;
-      monitorData_o.accuracy = accuracy;
-      monitorData_o.losses = losses;
-      if (driveBackwardPass_) {
-        // Provide accuracy and losses through backward passes to batch controller
-        backwardData_i = forwardData_i;
-        backwardData_i.optimizer_data.optimizerState = OPTIMIZER_STATE::PRE_UPDATE;
-        backwardData_i.accuracy = accuracy;
-        backwardData_i.losses = losses;
-      }
-    } else if (mode==MODE::EVALUATION) {
-      monitorData_o = forwardData_i;
-      monitorData_o.predictions = loss_function_->predictions(forwardData_i.data);
-    } else {
-      assert(false);
+  if (!forwardData_i.empty()) {
+    auto it = forwardData_i.begin();
+    payload_t in = std::move(it->second);
+    forwardData_i.erase(it);
+    if (lastComponent_)
+      monitorPass(std::move(in));
+    else
+      forwardPass(std::move(in));
+  }
+
+  // Keep going while batches are waiting
+  return !forwardData_i.empty() || !backwardData_i.empty();
+}
+
+void NNLayer::forwardPass(payload_t&& in) {
+  const bool training = (in.mode == MODE::TRAINING);
+  const uint64_t batch_id = in.batch_id;
+  if (!transfer_function_->acceptsView())
+    in.gather();
+  const bool viewed = !in.view.empty();
+  const SimTime_t delay = passDelay(false, transfer_function_->work(false,
+      static_cast<uint64_t>(viewed ? in.view.rows : in.data.rows()),
+      static_cast<uint64_t>(viewed ? in.view.cols : in.data.cols())));
+  uint64_t allocations = transfer_function_->allocations();
+  {
+    // Training passes after the first one must not touch the heap
+    NNMallocScope steady(!training || trainingSteps_ == 0);
+    transfer_function_->forward(std::move(in), forwardData_o);
+  }
+  if (training) {
+    trainingAllocations_ += transfer_function_->allocations() - allocations;
+    // Later batches may pass through before this one comes back
+    transfer_function_->stash(batch_id);
+  }
+  forward_o_snd(delay);
+}
+
+void NNLayer::monitorPass(payload_t&& in) {
+  MODE mode = in.mode;
+  assert(lastComponent_);
+  in.gather();
+  assert(loss_function_);
+  const SimTime_t delay = passDelay(false, loss_function_->work(false,
+      static_cast<uint64_t>(in.data.rows()), static_cast<uint64_t>(in.data.cols())));
+  if (mode==MODE::VALIDATION || mode==MODE::TRAINING) {
+    NNMallocScope steady(mode != MODE::TRAINING || trainingSteps_ == 0);
+    // Loss calculation at end of first pass
+    loss_function_->forward(in, sampleLosses_);
+    // sampleLosses_.X_batch is sample_losses
+    // sampleLosses_.y_batch is y_true
+    Losses losses = loss_function_->calculate(sampleLosses_.data);
+    // Predictions and accuracy
+    const MatrixXs& predictions = loss_function_->predictions(in.data);
+    double accuracy = loss_function_->fused() ? loss_function_->accuracy()
+                                              : accuracy_function_->calculate(predictions, in.classes);
+
+    if (sstout_.getVerboseLevel() > 2 ) {
+      std::cout << "### Forward pass result ###" << std::endl;
+      std::cout << std::fixed << std::setprecision(3) 
+        << "acc: " << accuracy
+        << ", loss: "  << losses.total_loss()
+        << " (data_loss: "  << losses.data_loss
+        << ", reg_loss: "  << losses.regularization_loss << ")" << std::endl;
     }
-    // Send data back to controller
-    monitor_snd();
-    driveMonitor_=false;
-  }
-  if (driveBackwardPass_) {
-    // backward pass transfer function
-    transfer_function_->backward(backwardData_i, backwardData_o);
-    // Optimizer for layers with weights
-    if (optimizer_) {
-        // optimizer
-        if (backwardData_o.optimizer_data.optimizerState == OPTIMIZER_STATE::PRE_UPDATE) {
-          // update the current learning rate
-          optimizer_->pre_update_params();
-          // pass the hyperparameters to previous layer
-          backwardData_o.optimizer_data = { 
-            OPTIMIZER_STATE::ACTIVE, 
-            optimizer_->learning_rate(),
-            optimizer_->current_learning_rate(),
-            optimizer_->iterations() };
-          // Keep track of iterations
-          optimizer_->post_update_params();
-        } else {
-          assert(backwardData_o.optimizer_data.optimizerState == OPTIMIZER_STATE::ACTIVE);
-          optimizer_->update_params(static_cast<NNDenseLayer*>(transfer_function_), backwardData_o.optimizer_data );
-        }
+
+    // Send results to batch_controller. The controller only needs the scalars.
+    monitorData_o.mode = mode;
+    monitorData_o.batch_id = in.batch_id;
+    monitorData_o.optimizer_data = in.optimizer_data;
+    monitorData_o.accuracy = accuracy;
+    monitorData_o.losses = losses;
+    monitor_snd(delay);
+    if (mode==MODE::TRAINING) {
+      // Provide accuracy and losses through backward passes to batch controller.
+      // The forward pass data is no longer needed so hand its buffers over.
+      in.optimizer_data.optimizerState = OPTIMIZER_STATE::PRE_UPDATE;
+      in.accuracy = accuracy;
+      in.losses = losses;
+      // A fused loss already has the gradient for the layer before it
+      if (loss_function_->fused())
+        loss_function_->gradient(in);
+      backwardPass(std::move(in));
     }
-    // drive output
-    backward_o_snd();
-    driveBackwardPass_=false;
+  } else if (mode==MODE::EVALUATION) {
+    monitorData_o = std::move(in);
+    monitorData_o.predictions = loss_function_->predictions(monitorData_o.data);
+    monitor_snd(delay);
+  } else {
+    assert(false);
   }
-  return true;
 }
 
-void NNLayer::forward_i_rcv(SST::Event *ev){
-  NNEvent *nnev = static_cast<NNEvent*>(ev);
-  forwardData_i = nnev->payload();
-  if (lastComponent_) {
-    driveMonitor_ = true;
-    if (forwardData_i.mode == MODE::TRAINING)
-      driveBackwardPass_ = true;
+void NNLayer::backwardPass(payload_t&& in) {
+  // Bring back the forward state this batch left behind
+  if (!lastComponent_)
+    transfer_function_->unstash(in.batch_id);
+  // backward pass transfer function
+  const SimTime_t delay = passDelay(true, transfer_function_->work(true,
+      static_cast<uint64_t>(in.data.rows()), static_cast<uint64_t>(in.data.cols())));
+  uint64_t allocations = transfer_function_->allocations();
+  NNMallocScope steady(trainingSteps_ == 0);
+  transfer_function_->backward(std::move(in), backwardData_o);
+  trainingAllocations_ += transfer_function_->allocations() - allocations;
+  if (trainingSteps_++ == 0)
+    firstStepAllocations_ = trainingAllocations_;
+  // Optimizer for layers with weights
+  if (optimizer_)
+    optimizer_->step(transfer_function_, backwardData_o.optimizer_data);
+  // drive output
+  backward_o_snd(delay);
+}
+
+SimTime_t NNLayer::passDelay(bool backward, const pass_work_t& w)
+{
+  (backward ? statBackwardMacs_ : statForwardMacs_)->addData(w.macs);
+  statBytes_->addData(w.bytes);
+  if (peak_flops_ <= 0)
+    return 0;
+  // Roofline: a pass is bound by its arithmetic or its memory traffic
+  double seconds = 2.0 * static_cast<double>(w.macs) / peak_flops_;
+  if (mem_bandwidth_ > 0)
+    seconds = std::max(seconds, static_cast<double>(w.bytes) / mem_bandwidth_);
+  const SimTime_t busy = layer_overhead_ + static_cast<SimTime_t>(std::ceil(seconds * 1e12));
+  statBusyTime_->addData(busy);
+  // A pass waits for the one still on the device
+  const SimTime_t now = getCurrentSimTime("1ps");
+  busy_until_ = std::max(now, busy_until_) + busy;
+  return busy_until_ - now;
+}
+
+void NNLayer::wake() {
+  // Events can arrive while earlier batches are still queued
+  if (eventDriven_) {
+    if (!computePending_)
+      computeLink_->send(new NNEvent(payload_t()));
+    computePending_ = true;
+    return;
   }
-  else
-    driveForwardPass_ = true;
- 
+  if (clockEnabled_)
+    return;
   sstout_.verbose(CALL_INFO, 10, 0, "reregister clock: &timeConverter_=%p factor=%" PRIx64 "\n", &timeConverter_, timeConverter_.getFactor());
   reregisterClock(timeConverter_, clockHandler_);
+  clockEnabled_ = true;
+}
+
+void NNLayer::forward_i_rcv(SST::Event *ev){
+  NNEvent *nnev = static_cast<NNEvent*>(ev);
+  payload_t in = nnev->release();
+  const uint64_t batch_id = in.batch_id;
+  assert(forwardData_i.count(batch_id) == 0);
+  forwardData_i.emplace(batch_id, std::move(in));
+  wake();
   delete ev;
 }
 
 void NNLayer::backward_i_rcv(SST::Event *ev){
   NNEvent *nnev = static_cast<NNEvent*>(ev);
-  backwardData_i = nnev->payload();
-  driveBackwardPass_ = true;
-  sstout_.verbose(CALL_INFO, 10, 0, "reregister clock: &timeConverter_=%p factor=%" PRIx64 "\n", &timeConverter_, timeConverter_.getFactor());
-  reregisterClock(timeConverter_, clockHandler_);
+  payload_t in = nnev->release();
+  const uint64_t batch_id = in.batch_id;
+  assert(backwardData_i.count(batch_id) == 0);
+  backwardData_i.emplace(batch_id, std::move(in));
+  wake();
   delete ev;
 }
 
-void NNLayer::backward_o_snd() {
+void NNLayer::backward_o_snd(SimTime_t delay) {
   sstout_.verbose(CALL_INFO, 5, 0, "%s sending backward pass data\n", getName().c_str());
-  NNEvent* nnev = new NNEvent(backwardData_o);
-  linkHandlers.at(PortTypes::backward_o)->send(nnev);
+  NNEvent* nnev = new NNEvent(std::move(backwardData_o));
+  linkHandlers.at(PortTypes::backward_o)->send(delay, nnev);
 }
 
-void NNLayer::forward_o_snd(){
+void NNLayer::forward_o_snd(SimTime_t delay){
   sstout_.verbose(CALL_INFO, 5, 0, "%s sending forward pass data\n", getName().c_str());
-  NNEvent* nnev = new NNEvent(forwardData_o);
-  linkHandlers.at(PortTypes::forward_o)->send(nnev);
+  NNEvent* nnev = new NNEvent(std::move(forwardData_o));
+  linkHandlers.at(PortTypes::forward_o)->send(delay, nnev);
 }
 
-void NNLayer::monitor_snd() {
+void NNLayer::monitor_snd(SimTime_t delay) {
   sstout_.verbose(CALL_INFO, 5, 0, "%s sending monitor data\n", getName().c_str());
-  NNEvent* nnev = new NNEvent(monitorData_o);
-  linkHandlers.at(PortTypes::monitor)->send(nnev);
+  NNEvent* nnev = new NNEvent(std::move(monitorData_o));
+  linkHandlers.at(PortTypes::monitor)->send(delay, nnev);
 }
 
 void NNLayer::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   NNLayerBase::serialize_order(ser);
   SST_SER(linkHandlers);
-  // SST_SER(forwardData_i);
-  // SST_SER(forwardData_o);
-  // SST_SER(backwardData_i);
-  // SST_SER(backwardData_o);
-  // SST_SER(monitorData_o);
+  SST_SER(forwardData_i);
+  SST_SER(forwardData_o);
+  SST_SER(backwardData_i);
+  SST_SER(backwardData_o);
+  SST_SER(monitorData_o);
   SST_SER(sstout_);
   SST_SER(timeConverter_);
   SST_SER(clockHandler_);
+  SST_SER(computeLink_);
   SST_SER(lastComponent_);
-  SST_SER(driveForwardPass_);
-  SST_SER(driveBackwardPass_);
-  SST_SER(driveMonitor_);
+  SST_SER(eventDriven_);
+  SST_SER(clockEnabled_);
+  SST_SER(computePending_);
+  SST_SER(peak_flops_);
+  SST_SER(mem_bandwidth_);
+  SST_SER(layer_overhead_);
+  SST_SER(busy_until_);
+  SST_SER(statForwardMacs_);
+  SST_SER(statBackwardMacs_);
+  SST_SER(statBytes_);
+  SST_SER(statBusyTime_);
 }
 
 //
 // Input Layer
 //
-void NNInputLayer::forward(const payload_t& in, payload_t& o)
+void NNInputLayer::forward(payload_t&& in, payload_t& o)
 {
-  o = in;
+  o = std::move(in);
   sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
 }
 
-void NNInputLayer::backward(const payload_t& in, payload_t& o)
+void NNInputLayer::backward(payload_t&& in, payload_t& o)
 {
-  o = in;
+  o = std::move(in);
   sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
 }
 
@@ -274,8 +393,10 @@ void NNSubComponentAPI::serialize_order(SST::Core::Serialization::serializer &se
 {
   SubComponent::serialize_order(ser);
   SST_SER(sstout_);
-  // SST_SER(inputs_);
-  // SST_SER(dinputs_);
+  // forward inputs are held until the matching backward pass
+  SST_SER(inputs_);
+  SST_SER(stashedInputs_);
+  // SST_SER(outputs_);  recycled buffer, contents are never read
   // SST_SER(util_);
 
 }
@@ -288,6 +409,22 @@ NNSubComponentAPI::NNSubComponentAPI(ComponentId_t id, Params &params) : SubComp
     "NNSubComponentAPI[" + getName() + ":@p:@t]: ",
     Verbosity, 0, SST::Output::STDOUT );
 }
+
+void NNSubComponentAPI::stash(uint64_t batch_id)
+{
+  // buffers are moved, never copied
+  assert(stashedInputs_.count(batch_id) == 0);
+  stashedInputs_[batch_id].swap(inputs_);
+}
+
+void NNSubComponentAPI::unstash(uint64_t batch_id)
+{
+  auto it = stashedInputs_.find(batch_id);
+  assert(it != stashedInputs_.end());
+  // the current inputs_ buffer (if any) is dropped with the map node
+  inputs_.swap(it->second);
+  stashedInputs_.erase(it);
+}
 //
 // Dense Layer
 //
@@ -298,12 +435,18 @@ NNDenseLayer::NNDenseLayer(ComponentId_t id, Params &params) : NNSubComponentAPI
   n_inputs_ = params.find<unsigned>("nInputs", "4");
   n_neurons_ = params.find<unsigned>("nNeurons", "128");
   initial_weight_scaling = params.find<double>("initialWeightScaling", 0.1);
+  gemm_threads_ = params.find<unsigned>("gemmThreads", 1);
+  if (gemm_threads_ == 0)
+    sstout_.fatal(CALL_INFO, -1, "gemmThreads must be at least 1\n");
+  if (gemm_threads_ > 1)
+    gemm_pool_ = std::make_unique<ThreadPool>(gemm_threads_);
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "### DenseLayer ###" << std::endl;
     std::cout << "n_inputs=" << n_inputs_ << std::endl;
     std::cout << "n_neurons=" << n_neurons_ << std::endl;
     std::cout << "initial_weight_scaling=" << initial_weight_scaling << std::endl;
+    std::cout << "gemm_threads=" << gemm_threads_ << std::endl;
   }
 
   // Regularization parameters
@@ -313,24 +456,45 @@ NNDenseLayer::NNDenseLayer(ComponentId_t id, Params &params) : NNSubComponentAPI
   bias_regularizer_l2_   = params.find<double>("biasRegularizerL2", "0");
 
   // Initialize weights and biases
+  // (drawn in double so every precision starts from the same values)
+  Eigen::MatrixXd initial_weights;
   bool normaldist = true;
   if (normaldist) {
-      util_.rand0to1normal(weights_, n_inputs_, n_neurons_, false);
-      weights_ =  weights_ * initial_weight_scaling;
+      util_.rand0to1normal(initial_weights, n_inputs_, n_neurons_, false);
   } else {
-      util_.rand0to1flat(weights_, n_inputs_, n_neurons_);
-      weights_ = weights_ * initial_weight_scaling;
+      util_.rand0to1flat(initial_weights, n_inputs_, n_neurons_);
+  }
+  weights_ = (initial_weights * initial_weight_scaling).cast<nn_scalar_t>();
+  biases_ = RowVectorXs::Zero(n_neurons_);
+}
+
+void NNDenseLayer::forwardGemm(MatrixXs& out)
+{
+  if (!gemm_pool_) {
+    out.noalias() = inputs_ * weights_;
+    return;
   }
-  biases_ = Eigen::RowVectorXd(n_neurons_) = Eigen::RowVectorXd::Zero(n_neurons_);
+  // Each thread computes a band of output rows
+  Kernels::gemm_rows(*gemm_pool_, out, inputs_, weights_);
 }
 
-void NNDenseLayer::forward(const payload_t& in, payload_t& o)
+void NNDenseLayer::backwardGemms(const MatrixXs& dvalues)
 {
-  // save for back propagation
-  inputs_ = in.data;
+  // The two products are independent. The pool takes bands of dweights_
+  // columns and dinputs_ rows from both at once.
+  assert(gemm_pool_);
+  Kernels::gemm_dense_backward(*gemm_pool_, dweights_, dinputs_, inputs_, dvalues, weights_);
+}
+
+void NNDenseLayer::forward(payload_t&& in, payload_t& o)
+{
+  // save for back propagation by taking over the input buffer
+  inputs_.swap(in.data);
   // Calculate output values from inputs, weights and biases
-  o.data = inputs_ * weights_;
-  o.data = o.data.rowwise() + biases_;
+  o.data.swap(outputs_);
+  conform(o.data, inputs_.rows(), weights_.cols());
+  forwardGemm(o.data);
+  o.data.rowwise() += biases_;
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "### Layer_Dense.forward ###"  << std::endl;
@@ -342,13 +506,13 @@ void NNDenseLayer::forward(const payload_t& in, payload_t& o)
   }
 
   // Complete payload
-  o.copyWithNoData(in);
+  o.copyWithNoData(std::move(in));
   sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
 }
 
-void NNDenseLayer::backward(const payload_t& in, payload_t& o)
+void NNDenseLayer::backward(payload_t&& in, payload_t& o)
 {
-  Eigen::MatrixXd dvalues = in.data; // TODO remove deep copy
+  const MatrixXs& dvalues = in.data;
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "### Layer_Dense.backward ###" << std::endl;
@@ -360,8 +524,16 @@ void NNDenseLayer::backward(const payload_t& in, payload_t& o)
 
   // Gradients on parameters
   //# self.dweights = self.inputs.T @ dvalues
-  dweights_ = inputs_.transpose() * dvalues;
+  conform(dweights_, weights_.rows(), weights_.cols());
+  if (gemm_pool_) {
+    // dinputs is computed here too so it goes to its own buffer
+    conform(dinputs_, dvalues.rows(), weights_.rows());
+    backwardGemms(dvalues);
+  } else {
+    dweights_.noalias() = inputs_.transpose() * dvalues;
+  }
   // # self.dbiases = np.sum(dvalues, axis=0, keepdims=True)
+  conform(dbiases_, 1, biases_.cols());
   dbiases_ = dvalues.colwise().sum(); // .reshaped(1, dvalues.cols());
 
   if (sstout_.getVerboseLevel() > 2) {
@@ -374,40 +546,48 @@ void NNDenseLayer::backward(const payload_t& in, payload_t& o)
   // L1 on weights
   if (weight_regularizer_l1_ > 0) {
     //# dL1 = np.ones_like(self.weights)
-    Eigen::MatrixXd dL1 = Eigen::MatrixXd::Ones(weights_.rows(), weights_.cols());
     //# dL1[self.weights < 0] = -1
-    dL1 = (weights_.array() < 0).select(-1, dL1.array());
     //# self.dweights += self.weight_regularizer_l1 * dL1
-    dweights_ = dweights_.array() + weight_regularizer_l1_ * dL1.array();
+    const nn_scalar_t l1 = static_cast<nn_scalar_t>(weight_regularizer_l1_);
+    dweights_.array() += (weights_.array() < 0).select(
+      ArrayXXs::Constant(weights_.rows(), weights_.cols(), -l1), l1);
 
     if (sstout_.getVerboseLevel() > 2) {
-      std::cout << "dL1=\n" << HEAD(dL1.array()) << std::endl;
       std::cout << "dweights(l1)=\n" << HEAD(dweights_.array()) << std::endl;
     }
   }
   // L2 on weights
   if (weight_regularizer_l2_ > 0) {
     //# self.dweights += 2 * self.weight_regularizer_l2 * self.weights
-    dweights_ += 2 * weight_regularizer_l2_ * weights_;
+    dweights_ += static_cast<nn_scalar_t>(2 * weight_regularizer_l2_) * weights_;
   }
   // L1 on biases
   if (bias_regularizer_l1_ > 0) {
     //# dL1 = np.ones_like(self.biases)
-    Eigen::MatrixXd dL1 = Eigen::MatrixXd::Ones(biases_.rows(), biases_.cols());
     //# dL1[self.biases < 0] = -1
-    dL1 = (biases_.array() < 0).select(-1, dL1.array());
     //# self.dbiases += self.bias_regularizer_l1 * dL1
-    dbiases_ += bias_regularizer_l1_ * dL1;
+    const nn_scalar_t l1 = static_cast<nn_scalar_t>(bias_regularizer_l1_);
+    dbiases_.array() += (biases_.array() < 0).select(
+      ArrayXXs::Constant(biases_.rows(), biases_.cols(), -l1), l1);
   }
   // L2 on biases
   if (bias_regularizer_l2_ > 0) {
     //# self.dbiases += 2 * self.bias_regularizer_l2 * self.biases
-    dbiases_ += 2.0 * bias_regularizer_l2_ * biases_;
+    dbiases_ += static_cast<nn_scalar_t>(2.0 * bias_regularizer_l2_) * biases_;
   }
 
   // Gradient on values
+  // The forward inputs are no longer needed so their buffer takes the result
   //# self.dinputs = dvalues @ self.weights.T
-  dinputs_ = dvalues * weights_.transpose();
+  if (gemm_pool_) {
+    // Already computed with dweights. The inputs buffer is next time's dinputs_.
+    o.data.swap(dinputs_);
+    dinputs_.swap(inputs_);
+  } else {
+    o.data.swap(inputs_);
+    conform(o.data, dvalues.rows(), weights_.rows());
+    o.data.noalias() = dvalues * weights_.transpose();
+  }
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "weights=\n"  << HEAD(weights_.array())  << std::endl;
@@ -421,141 +601,206 @@ void NNDenseLayer::backward(const payload_t& in, payload_t& o)
     std::cout << "################################" << std::endl;
   }
 
+  // Incoming gradient buffer becomes the next forward pass output
+  outputs_.swap(in.data);
+
   // complete payload
-  o.data = dinputs_;
-  o.copyWithNoData(in);
+  o.copyWithNoData(std::move(in));
 }
 
 void NNDenseLayer::enable_weight_cache() {
-    weight_momentums_ = Eigen::MatrixXd::Zero(weights_.rows(), weights_.cols());
-    weight_cache_ = Eigen::MatrixXd::Zero(weights_.rows(), weights_.cols());
-    bias_momentums_ = Eigen::RowVectorXd::Zero(biases_.rows(), biases_.cols());
-    bias_cache_ = Eigen::RowVectorXd::Zero(biases_.rows(), biases_.cols());
+    weight_momentums_ = MatrixXo::Zero(weights_.rows(), weights_.cols());
+    weight_cache_ = MatrixXo::Zero(weights_.rows(), weights_.cols());
+    bias_momentums_ = RowVectorXo::Zero(biases_.rows(), biases_.cols());
+    bias_cache_ = RowVectorXo::Zero(biases_.rows(), biases_.cols());
     has_weight_cache_ = true;
 }
 
+pass_work_t NNDenseLayer::work(bool backward, uint64_t rows, uint64_t cols) const
+{
+  const uint64_t n = n_inputs_, m = n_neurons_;
+  const uint64_t s = sizeof(nn_scalar_t);
+  // forward: X*W + b.  backward: X^T*dvalues, dvalues*W^T and column sums
+  if (!backward)
+    return { rows * n * m, s * (rows * n + n * m + m + rows * m) };
+  return { 2 * rows * n * m, s * (rows * m + rows * n + 2 * n * m + m + rows * n) };
+}
+
 void NNDenseLayer::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   NNSubComponentAPI::serialize_order(ser);
   SST_SER(n_inputs_);
   SST_SER(n_neurons_);
-  // SST_SER(initial_weight_scaling);
-  // SST_SER(weight_regularizer_l1_);
-  // SST_SER(weight_regularizer_l2_);
-  // SST_SER(bias_regularizer_l1_);
-  // SST_SER(bias_regularizer_l2_);
-  // SST_SER(weight_momentums_);
-  // SST_SER(weight_cache_);
-  // SST_SER(bias_momentums_);
-  // SST_SER(bias_cache_);
-  // SST_SER(predictions_);
-  // SST_SER(has_weight_cache_);
-  // SST_SER(dweights_ = {};
-  // SST_SER(dbiases_ = {};
-
-  // Weights and Biases need special handling
-
-  double w, b;
-
-  switch (ser.mode() ) {
-  case SST::Core::Serialization::serializer::SIZER:
-  case SST::Core::Serialization::serializer::PACK:
-  {
-    assert(weights_.rows() == n_inputs_);
-    assert(weights_.cols() == n_neurons_);
-    assert(biases_.cols() == n_neurons_);
-
-    // get the object size during SIZER, serialize during PACK
-    for (unsigned r=0; r<n_inputs_; r++) {
-      for (unsigned c=0; c<n_neurons_; c++) {
-        w = weights_(r,c);
-        SST_SER(w);
-      }
-    }
-    for (unsigned c=0; c<n_neurons_; c++) {
-      b = biases_(c);
-      SST_SER(b);
-    }
-    break;
-  }
-  case SST::Core::Serialization::serializer::UNPACK:
-  {   
-    // Extract from the stream and reinitialize values
-    weights_.resize(n_inputs_, n_neurons_);
-    for (unsigned r=0; r<n_inputs_; r++) {
-      for (unsigned c=0; c<n_neurons_; c++) {
-        SST_SER(w);
-        weights_(r,c) = w;
-      }
-    }
-    biases_.resize(n_neurons_);
-    for (unsigned c=0; c<n_neurons_; c++) {
-      SST_SER(b);
-      biases_(c) = b;
-    }
-    break;
-  }
-  case SST::Core::Serialization::serializer::MAP:
-  {
-      // Not currently debugging weights
-      break;
+  SST_SER(initial_weight_scaling);
+  SST_SER(gemm_threads_);
+  if (ser.mode() == SST::Core::Serialization::serializer::UNPACK && gemm_threads_ > 1)
+    gemm_pool_ = std::make_unique<ThreadPool>(gemm_threads_);
+  SST_SER(weight_regularizer_l1_);
+  SST_SER(weight_regularizer_l2_);
+  SST_SER(bias_regularizer_l1_);
+  SST_SER(bias_regularizer_l2_);
+  // optimizer state
+  SST_SER(has_weight_cache_);
+  SST_SER(weight_momentums_);
+  SST_SER(weight_cache_);
+  SST_SER(bias_momentums_);
+  SST_SER(bias_cache_);
+  // Weights and Biases
+  SST_SER(weights_);
+  SST_SER(biases_);
+  // dweights_ and dbiases_ are rewritten by every backward pass
+  // before the optimizer reads them
+}
+
+//
+// Dense Layer with fused ReLU
+//
+void NNDenseReLULayer::forward(payload_t&& in, payload_t& o)
+{
+  // save for back propagation by taking over the input buffer
+  inputs_.swap(in.data);
+  o.data.swap(outputs_);
+  conform(o.data, inputs_.rows(), weights_.cols());
+  conform(active_, inputs_.rows(), weights_.cols());
+  forwardGemm(o.data);
+
+  // Bias, activation and mask in one pass over the GEMM output
+  //# self.output = np.maximum(0, inputs @ weights + biases)
+  Kernels::bias_relu(o.data.data(), o.data.rows(), o.data.cols(), biases_.data(), active_.words());
+
+  if (sstout_.getVerboseLevel() > 2) {
+    std::cout << "### Layer_DenseReLU.forward ###"  << std::endl;
+    std::cout << std::fixed << std::setprecision(7);
+    std::cout << "inputs"  << util_.shapestr(inputs_)  << "=\n" << HEAD(inputs_)  << std::endl;
+    std::cout << "weights" << util_.shapestr(weights_) << "=\n" << HEAD(weights_) << std::endl;
+    std::cout << "biases"  << util_.shapestr(biases_)  << "=\n" << HEAD(biases_)  << std::endl;
+    std::cout << "output"  << util_.shapestr(o.data)  << "=\n" << HEAD(o.data)  << std::endl;
   }
-  } //switch (ser.mode())
 
+  // Complete payload
+  o.copyWithNoData(std::move(in));
+  sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
+}
+
+void NNDenseReLULayer::backward(payload_t&& in, payload_t& o)
+{
+  // ReLU gradient in place, then the dense layer gradients
+  //# self.dinputs[self.inputs <= 0] = 0
+  active_.apply(in.data);
+  NNDenseLayer::backward(std::move(in), o);
+}
+
+void NNDenseReLULayer::stash(uint64_t batch_id)
+{
+  NNDenseLayer::stash(batch_id);
+  assert(stashedActive_.count(batch_id) == 0);
+  std::swap(stashedActive_[batch_id], active_);
+}
+
+void NNDenseReLULayer::unstash(uint64_t batch_id)
+{
+  NNDenseLayer::unstash(batch_id);
+  auto it = stashedActive_.find(batch_id);
+  assert(it != stashedActive_.end());
+  std::swap(active_, it->second);
+  stashedActive_.erase(it);
+}
+
+pass_work_t NNDenseReLULayer::work(bool backward, uint64_t rows, uint64_t cols) const
+{
+  // The activation only adds its mask to the dense layer traffic
+  pass_work_t w = NNDenseLayer::work(backward, rows, cols);
+  w.bytes += rows * static_cast<uint64_t>(n_neurons_) / 8;
+  return w;
+}
 
+void NNDenseReLULayer::serialize_order(SST::Core::Serialization::serializer &ser)
+{
+  NNDenseLayer::serialize_order(ser);
+  // The activation masks are held until the matching backward pass
+  SST_SER(active_);
+  SST_SER(stashedActive_);
 }
 
 // 
 // ReLU Activation Layer
 // 
-void NNActivationReLULayer::forward(const payload_t& in, payload_t& o)
+void NNActivationReLULayer::forward(payload_t&& in, payload_t& o)
 {
-  // save for backpropagation
-  inputs_ = in.data;
-  // Calculation output values from input
-  //# self.output = np.maximum(0,inputs)
-  o.data = in.data.cwiseMax(0.0);
-
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "### ReLU.forward ###" << std::endl;
     std::cout << "inputs=\n" << HEAD(in.data) << std::endl;
+  }
+
+  // Calculate output values in place over the input buffer. Only a bit
+  // per element is kept for backpropagation.
+  //# self.output = np.maximum(0,inputs)
+  o.data.swap(in.data);
+  const size_t words = active_.bytes();
+  active_.relu(o.data);
+  if (active_.bytes() != words) allocations_++;
+
+  if (sstout_.getVerboseLevel() > 2) {
     std::cout << "output=\n" << HEAD(o.data) << std::endl;
     std::cout << "################################" << std::endl;
   }
 
   // complete payload
-  o.copyWithNoData(in);
+  o.copyWithNoData(std::move(in));
   sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
 }
 
-void NNActivationReLULayer::backward(const payload_t& in, payload_t& o)
+void NNActivationReLULayer::backward(payload_t&& in, payload_t& o)
 {
-  // Internal copy
-  dinputs_ = in.data;
+  // Gradient is computed in place over the incoming buffer
+  o.data.swap(in.data);
+
+  if (sstout_.getVerboseLevel() > 2) {
+    std::cout << "### ReLU.backward ###" << std::endl;
+    std::cout << std::scientific << std::setprecision(7)
+      << "dvalues=\n"  << HEAD(o.data) << std::endl;
+  }
+
   // Zero gradient where input values were negative
   //# self.dinputs[self.inputs <= 0] = 0
-  Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic> mask = (inputs_.array() <= 0).cast<bool>();
-  Eigen::MatrixXd zeros(inputs_.rows(), inputs_.cols());
-  zeros.setZero();
-  dinputs_ = mask.select(zeros.array(), dinputs_);
+  active_.apply(o.data);
 
   if (sstout_.getVerboseLevel() > 2) {
-    std::cout << "### ReLU.backward ###" << std::endl;
     std::cout << std::scientific << std::setprecision(7)
-      << "inputs=\n"  << HEAD(inputs_)
-      << "\ndvalues=\n"  << HEAD(in.data)
-      << "\ndinputs=\n" << HEAD(dinputs_)
+      << "dinputs=\n" << HEAD(o.data)
       << "\n################################" << std::endl;
   }
 
   // Complete payload
-  o.data = dinputs_;
-  o.copyWithNoData(in);
+  o.copyWithNoData(std::move(in));
+}
+
+void NNActivationReLULayer::stash(uint64_t batch_id)
+{
+  assert(stashedActive_.count(batch_id) == 0);
+  std::swap(stashedActive_[batch_id], active_);
+}
+
+void NNActivationReLULayer::unstash(uint64_t batch_id)
+{
+  auto it = stashedActive_.find(batch_id);
+  assert(it != stashedActive_.end());
+  std::swap(active_, it->second);
+  stashedActive_.erase(it);
+}
+
+pass_work_t NNActivationReLULayer::work(bool backward, uint64_t rows, uint64_t cols) const
+{
+  // elementwise plus the activation mask
+  return { 0, 2 * rows * cols * sizeof(nn_scalar_t) + rows * cols / 8 };
 }
 
 void NNActivationReLULayer::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   NNSubComponentAPI::serialize_order(ser);
+  // The activation masks are held until the matching backward pass
+  SST_SER(active_);
+  SST_SER(stashedActive_);
 }
 
 // 
@@ -573,51 +818,61 @@ NNActivationSoftmaxLayer::NNActivationSoftmaxLayer(ComponentId_t id, Params& par
   assert(loss_type_==LOSS_TYPE::CATEGORICAL_CROSS_ENTROPY);
 };
 
-void NNActivationSoftmaxLayer::forward(const payload_t& in, payload_t& o)
+void NNActivationSoftmaxLayer::forward(payload_t&& in, payload_t& o)
 {
 
   // Remember input values
-  inputs_ = in.data;
+  inputs_.swap(in.data);
+
+  // Row reductions live in the workspace, exp_values and probabilities
+  // are computed in place in the output buffer
+  layoutWorkspace({{inputs_.rows(), 1}, {inputs_.rows(), 1}});
+  auto row_max = workspace_.slot(0).col(0);
+  auto row_sum = workspace_.slot(1).col(0);
+  o.data.swap(outputs_);
+  conform(o.data, inputs_.rows(), inputs_.cols());
 
   // Get unnormalized probabilities
   //# exp_values = np.exp(inputs - np.max(inputs, axis=1, keepdims=True))
-  Eigen::VectorXd row_max = (in.data.rowwise().maxCoeff()).reshaped(in.data.rows(),1); 
-  Eigen::MatrixXd exp_values = (in.data.colwise() - row_max).array().exp();
-
-  // Normalize them for each sample
-  //# probabilities = exp_values / np.sum(exp_values, axis=1, keepdims=True)
-  Eigen::VectorXd row_sum = (exp_values.rowwise().sum()).reshaped(exp_values.rows(), 1);
-  Eigen::MatrixXd probabilities = exp_values.array().colwise() / row_sum.array();
-
-  // Save result
-  o.data = probabilities;
+  row_max = inputs_.rowwise().maxCoeff();
+  o.data = (inputs_.colwise() - row_max).array().exp();
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "### Softmax.forward ###" << std::endl;
     std::cout << std::fixed << std::setprecision(7);
     std::cout << "inputs=\n" << HEAD(inputs_) << std::endl;
     // std::cout << "rowmax=\n" << HEAD(row_max) << std::endl;
-    std::cout << "exp_values=\n" << HEAD(exp_values) << std::endl;
+    std::cout << "exp_values=\n" << HEAD(o.data) << std::endl;
+  }
+
+  // Normalize them for each sample
+  //# probabilities = exp_values / np.sum(exp_values, axis=1, keepdims=True)
+  // (reshaped keeps the per-row summation order of the original code)
+  row_sum = o.data.rowwise().sum().reshaped(inputs_.rows(), 1);
+  o.data.array().colwise() /= row_sum.array();
+
+  if (sstout_.getVerboseLevel() > 2) {
     // std::cout << "row_sum=\n" << HEAD(row_sum) << std::endl;
     std::cout << "output=\n" << HEAD(o.data) << std::endl;
     std::cout << "################################" << std::endl;
   }
 
   // Complete payload
-  o.copyWithNoData(in);
+  o.copyWithNoData(std::move(in));
   sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
 }
 
-void NNActivationSoftmaxLayer::backward(const payload_t& in, payload_t& o)
+void NNActivationSoftmaxLayer::backward(payload_t&& in, payload_t& o)
 {
   assert(loss_type_==LOSS_TYPE::CATEGORICAL_CROSS_ENTROPY);
   // Using optimized combined loss and software backward pass function
 
-  Eigen::MatrixXd dvalues = in.data; // TODO remove these deep copies.
-  Eigen::MatrixXi y_true = in.classes;
+  // The incoming probabilities are modified in place
+  o.data.swap(in.data);
+  const Eigen::MatrixXi& y_true = in.classes;
 
   // Number of samples
-  auto samples = dvalues.rows();
+  auto samples = o.data.rows();
 
   // If labels are one-hot encoded, turn them into discrete values
   if (!ISVECTOR(y_true)){
@@ -625,23 +880,29 @@ void NNActivationSoftmaxLayer::backward(const payload_t& in, payload_t& o)
       assert(false);
   }
 
-  // Copy so we can safely modify
-  dinputs_ = dvalues; // Eigen default deep copy
   // Calculate gradient
   // # self.dinputs[range(samples), y_true] -= 1
   for (int i = 0; i < samples; i++)
   {
-      double v = dinputs_(i, y_true(i));
-      dinputs_(i, y_true(i)) = v - 1;
+      nn_scalar_t v = o.data(i, y_true(i));
+      o.data(i, y_true(i)) = v - 1;
   }
 
   // Normalize gradient
   // # self.dinputs = self.dinputs / samples
-  dinputs_ = dinputs_.array() / samples;
+  o.data.array() /= static_cast<nn_scalar_t>(samples);
+
+  // Forward inputs are no longer needed. Recycle for the next forward output.
+  outputs_.swap(inputs_);
 
   // Complete payload
-  o.data = dinputs_;
-  o.copyWithNoData(in);
+  o.copyWithNoData(std::move(in));
+}
+
+pass_work_t NNActivationSoftmaxLayer::work(bool backward, uint64_t rows, uint64_t cols) const
+{
+  // forward counts one op per exponential, backward is elementwise
+  return { backward ? 0 : rows * cols, 2 * rows * cols * sizeof(nn_scalar_t) };
 }
 
 void NNActivationSoftmaxLayer::serialize_order(SST::Core::Serialization::serializer &ser)
@@ -662,17 +923,17 @@ NNLossLayerAPI::NNLossLayerAPI(ComponentId_t id, Params &params) : NNSubComponen
   prediction_type_ = static_cast<ACTIVATION_TYPE>(prediction_type);
 }
 
-const Losses& NNLossLayerAPI::calculate(Eigen::MatrixXd& sample_losses, REGULARIZATION include_regularization)
+const Losses& NNLossLayerAPI::calculate(MatrixXs& sample_losses, REGULARIZATION include_regularization)
 {
 
   // Calculate the sample losses (called by parent)
   // Eigen::MatrixXd sample_losses = forward(output, y, debug);
 
   // Calculate the mean loss
-  double data_loss = sample_losses.mean();
+  double data_loss = static_cast<double>(sample_losses.mean());
 
   // Add accumulated sum of losses and sample count
-  accumulated_sum_ += sample_losses.sum();
+  accumulated_sum_ += static_cast<double>(sample_losses.sum());
   accumulated_count_ += (int) sample_losses.rows();
 
   if (sstout_.getVerboseLevel() > 2) {
@@ -702,7 +963,7 @@ const Losses& NNLossLayerAPI::calculated_accumulated(REGULARIZATION include_regu
   return losses_;
 }
 
-const Eigen::MatrixXd &NNLossLayerAPI::predictions(const Eigen::MatrixXd &outputs)
+const MatrixXs &NNLossLayerAPI::predictions(const MatrixXs &outputs)
 {
   assert(prediction_type_ == ACTIVATION_TYPE::SOFTMAX);
   util_.argmax(predictions_, outputs);
@@ -713,10 +974,10 @@ void NNLossLayerAPI::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   NNSubComponentAPI::serialize_order(ser);
   SST_SER(prediction_type_);
-  // SST_SER(accumulated_losses_);
-  // SST_SER(predictions);
-  // SST_SER(accumulated_sum_);
-  // SST_SER(accumulated_count_);
+  SST_SER(losses_.data_loss);
+  SST_SER(losses_.regularization_loss);
+  SST_SER(accumulated_sum_);
+  SST_SER(accumulated_count_);
 }
 
 // 
@@ -724,22 +985,16 @@ void NNLossLayerAPI::serialize_order(SST::Core::Serialization::serializer &ser)
 // 
 void NNLoss_CategoricalCrossEntropy::forward(const payload_t& in, payload_t& o)
 {
-  // TODO remove these deep copies
-  Eigen::MatrixXd y_pred = in.data;
-  Eigen::MatrixXi y_true = in.classes;
+  const MatrixXs& y_pred = in.data;
+  const Eigen::MatrixXi& y_true = in.classes;
 
   // Number of samples in a batch
   auto samples = y_pred.rows();
   // std::cout << "y_pred=\n" << HEAD(y_pred) << std::endl;
 
-  // Clip data to prevent division by 0
-  // Clip both sides to not drag mean towards any value
-  //# y_pred_clipped = np.clip(y_pred, 1e-7, 1 - 1e-7)
-  Eigen::MatrixXd y_pred_clipped = CLIP(y_pred.array(), 1e-7, 1-1e-7);
-  // std::cout << "y_pred_clipped=\n" << HEAD(y_pred_clipped) << std::endl;
-
   // Probabilities for target values
-  Eigen::MatrixXd correct_confidences(samples, 1);
+  layoutWorkspace({{samples, 1}});
+  auto correct_confidences = workspace_.slot(0);
   if (ISVECTOR(y_true)) {
       // only if categorical labels
       //# if len(y_true.shape) == 1:
@@ -747,9 +1002,15 @@ void NNLoss_CategoricalCrossEntropy::forward(const payload_t& in, payload_t& o)
       //#       range(samples),
       //#       y_true
       //#   ]   
+      // Clip data to prevent division by 0
+      // Clip both sides to not drag mean towards any value.
+      // Only the gathered values are needed so clip those.
+      //# y_pred_clipped = np.clip(y_pred, 1e-7, 1 - 1e-7)
+      const nn_scalar_t clip_min = static_cast<nn_scalar_t>(1e-7);
+      const nn_scalar_t clip_max = static_cast<nn_scalar_t>(1-1e-7);
       for (int i=0; i<samples;i++) {
         // std::cout << "y_true[" << i << "]=" << y_true[i] << std::endl;
-        correct_confidences(i,0) = y_pred_clipped(i,y_true(i,0));
+        correct_confidences(i,0) = std::min(std::max(y_pred(i,y_true(i,0)), clip_min), clip_max);
       }
   } else {
       // Mask values - only for one-hot encoded labels
@@ -762,24 +1023,23 @@ void NNLoss_CategoricalCrossEntropy::forward(const payload_t& in, payload_t& o)
   }
   // std::cout << "correct_confidences=\n" << HEAD(correct_confidences) << std::endl;
 
-  // Losses
+  // Losses (sample_losses)
   //# negative_log_likelihoods = -np.log(correct_confidences)
-  negative_log_likelihoods_ = -correct_confidences.array().log();
+  conform(o.data, samples, 1);
+  o.data = -correct_confidences.array().log();
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "### Loss_CategoricalCrossentropy.forward ###" << std::endl;
     std::cout << "samples=" << samples << std::endl;
     std::cout << "y_pred=\n" << HEAD(y_pred) << std::endl;
-    std::cout << "y_pred_clipped=\n" << HEAD(y_pred) << std::endl;
     std::cout << "y_true=\n" << HEAD(y_true)  << std::endl;
     std::cout << "correct_confidences=\n" << HEAD(correct_confidences) << std::endl;
     // std::cout << "correct_confidences.size()=" << correct_confidences.size() << std::endl;
-    std::cout << "negative_log_likelihoods=\n" << HEAD(negative_log_likelihoods_) << std::endl;
+    std::cout << "negative_log_likelihoods=\n" << HEAD(o.data) << std::endl;
     std::cout << "################################" << std::endl;
   }
 
-  // output payload
-  o.data = negative_log_likelihoods_;  // sample_losses
+  // complete payload
   o.copyWithNoData(in);
   sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
 }
@@ -789,20 +1049,108 @@ void NNLoss_CategoricalCrossEntropy::backward(const payload_t& in, payload_t& o)
   o = in;
 }
 
+void NNLoss_CategoricalCrossEntropy::forward(payload_t&& in, payload_t& o)
+{
+  forward(static_cast<const payload_t&>(in), o);
+}
+
+void NNLoss_CategoricalCrossEntropy::backward(payload_t&& in, payload_t& o)
+{
+  o = std::move(in);
+}
+
 void NNLoss_CategoricalCrossEntropy::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   NNLossLayerAPI::serialize_order(ser);
-  // SST_SER(negative_log_likelihoods_);
+}
+
+//
+// NNLoss_SoftmaxCategoricalCrossEntropy
+//
+void NNLoss_SoftmaxCategoricalCrossEntropy::forward(const payload_t& in, payload_t& o)
+{
+  const MatrixXs& z = in.data;
+  const Eigen::MatrixXi& y_true = in.classes;
+  assert(ISVECTOR(y_true));
+  const Eigen::Index samples = z.rows();
+  const Eigen::Index classes = z.cols();
+  const bool training = (in.mode == MODE::TRAINING);
+
+  conform(o.data, samples, 1);
+  conform(predictions_, samples, 1);
+  if (training)
+    conform(dinputs_, samples, classes);
+
+  // log(softmax(z)) = z - max - log(sum(exp(z - max))), with the losses,
+  // predictions, accuracy and gradient from the same pass over the logits
+  //# negative_log_likelihoods = -np.log(correct_confidences)
+  //# self.dinputs[range(samples), y_true] -= 1
+  //# self.dinputs = self.dinputs / samples
+  const Eigen::Index correct = Kernels::softmax_cce(z, y_true, o.data, predictions_,
+                                                    training ? &dinputs_ : nullptr);
+  accuracy_ = static_cast<double>(correct) / static_cast<double>(samples);
+  fresh_ = true;
+
+  if (sstout_.getVerboseLevel() > 2) {
+    std::cout << "### Loss_SoftmaxCategoricalCrossentropy.forward ###" << std::endl;
+    std::cout << "samples=" << samples << std::endl;
+    std::cout << "logits=\n" << HEAD(z) << std::endl;
+    std::cout << "y_true=\n" << HEAD(y_true)  << std::endl;
+    std::cout << "negative_log_likelihoods=\n" << HEAD(o.data) << std::endl;
+    std::cout << "accuracy=" << accuracy_ << std::endl;
+    std::cout << "################################" << std::endl;
+  }
+
+  // complete payload
+  o.copyWithNoData(in);
+  sstout_.verbose(CALL_INFO, 5, 0, "%s %s\n", getName().c_str(), o.str().c_str());
+}
+
+const MatrixXs& NNLoss_SoftmaxCategoricalCrossEntropy::predictions(const MatrixXs& outputs)
+{
+  // Forward already found them for these logits. Evaluation has no
+  // forward pass so take the argmax of the logits here.
+  if (!fresh_)
+    util_.argmax(predictions_, outputs);
+  fresh_ = false;
+  return predictions_;
+}
+
+void NNLoss_SoftmaxCategoricalCrossEntropy::gradient(payload_t& p)
+{
+  // The logits buffer takes the next gradient
+  assert(dinputs_.rows() == p.data.rows() && dinputs_.cols() == p.data.cols());
+  p.data.swap(dinputs_);
+}
+
+void NNLoss_SoftmaxCategoricalCrossEntropy::backward(const payload_t& in, payload_t& o)
+{
+  o = in;
+}
+
+void NNLoss_SoftmaxCategoricalCrossEntropy::forward(payload_t&& in, payload_t& o)
+{
+  forward(static_cast<const payload_t&>(in), o);
+}
+
+void NNLoss_SoftmaxCategoricalCrossEntropy::backward(payload_t&& in, payload_t& o)
+{
+  o = std::move(in);
+}
+
+void NNLoss_SoftmaxCategoricalCrossEntropy::serialize_order(SST::Core::Serialization::serializer &ser)
+{
+  NNLossLayerAPI::serialize_order(ser);
 }
 
 // 
 // NNAccuracyAPI
 //
 
-double NNAccuracyAPI::calculate(const Eigen::MatrixXd& predictions, const Eigen::MatrixXi& y) {
+double NNAccuracyAPI::calculate(const MatrixXs& predictions, const Eigen::MatrixXi& y) {
   // Get comparison results
-  Eigen::MatrixXd yy = y.cast<double>();
-  Eigen::MatrixX<bool> comparisons = this->compare(predictions, yy);
+  labels_ = y.cast<nn_scalar_t>();
+  const Eigen::MatrixX<bool>& comparisons = this->compare(predictions, labels_);
   // Calculate an accuracy
   double accuracy = comparisons.array().cast<double>().mean();
   // Add accumulated sum of matching values and sample count
@@ -851,7 +1199,7 @@ NNAccuracyAPI::NNAccuracyAPI(ComponentId_t id, Params &params) : SubComponent(id
     Verbosity, 0, SST::Output::STDOUT );
 }
 
-Eigen::MatrixX<bool> &NNAccuracyCategorical::compare(const Eigen::MatrixXd &predictions, const Eigen::MatrixXd &y)
+Eigen::MatrixX<bool> &NNAccuracyCategorical::compare(const MatrixXs &predictions, const MatrixXs &y)
 {
   if (!binary_ && scalar_) {
     assert(false);
@@ -925,67 +1273,29 @@ void NNAdamOptimizer::update_params(NNDenseLayer *layer, const optimizer_data_t&
     std::cout << "bias_momentums(i)=\n" << HEAD(layer->bias_momentums_) << std::endl;
   }
 
-  // Update momentum  with current gradients
-  layer->weight_momentums_ = beta_1_ * layer->weight_momentums_.array()
-                  + ( 1. - beta_1_) * layer->dweights_.array();
-  layer->bias_momentums_ = beta_1_ * layer->bias_momentums_.array()
-                  + ( 1. - beta_1_) * layer->dbiases_.array();
-
-  if (sstout_.getVerboseLevel() > 2) {
-    std::cout << "weight_momentums(f)=\n" << HEAD(layer->weight_momentums_) << std::endl;
-    std::cout << "bias_momentums(f)=\n" << HEAD(layer->bias_momentums_) << std::endl;
-  }
-
-  // Get corrected momentum
-  // iteration is 0 at first pass and we need to start with 1 here
-  Eigen::MatrixXd weight_momentums_corrected = 
-      layer->weight_momentums_.array() / ( 1. - pow(beta_1_ ,(iterations_ + 1.)) );
-  Eigen::MatrixXd bias_momentums_corrected = 
-      layer->bias_momentums_.array() / ( 1. - pow(beta_1_ ,(iterations_ + 1.)) );
-
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "iterations=" << iterations_ << std::endl;
-    std::cout << "weight_momentums_corrected=\n" << HEAD(weight_momentums_corrected) << std::endl;
-    std::cout << "bias_momentums_corrected=\n" << HEAD(bias_momentums_corrected) << std::endl;
     std::cout << "beta_2=" << beta_2_ << std::endl;
     std::cout << "weight_cache(i)=\n" << HEAD(layer->weight_cache_) << std::endl;
     std::cout << "bias_cache(i)=\n" << HEAD(layer->bias_cache_) << std::endl;
+    std::cout << "current_learning_rate" << current_learning_rate_ << std::endl;
+    std::cout << "weights_(i)=\n" << HEAD(layer->weights_) << std::endl;
+    std::cout << "biases(i)=\n" << HEAD(layer->biases_) << std::endl; 
   }
 
-  // Update cache with squared current gradients
-  layer->weight_cache_ = beta_2_ * layer->weight_cache_.array() + 
-      (1 - beta_2_) * layer->dweights_.array().pow(2);
-  layer->bias_cache_ = beta_2_ * layer->bias_cache_.array() + 
-      (1 - beta_2_) * layer->dbiases_.array().pow(2);
+  // Momentum and cache update, bias correction, and the parameter step
+  // are fused into one pass over each parameter block.
+  // iteration is 0 at first pass and we need to start with 1 here
+  const Kernels::adam_step_t step(beta_1_, beta_2_, current_learning_rate_, epsilon_, iterations_);
+  Kernels::adam_update(layer->weights_, layer->weight_momentums_, layer->weight_cache_, layer->dweights_, step);
+  Kernels::adam_update(layer->biases_, layer->bias_momentums_, layer->bias_cache_, layer->dbiases_, step);
 
   if (sstout_.getVerboseLevel() > 2) {
+    std::cout << "weight_momentums(f)=\n" << HEAD(layer->weight_momentums_) << std::endl;
+    std::cout << "bias_momentums(f)=\n" << HEAD(layer->bias_momentums_) << std::endl;
     std::cout << "weight_cache(f)=\n" << HEAD(layer->weight_cache_) << std::endl;
     std::cout << "bias_cache(f)=\n" << HEAD(layer->bias_cache_) << std::endl; 
-  }  
-
-  // Get correct cache
-  Eigen::MatrixXd weight_cache_corrected = layer->weight_cache_ /
-          (1 - pow(beta_2_, (iterations_ + 1)));
-  Eigen::MatrixXd bias_cache_corrected = layer->bias_cache_ /
-          (1 - pow(beta_2_, (iterations_ + 1)));
-
-  if (sstout_.getVerboseLevel() > 2) {
-    std::cout << "weight_cache_corrected=\n" << HEAD(weight_cache_corrected) << std::endl;
-    std::cout << "bias_cache_corrected=\n" << HEAD(bias_cache_corrected) << std::endl;   
-    std::cout << "current_learning_rate" << current_learning_rate_ << std::endl;
-    std::cout << "weights_(i)=\n" << HEAD(layer->weights_) << std::endl;
-    std::cout << "biases(i)=\n" << HEAD(layer->biases_) << std::endl; 
-  }  
-
-  // Vanilla SGD parameter update + normalization
-  // with square rooted cache
-  layer->weights_ = layer->weights_.array() - current_learning_rate_ *
-                      weight_momentums_corrected.array() /
-                      (weight_cache_corrected.array().sqrt() + epsilon_);
-  layer->biases_ = layer->biases_.array() - current_learning_rate_ *
-                      bias_momentums_corrected.array() /
-                      (bias_cache_corrected.array().sqrt()+
-                      epsilon_);
+  }
 
   if (sstout_.getVerboseLevel() > 2) {
     std::cout << "weights_(f)=\n" << HEAD(layer->weights_) << std::endl;
@@ -994,6 +1304,25 @@ void NNAdamOptimizer::update_params(NNDenseLayer *layer, const optimizer_data_t&
 
 }
 
+void NNOptimizerAPI::step(NNSubComponentAPI* layer, optimizer_data_t& opt)
+{
+  if (opt.optimizerState == OPTIMIZER_STATE::PRE_UPDATE) {
+    // update the current learning rate
+    pre_update_params();
+    // pass the hyperparameters to previous layer
+    opt = {
+      OPTIMIZER_STATE::ACTIVE,
+      learning_rate(),
+      current_learning_rate(),
+      iterations() };
+    // Keep track of iterations
+    post_update_params();
+  } else {
+    assert(opt.optimizerState == OPTIMIZER_STATE::ACTIVE);
+    update_params(static_cast<NNDenseLayer*>(layer), opt);
+  }
+}
+
 void NNOptimizerAPI::serialize_order(SST::Core::Serialization::serializer &ser)
 {
   SubComponent::serialize_order(ser);
@@ -1018,4 +1347,22 @@ void NNAdamOptimizer::serialize_order(SST::Core::Serialization::serializer &ser)
 
 } // namespace SST::NNLayer
 
+namespace SST::Core::Serialization {
+
+void serialize_impl<SST::NeuralNet::NNBitMask>::operator()(
+  SST::NeuralNet::NNBitMask& m, serializer& ser, ser_opt_t options)
+{
+  if (ser.mode() == serializer::MAP)
+    return;
+  int64_t rows = m.rows();
+  int64_t cols = m.cols();
+  SST_SER(rows);
+  SST_SER(cols);
+  if (ser.mode() == serializer::UNPACK)
+    m.resize(rows, cols);
+  ser.raw(m.words(), m.bytes());
+}
+
+} // namespace SST::Core::Serialization
+
 // EOF
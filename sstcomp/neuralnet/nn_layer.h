@@ -13,6 +13,7 @@
 
 // clang-format off
 #include <map>
+#include <memory>
 #include <queue>
 #include <random>
 #include <stdio.h>
@@ -21,9 +22,20 @@
 #include <vector>
 
 #include "nn_layer_base.h"
+#include "nn_bitmask.h"
 #include "nn_event.h"
+#include "thread_pool.h"
 // clang-format on
 
+namespace SST::Core::Serialization {
+// Activation masks are held between the forward and backward passes
+template<>
+class serialize_impl<SST::NeuralNet::NNBitMask> {
+public:
+  void operator()(SST::NeuralNet::NNBitMask& m, serializer& ser, ser_opt_t options);
+};
+} //namespace SST::Core::Serialization
+
 namespace SST::NeuralNet{
 
 // -------------------------------------------------------
@@ -52,39 +64,83 @@ public:
                               "NNLayer SST Component",
                               COMPONENT_CATEGORY_UNCATEGORIZED )
 
+  SST_ELI_DOCUMENT_PARAMS(
+    {"clockFreq",      "Clock that runs the passes when not event driven", "1GHz"},
+    {"computeLatency", "Simulated time from a batch arriving to its pass output when event driven", "1ns"},
+    {"eventDriven",    "Run passes from a self-link event instead of reregistering the clock", "0"},
+    {"layerOverhead",  "Device model: fixed time added to every pass", "0ns"},
+    {"memBandwidth",   "Device model: memory bandwidth in bytes/s. 0 leaves memory traffic out", "0"},
+    {"peakFlops",      "Device model: peak FLOP/s. 0 turns the latency model off", "0"}
+  )
+  SST_ELI_DOCUMENT_STATISTICS(
+    {"forward_macs",  "Multiply-accumulates of each forward pass",  "MACs",  1},
+    {"backward_macs", "Multiply-accumulates of each backward pass", "MACs",  1},
+    {"bytes_moved",   "Memory traffic of each pass",                "bytes", 1},
+    {"busy_time",     "Modeled device time of each pass",           "ps",    1}
+  )
+
 private:
 
   // event handling
   std::map<SST::NeuralNet::PortTypes,SST::Link*> linkHandlers = {};
   void forward_i_snd() { assert(false); }
   void forward_i_rcv(SST::Event *ev);
-  void forward_o_snd();
+  void forward_o_snd(SimTime_t delay);
   void forward_o_rcv(SST::Event *ev) { assert(false);}
   void backward_i_snd() { assert(false); }
   void backward_i_rcv(SST::Event *ev);
-  void backward_o_snd();
+  void backward_o_snd(SimTime_t delay);
   void backward_o_rcv(SST::Event *ev) { assert(false); }
   void monitorEvent(SST::Event *ev) { assert(false); }
+  void compute_rcv(SST::Event *ev);
   void monitor_rcv(SST::Event *ev) {assert(false); };
-  void monitor_snd();
+  void monitor_snd(SimTime_t delay);
 
-  // port transfer functions
-  payload_t forwardData_i = {};
+  // port transfer functions. Inputs are queued by batch id while
+  // several batches are in flight.
+  std::map<uint64_t, payload_t> forwardData_i = {};
   payload_t forwardData_o = {};
-  payload_t backwardData_i = {};
+  std::map<uint64_t, payload_t> backwardData_i = {};
   payload_t backwardData_o = {};
   payload_t monitorData_o = {};
 
+  // per batch work ( call from clocktick )
+  void forwardPass(payload_t&& in);
+  void monitorPass(payload_t&& in);  // last layer, includes the backward pass when training
+  void backwardPass(payload_t&& in);
+  bool runPasses();   // returns true while batches are still waiting
+
+  // Device latency model. Passes run one after another on the device and
+  // each output leaves when its pass is done.
+  double peak_flops_ = 0;
+  double mem_bandwidth_ = 0;
+  SimTime_t layer_overhead_ = 0;   // ps
+  SimTime_t busy_until_ = 0;       // ps
+  // Record a pass and return how long its output is held back (ps)
+  SimTime_t passDelay(bool backward, const pass_work_t& w);
+  Statistic<uint64_t>* statForwardMacs_ = nullptr;
+  Statistic<uint64_t>* statBackwardMacs_ = nullptr;
+  Statistic<uint64_t>* statBytes_ = nullptr;
+  Statistic<uint64_t>* statBusyTime_ = nullptr;
+
   // -- SST handlers
   SST::Output    sstout_; 
   TimeConverter timeConverter_;
-  SST::Clock::HandlerBase* clockHandler_;
+  SST::Clock::HandlerBase* clockHandler_ = nullptr;
+  SST::Link* computeLink_ = nullptr;   // self-link for event driven passes
 
   // internals
   bool lastComponent_ = false;
-  bool driveForwardPass_ = false;
-  bool driveBackwardPass_ = false;
-  bool driveMonitor_ = false;
+  bool eventDriven_ = false;
+  bool clockEnabled_ = false;
+  bool computePending_ = false;
+  void wake();
+  payload_t sampleLosses_ = {};
+
+  // transfer function buffer allocations during training
+  uint64_t trainingSteps_ = 0;
+  uint64_t firstStepAllocations_ = 0;
+  uint64_t trainingAllocations_ = 0;
 
 public:
   // -------------------------------------------------------
@@ -113,8 +169,12 @@ public:
         SST::NeuralNet::NNSubComponentAPI) // Fully qualified API name
   NNInputLayer(ComponentId_t id, Params& params) : NNSubComponentAPI(id,params) {};
   ~NNInputLayer() {};
-  virtual void forward(const payload_t& in, payload_t& o) final;
-  virtual void backward(const payload_t& in, payload_t& o) final;
+  using NNSubComponentAPI::forward;
+  using NNSubComponentAPI::backward;
+  virtual void forward(payload_t&& in, payload_t& o) final;
+  virtual void backward(payload_t&& in, payload_t& o) final;
+  bool acceptsView() const final { return true; }
+  pass_work_t work(bool backward, uint64_t rows, uint64_t cols) const final { return {}; }
 
 public:
   // -------------------------------------------------------
@@ -145,6 +205,7 @@ public:
   SST_ELI_DOCUMENT_PARAMS(
     {"biasRegularizerL1",    "L1 optimizer for biases",  "0" },
     {"biasRegularizerL2",    "L2 optimizer for biases",  "0" },
+    {"gemmThreads",          "threads for the matrix products, including the simulation thread. Keep SST threads x gemmThreads within the core count", "1" },
     {"initialWeightScaling", "scaling factor for random weights", "0.1"},
     {"nInputs",              "number of inputs",    "4" },
     {"nNeurons",             "number of neurons",   "128" },
@@ -154,32 +215,44 @@ public:
 
   NNDenseLayer(ComponentId_t id, Params& params);
   ~NNDenseLayer() {};
-  virtual void forward(const payload_t& in, payload_t& o) final;
-  virtual void backward(const payload_t& in, payload_t& o) final;
+  using NNSubComponentAPI::forward;
+  using NNSubComponentAPI::backward;
+  virtual void forward(payload_t&& in, payload_t& o) override;
+  virtual void backward(payload_t&& in, payload_t& o) override;
+  pass_work_t work(bool backward, uint64_t rows, uint64_t cols) const override;
   void enable_weight_cache();
-private:
+protected:
   // Configuration
   unsigned n_inputs_ = 4;
   unsigned n_neurons_ = 128;
   double initial_weight_scaling = 0.1;
+  unsigned gemm_threads_ = 1;
+  // Intra-layer GEMM threads (gemm_threads_>1). Rebuilt on restart.
+  std::unique_ptr<ThreadPool> gemm_pool_ = {};
+  // dinputs buffer while inputs_ is still read by the concurrent dweights GEMM
+  MatrixXs dinputs_ = {};
+  // out = inputs_ * weights_, split by rows over the GEMM pool
+  void forwardGemm(MatrixXs& out);
+  // dweights_ = inputs_^T * dvalues and dinputs_ = dvalues * weights_^T together
+  void backwardGemms(const MatrixXs& dvalues);
   // regularization (trainable layers only)
   double weight_regularizer_l1_ = 0;
   double weight_regularizer_l2_ = 0;
   double bias_regularizer_l1_ = 0;
   double bias_regularizer_l2_ = 0;
   // optimizer support  
-  Eigen::MatrixXd weight_momentums_ = {};    // like weights
-  Eigen::MatrixXd weight_cache_ = {};        // like weights
-  Eigen::RowVectorXd bias_momentums_ = {};   // like biases
-  Eigen::RowVectorXd bias_cache_ = {};       // like biases
-  Eigen::MatrixXd predictions_ = {};
+  MatrixXo weight_momentums_ = {};    // like weights
+  MatrixXo weight_cache_ = {};        // like weights
+  RowVectorXo bias_momentums_ = {};   // like biases
+  RowVectorXo bias_cache_ = {};       // like biases
+  MatrixXs predictions_ = {};
   bool has_weight_cache_ = false;
   // derivatives
-  Eigen::MatrixXd dweights_ = {};
-  Eigen::RowVectorXd dbiases_ = {};
+  MatrixXs dweights_ = {};
+  RowVectorXs dbiases_ = {};
   // Weights and Biases
-  Eigen::MatrixXd weights_ = {};    // n_inputs x n_neurons
-  Eigen::RowVectorXd biases_ = {};  // n_neurons
+  MatrixXs weights_ = {};    // n_inputs x n_neurons
+  RowVectorXs biases_ = {};  // n_neurons
 
 public:
   // -------------------------------------------------------
@@ -194,6 +267,50 @@ public:
 
 }; //class NNDenseLayer
 
+// -------------------------------------------------------
+// NNDenseReLULayer
+// Dense layer with a fused ReLU activation. The GEMM output takes the
+// bias and activation in a single pass and only a bit mask of the
+// active outputs is kept for the backward pass. Replaces a
+// NNDenseLayer/NNActivationReLULayer component pair.
+// -------------------------------------------------------
+class NNDenseReLULayer : public NNDenseLayer {
+public:
+  SST_ELI_REGISTER_SUBCOMPONENT(
+    NNDenseReLULayer,   // Class name
+    "neuralnet",    // Library name
+    "NNDenseReLULayer",   // Subcomponent name
+    SST_ELI_ELEMENT_VERSION(1,0,0),    // A version number
+    "Neural network dense layer with fused ReLU activation.",     // Description
+    SST::NeuralNet::NNSubComponentAPI) // Fully qualified API name
+
+  NNDenseReLULayer(ComponentId_t id, Params& params) : NNDenseLayer(id, params) {};
+  ~NNDenseReLULayer() {};
+  using NNSubComponentAPI::forward;
+  using NNSubComponentAPI::backward;
+  virtual void forward(payload_t&& in, payload_t& o) final;
+  virtual void backward(payload_t&& in, payload_t& o) final;
+  pass_work_t work(bool backward, uint64_t rows, uint64_t cols) const final;
+  void stash(uint64_t batch_id) final;
+  void unstash(uint64_t batch_id) final;
+private:
+  // Set where the pre-activation output was positive
+  NNBitMask active_ = {};
+  std::map<uint64_t, NNBitMask> stashedActive_ = {};
+
+public:
+  // -------------------------------------------------------
+  // Serialization support
+  // -------------------------------------------------------
+  // Default constructor required for serialization
+  NNDenseReLULayer() : NNDenseLayer() {}
+  // Serialization function
+  void serialize_order(SST::Core::Serialization::serializer& ser) override;
+  // Serialization implementation
+  ImplementSerializable(SST::NeuralNet::NNDenseReLULayer)
+
+}; //class NNDenseReLULayer
+
 // -------------------------------------------------------
 // NNActivationReLULayer
 // -------------------------------------------------------
@@ -209,8 +326,18 @@ public:
 
   NNActivationReLULayer(ComponentId_t id, Params& params) : NNSubComponentAPI(id,params) {};
   ~NNActivationReLULayer() {};
-  virtual void forward(const payload_t& in, payload_t& o) final;
-  virtual void backward(const payload_t& in, payload_t& o) final;
+  using NNSubComponentAPI::forward;
+  using NNSubComponentAPI::backward;
+  virtual void forward(payload_t&& in, payload_t& o) final;
+  virtual void backward(payload_t&& in, payload_t& o) final;
+  pass_work_t work(bool backward, uint64_t rows, uint64_t cols) const final;
+  void stash(uint64_t batch_id) final;
+  void unstash(uint64_t batch_id) final;
+private:
+  // Set where the forward input was positive. Replaces keeping inputs_.
+  NNBitMask active_ = {};
+  std::map<uint64_t, NNBitMask> stashedActive_ = {};
+
 public:
   // -------------------------------------------------------
   // Serialization support
@@ -242,8 +369,11 @@ public:
 
   NNActivationSoftmaxLayer(ComponentId_t id, Params& params);
   ~NNActivationSoftmaxLayer() {};
-  virtual void forward(const payload_t& in, payload_t& o) final;
-  virtual void backward(const payload_t& in, payload_t& o) final;
+  using NNSubComponentAPI::forward;
+  using NNSubComponentAPI::backward;
+  virtual void forward(payload_t&& in, payload_t& o) final;
+  virtual void backward(payload_t&& in, payload_t& o) final;
+  pass_work_t work(bool backward, uint64_t rows, uint64_t cols) const final;
 
   LOSS_TYPE loss_type() { return loss_type_; }
 
@@ -279,8 +409,9 @@ public:
   ~NNLoss_CategoricalCrossEntropy() {};
   virtual void forward(const payload_t& in, payload_t& o) final;
   virtual void backward(const payload_t& in, payload_t& o) final;
-private:
-  Eigen::MatrixXd negative_log_likelihoods_ = {}; // TODO remove
+  // Loss functions only read their input
+  virtual void forward(payload_t&& in, payload_t& o) final;
+  virtual void backward(payload_t&& in, payload_t& o) final;
 public:
   // -------------------------------------------------------
   // Serialization support
@@ -293,6 +424,48 @@ public:
   ImplementSerializable(SST::NeuralNet::NNLoss_CategoricalCrossEntropy)
 }; //class NNLossLayer
 
+// -------------------------------------------------------
+// NNLoss_SoftmaxCategoricalCrossEntropy
+// Softmax activation and categorical cross-entropy in one kernel. Takes
+// the logits of the last dense layer and replaces a
+// NNActivationSoftmaxLayer/NNLoss_CategoricalCrossEntropy pair.
+// -------------------------------------------------------
+class NNLoss_SoftmaxCategoricalCrossEntropy : public NNLossLayerAPI {
+public:
+  SST_ELI_REGISTER_SUBCOMPONENT(
+        NNLoss_SoftmaxCategoricalCrossEntropy,    // Class name
+        "neuralnet",                              // Library name
+        "NNLoss_SoftmaxCategoricalCrossEntropy",  // Subcomponent name
+        SST_ELI_ELEMENT_VERSION(1,0,0),           // A version number
+        "Fused softmax activation and categorical cross-entropy loss.", // Description
+        SST::NeuralNet::NNLossLayerAPI)           // Fully qualified API name
+  NNLoss_SoftmaxCategoricalCrossEntropy(ComponentId_t id, Params& params) : NNLossLayerAPI(id,params) {};
+  ~NNLoss_SoftmaxCategoricalCrossEntropy() {};
+  virtual void forward(const payload_t& in, payload_t& o) final;
+  virtual void backward(const payload_t& in, payload_t& o) final;
+  virtual void forward(payload_t&& in, payload_t& o) final;
+  virtual void backward(payload_t&& in, payload_t& o) final;
+  const MatrixXs& predictions(const MatrixXs& outputs) final;
+  bool fused() const final { return true; }
+  double accuracy() const final { return accuracy_; }
+  void gradient(payload_t& p) final;
+private:
+  // Per-batch results of the last forward pass, not serialized
+  MatrixXs dinputs_ = {};
+  double accuracy_ = 0;
+  bool fresh_ = false;    // predictions_ belongs to the last forward pass
+public:
+  // -------------------------------------------------------
+  // Serialization support
+  // -------------------------------------------------------
+  // Default constructor required for serialization
+  NNLoss_SoftmaxCategoricalCrossEntropy() : NNLossLayerAPI() {}
+  // Serialization function
+  void serialize_order(SST::Core::Serialization::serializer& ser) override;
+  // Serialization implementation
+  ImplementSerializable(SST::NeuralNet::NNLoss_SoftmaxCategoricalCrossEntropy)
+}; //class NNLoss_SoftmaxCategoricalCrossEntropy
+
 // -------------------------------------------------------
 // NNAccuracyCategorical
 // -------------------------------------------------------
@@ -309,7 +482,7 @@ public:
 
   NNAccuracyCategorical(ComponentId_t id, Params& params) : NNAccuracyAPI(id,params) {};
   ~NNAccuracyCategorical() {};
-  Eigen::MatrixX<bool>& compare(const Eigen::MatrixXd& predictions, const Eigen::MatrixXd& y) final;
+  Eigen::MatrixX<bool>& compare(const MatrixXs& predictions, const MatrixXs& y) final;
 
 private:
   const bool binary_=false; //TODO input parameter
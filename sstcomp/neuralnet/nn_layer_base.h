@@ -12,8 +12,10 @@
 #define _SST_NN_LAYER_BASE_H_
 
 // clang-format off
+#include <map>
 #include <vector>
 #include "nn_event.h"
+#include "nn_workspace.h"
 #include "eigen_utils.h"
 #include "SST.h"
 // clang-format on
@@ -39,6 +41,41 @@ namespace SST::NeuralNet{
     ADAM = 1,
   };
 
+// Work of one pass over a batch, the input of the latency model
+struct pass_work_t {
+  uint64_t macs = 0;    // multiply-accumulates, or equivalent elementwise ops
+  uint64_t bytes = 0;   // memory read and written
+};
+
+// -------------------------------------------------------
+// NNMallocScope
+// Sets whether Eigen may allocate from the heap until the scope ends.
+// Only built with NN_CHECK_NO_MALLOC, where an allocation while forbidden
+// fails an eigen_assert. Layers forbid them during steady-state training
+// passes. Eigen keeps one flag for the whole process, so the check needs a
+// single SST thread.
+// -------------------------------------------------------
+class NNMallocScope {
+public:
+  explicit NNMallocScope(bool allowed) {
+#ifdef NN_CHECK_NO_MALLOC
+    previous_ = Eigen::internal::is_malloc_allowed();
+    Eigen::internal::set_is_malloc_allowed(allowed);
+#endif
+  }
+  ~NNMallocScope() {
+#ifdef NN_CHECK_NO_MALLOC
+    Eigen::internal::set_is_malloc_allowed(previous_);
+#endif
+  }
+  NNMallocScope(const NNMallocScope&) = delete;
+  NNMallocScope& operator=(const NNMallocScope&) = delete;
+#ifdef NN_CHECK_NO_MALLOC
+private:
+  bool previous_ = true;
+#endif
+};
+
 // -------------------------------------------------------
 // NNSubComponentAPI (not registered)
 // -------------------------------------------------------
@@ -53,16 +90,62 @@ public:
     NNSubComponentAPI(ComponentId_t id, Params& params);
     virtual ~NNSubComponentAPI() {}
 
-    virtual void forward(const payload_t& in, payload_t& o) = 0;
-    virtual void backward(const payload_t& in, payload_t& o) = 0;
+    // Ownership-taking passes. Layers may take over any buffer in the input
+    // payload so callers must not use it afterwards.
+    virtual void forward(payload_t&& in, payload_t& o) = 0;
+    virtual void backward(payload_t&& in, payload_t& o) = 0;
+    // Read-only passes for callers that need to keep their input
+    virtual void forward(const payload_t& in, payload_t& o) { payload_t c(in); forward(std::move(c), o); }
+    virtual void backward(const payload_t& in, payload_t& o) { payload_t c(in); backward(std::move(c), o); }
+
+    // Layers that only pass the batch along can take it as a view into the
+    // controller's dataset. Everyone else gets the rows gathered into data.
+    virtual bool acceptsView() const { return false; }
+
+    // Number of buffer allocations made by this subcomponent
+    uint64_t allocations() const { return allocations_; }
+
+    // Work of a pass over a rows x cols input (the incoming gradient for
+    // backward). By default one read and one write of every element.
+    virtual pass_work_t work(bool backward, uint64_t rows, uint64_t cols) const {
+      return { 0, 2 * rows * cols * sizeof(nn_scalar_t) };
+    }
+
+    // Pipelined training runs the forward passes of later batches before
+    // the backward pass of an earlier one. The state a forward pass leaves
+    // for its backward pass is parked under the batch id and brought back
+    // before the matching backward pass.
+    virtual void stash(uint64_t batch_id);
+    virtual void unstash(uint64_t batch_id);
 
 protected:
   // SST Handlers
   SST::Output sstout_;
   // Flopped forward pass inputs
-  Eigen::MatrixXd inputs_ = {};
-  // Flopped backwas pass outputs (derivatives)
-  Eigen::MatrixXd dinputs_ = {};
+  MatrixXs inputs_ = {};
+  // Forward pass inputs of batches waiting for their backward pass
+  std::map<uint64_t, MatrixXs> stashedInputs_ = {};
+  // Buffer recycled from the backward pass for the next forward pass output
+  MatrixXs outputs_ = {};
+
+  // Resize a buffer only when its shape changes. Allocations are counted,
+  // so they are allowed even in a steady-state NNMallocScope.
+  template<typename M>
+  void conform(M& m, Eigen::Index rows, Eigen::Index cols) {
+    if (m.rows() == rows && m.cols() == cols) return;
+    if (m.size() != rows * cols) allocations_++;
+    NNMallocScope counted(true);
+    m.resize(rows, cols);
+  }
+  uint64_t allocations_ = 0;
+
+  // Scratch space for per-batch temporaries
+  NNWorkspace workspace_ = {};
+  // Lay out the workspace. Growing the arena counts as an allocation.
+  void layoutWorkspace(std::initializer_list<std::pair<Eigen::Index, Eigen::Index>> shapes) {
+    NNMallocScope counted(true);
+    if (workspace_.layout(shapes)) allocations_++;
+  }
 
   //-- Helpers
   Eutils util_ = {};
@@ -95,19 +178,28 @@ public:
     virtual ~NNLossLayerAPI() {}
 
     // Calculates the data and regularization losses - classification
-    const Losses& calculate( Eigen::MatrixXd& sample_losses, REGULARIZATION include_regularization=NONE);
+    const Losses& calculate( MatrixXs& sample_losses, REGULARIZATION include_regularization=NONE);
     // Calculates accumulated loss
     const Losses& calculated_accumulated(REGULARIZATION include_regularization=NONE);
     // Activation type of previous layer determines prediction calculation
     ACTIVATION_TYPE prediction_type() { return prediction_type_; }
     // Perform predications
-    const Eigen::MatrixXd& predictions(const Eigen::MatrixXd& outputs);
+    virtual const MatrixXs& predictions(const MatrixXs& outputs);
+
+    // Losses fused with their softmax activation take the logits. Their
+    // forward pass also produces the predictions, the accuracy and the
+    // gradient with respect to the logits.
+    virtual bool fused() const { return false; }
+    // Fraction of correct predictions in the last forward pass (fused only)
+    virtual double accuracy() const { assert(false); return 0; }
+    // Hand the last forward pass gradient over in p.data (fused only)
+    virtual void gradient(payload_t& p) { assert(false); }
 
 protected:
     ACTIVATION_TYPE prediction_type_ = ACTIVATION_TYPE::SOFTMAX;
     Losses losses_ = {};
     Losses accumulated_losses_ = {};
-    Eigen::MatrixXd predictions_ = {};
+    MatrixXs predictions_ = {};
     double accumulated_sum_ = 0;
     int accumulated_count_ = 0;
 
@@ -135,8 +227,8 @@ public:
   )
   NNAccuracyAPI(ComponentId_t id, Params& params);
   virtual ~NNAccuracyAPI() {}
-  virtual Eigen::MatrixX<bool>& compare(const Eigen::MatrixXd& predictions, const Eigen::MatrixXd& y) = 0;
-  double calculate(const Eigen::MatrixXd& predictions, const Eigen::MatrixXi& y);
+  virtual Eigen::MatrixX<bool>& compare(const MatrixXs& predictions, const MatrixXs& y) = 0;
+  double calculate(const MatrixXs& predictions, const Eigen::MatrixXi& y);
   double calculate_accumulated();
   void new_pass();
 protected:
@@ -145,6 +237,7 @@ protected:
 private:
   double accumulated_sum_ = 0;
   double accumulated_count_ = 0;
+  MatrixXs labels_ = {};   // y as scalars for comparisons
 public:
   // -------------------------------------------------------
   // Serialization support
@@ -179,6 +272,10 @@ public:
   virtual void update_params(NNDenseLayer* layer, const optimizer_data_t& opt) = 0;
   // Call once after any parameter updates
   virtual void post_update_params() = 0;
+  // Backward pass step for the layer this optimizer belongs to. The first
+  // layer reached (PRE_UPDATE) starts an iteration and passes the
+  // hyperparameters on in opt, later layers update their parameters.
+  void step(NNSubComponentAPI* layer, optimizer_data_t& opt);
   // Getters
   double learning_rate() { return learning_rate_; }
   double current_learning_rate() { return current_learning_rate_; }
@@ -0,0 +1,136 @@
+//
+// _nn_prefetcher_h_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+
+#ifndef _SST_NN_PREFETCHER_H_
+#define _SST_NN_PREFETCHER_H_
+
+// clang-format off
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nnscalar.h"
+// clang-format on
+
+namespace SST::NeuralNet{
+
+// -------------------------------------------------------
+// NNPrefetcher
+// Fills a ring of ready batches on a background thread while the
+// simulation thread runs the layers. Batches are produced and taken
+// strictly in step order. The ring holds no simulation state: it can be
+// stopped at any time and restarted from the next step to send with
+// identical results. That includes a restart from a checkpoint, once the
+// batch controller has reloaded the data that fill reads (nn-restart).
+// -------------------------------------------------------
+class NNPrefetcher {
+public:
+  // Fill X and y with the batch for a step. Called on the worker thread.
+  using Fill = std::function<void(unsigned step, MatrixXs& X, Eigen::MatrixXi& y)>;
+
+  NNPrefetcher() = default;
+  NNPrefetcher(const NNPrefetcher&) = delete;
+  NNPrefetcher& operator=(const NNPrefetcher&) = delete;
+  ~NNPrefetcher() { stop(); }
+
+  bool running() const { return worker_.joinable(); }
+
+  // Gather steps [first, end) ahead of the consumer, at most `slots` at a
+  // time. Whatever fill reads must not change until stop().
+  void start(unsigned slots, unsigned first, unsigned end, Fill fill) {
+    assert(!running() && slots > 0);
+    if (ring_.size() != slots)
+      ring_.resize(slots);   // slot buffers are kept across restarts
+    for (auto& s : ring_)
+      s.ready = false;
+    fill_ = std::move(fill);
+    next_fill_ = next_take_ = first;
+    end_ = end;
+    stop_ = false;
+    worker_ = std::thread([this] { work(); });
+  }
+
+  // Stop the worker and drop every batch not yet taken
+  void stop() {
+    if (!running())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    worker_.join();
+  }
+
+  // Wait for the batch of `step` and swap it into X and y. The buffers
+  // handed back are refilled with later batches.
+  void take(unsigned step, MatrixXs& X, Eigen::MatrixXi& y) {
+    assert(running() && step == next_take_ && step < end_);
+    slot_t& s = ring_[step % ring_.size()];
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&] { return s.ready; });
+    X.swap(s.X);
+    y.swap(s.y);
+    s.ready = false;
+    next_take_++;
+    lock.unlock();
+    changed_.notify_all();
+  }
+
+private:
+  struct slot_t {
+    MatrixXs X = {};
+    Eigen::MatrixXi y = {};
+    bool ready = false;
+  };
+
+  void work() {
+    for (;;) {
+      unsigned step;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] {
+          return stop_ || next_fill_ == end_ || next_fill_ < next_take_ + ring_.size();
+        });
+        if (stop_ || next_fill_ == end_)
+          return;
+        step = next_fill_;
+      }
+      // The slot is free and only this thread touches it until ready is set
+      slot_t& s = ring_[step % ring_.size()];
+      fill_(step, s.X, s.y);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        s.ready = true;
+        next_fill_++;
+      }
+      changed_.notify_all();
+    }
+  }
+
+  std::vector<slot_t> ring_ = {};
+  Fill fill_ = {};
+  unsigned next_fill_ = 0;
+  unsigned next_take_ = 0;
+  unsigned end_ = 0;
+  bool stop_ = false;
+  std::mutex mutex_ = {};
+  std::condition_variable changed_ = {};
+  std::thread worker_ = {};
+};
+
+} //namespace SST::NeuralNet
+
+#endif  // _SST_NN_PREFETCHER_H_
+
+// EOF
@@ -0,0 +1,70 @@
+//
+// _nn_workspace_h_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+
+#ifndef _SST_NN_WORKSPACE_H_
+#define _SST_NN_WORKSPACE_H_
+
+// clang-format off
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "nnscalar.h"
+// clang-format on
+
+namespace SST::NeuralNet{
+
+// -------------------------------------------------------
+// NNWorkspace
+// Scratch arena for per-batch temporaries. A single aligned block
+// is carved into matrix slots. The block only ever grows so once it
+// has been sized (first batch) later layouts reuse it without
+// touching the heap.
+// -------------------------------------------------------
+class NNWorkspace {
+public:
+  using Slot = Eigen::Map<MatrixXs, Eigen::AlignedMax>;
+
+  // Carve the arena into slots of the given (rows, cols) shapes.
+  // Returns true if the backing block had to be (re)allocated.
+  bool layout(std::initializer_list<std::pair<Eigen::Index, Eigen::Index>> shapes) {
+    slots_.clear();
+    Eigen::Index total = 0;
+    for (const auto& shape : shapes) {
+      slots_.push_back({total, shape});
+      // keep every slot on its own cache line
+      total += (shape.first * shape.second + align_ - 1) / align_ * align_;
+    }
+    if (total <= store_.size())
+      return false;
+    store_.resize(total);
+    return true;
+  }
+
+  // Matrix view of a slot from the most recent layout
+  Slot slot(size_t i) {
+    const auto& s = slots_.at(i);
+    return Slot(store_.data() + s.first, s.second.first, s.second.second);
+  }
+
+  // Backing block size in scalars
+  Eigen::Index capacity() const { return store_.size(); }
+
+private:
+  static constexpr Eigen::Index align_ = 64 / sizeof(nn_scalar_t);
+  VectorXs store_ = {};
+  std::vector<std::pair<Eigen::Index, std::pair<Eigen::Index, Eigen::Index>>> slots_ = {};
+};
+
+} //namespace SST::NeuralNet
+
+#endif  // _SST_NN_WORKSPACE_H_
+
+// EOF
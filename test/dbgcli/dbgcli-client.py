@@ -10,24 +10,62 @@
 
 import argparse
 import socket
+import struct
 
 from enum import Enum
 
-BUFFER_SIZE = 4096
 HOST = "127.0.0.1"
 
+# Frame header, network byte order: payload length, message type, flags.
+# Must match ProbeServer in sstcomp/dbgcli/probe.h
+HEADER = struct.Struct("!IHH")
+MSG_CMD = 1
+MSG_TEXT = 2
+MSG_BINARY = 3
+MSG_MORE = 1
+
 class State(Enum):
     INIT = 0
     RUN = 1
     DISCONNECT = 2
 
+def recv_exact(sock, n):
+    buf = bytearray()
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("server closed the connection")
+        buf += chunk
+    return bytes(buf)
+
+def send_cmd(sock, cmd):
+    data = cmd.encode()
+    sock.sendall(HEADER.pack(len(data), MSG_CMD, 0) + data)
+
+# Returns (type, payload) of one message, joining its frames
+def recv_msg(sock):
+    parts = []
+    flags = MSG_MORE
+    while flags & MSG_MORE:
+        length, mtype, flags = HEADER.unpack(recv_exact(sock, HEADER.size))
+        parts.append(recv_exact(sock, length))
+    return mtype, b"".join(parts)
+
+# Send a command and return the text response
+def request(sock, cmd):
+    send_cmd(sock, cmd)
+    mtype, data = recv_msg(sock)
+    if mtype == MSG_BINARY:
+        return f"<{len(data)} bytes binary>"
+    return data.decode()
+
 def decode(msg):
     global state
     cmd = msg.lower().strip()
     if cmd=="disconnect" or cmd=="quit" or cmd=="exit" or cmd=="bye":
         state = State.DISCONNECT
 
-def client_program(probePort):
+def client_program(probePort, component):
     global state
     client_socket = socket.socket()
     print(f"Connecting to {HOST}:{probePort}")
@@ -39,40 +77,46 @@ def client_program(probePort):
     print(divider)
 
     cmd = "hostname"
-    client_socket.send(cmd.encode())
-    servername = client_socket.recv(BUFFER_SIZE).decode()
+    servername = request(client_socket, cmd)
     print(f"# {cmd} = {servername}")
 
+    # probed components of the process. Commands go to the selected one.
+    cmd = "list"
+    comps = request(client_socket, cmd)
+    print(f"# {cmd} =")
+    print(comps, end="")
+    names = [line[2:].split()[0] for line in comps.splitlines() if line.strip()]
+    if not component and request(client_socket, "select") == "none" and names:
+        component = names[0]
+    if component:
+        print(f"# {request(client_socket, f'select {component}')}")
+
     cmd = "component"
-    client_socket.send(cmd.encode())
-    comp = client_socket.recv(BUFFER_SIZE).decode()
+    comp = request(client_socket, cmd)
     print(f"# {cmd} = {comp}")
 
     cmd = "cycle"
-    client_socket.send(cmd.encode())
-    cycle = client_socket.recv(BUFFER_SIZE).decode()
+    cycle = request(client_socket, cmd)
     print(f"# {cmd} = {cycle}")
 
     cmd = "clicontrol"
-    client_socket.send(cmd.encode())
-    clicontrol = int(client_socket.recv(BUFFER_SIZE).decode(),10)
+    clicontrol = int(request(client_socket, cmd),10)
     print(f"# {cmd} = 0x{clicontrol:x}")
 
     print(divider)
 
     state = State.RUN
     while state == State.RUN:
-        client_socket.send("clicontrol".encode())
-        cctl = int(client_socket.recv(BUFFER_SIZE).decode(),10)
+        # waits for the component's next break point
+        cctl = int(request(client_socket, "clicontrol"),10)
         id = "comp"
         if (cctl & 0x100):
             id = "chkpt"
-            client_socket.send("syncstate".encode())
+            stat = request(client_socket, "syncstate")
         else:
-            client_socket.send("probestate".encode())
-        stat = client_socket.recv(BUFFER_SIZE).decode()
-        client_socket.send("cycle".encode())
-        cycle = client_socket.recv(BUFFER_SIZE).decode()
+            stat = request(client_socket, "probestate")
+        cycle = request(client_socket, "cycle")
+        comp = request(client_socket, "component")
         PROMPT = f"[{id}:{stat}:{comp}:{cycle}]> "
         msg_len=0;
         while msg_len<1:
@@ -81,9 +125,17 @@ def client_program(probePort):
         decode(msg)
         if state == State.DISCONNECT:
             msg = "disconnect"
-        client_socket.send(msg.encode())
-        data = client_socket.recv(BUFFER_SIZE).decode()
-        print(data)
+        args = msg.split()
+        if args[0] == "dumpbin":
+            # raw records saved as a probe file for readprobe
+            fname = args[1] if len(args) > 1 else "dump.prb"
+            send_cmd(client_socket, "dumpbin")
+            mtype, data = recv_msg(client_socket)
+            with open(fname, "wb") as f:
+                f.write(data)
+            print(f"wrote {len(data)} bytes to {fname}")
+            continue
+        print(request(client_socket, msg))
 
     client_socket.close()
 
@@ -91,13 +143,14 @@ if __name__ == '__main__':
 
     parser = argparse.ArgumentParser(description="dbgcli-client")
     parser.add_argument("--probePort", type=int, help="sst probe starting socket. 0=None", required=True)
+    parser.add_argument("--component", type=str, help="component to select. Default is the first listed", default="")
     args = parser.parse_args()
     print("dbgcli-client configuration:")
     for arg in vars(args):
         print("\t", arg, " = ", getattr(args, arg))
 
     try:
-        client_program(args.probePort)
+        client_program(args.probePort, args.component)
     except Exception as err:
         print(f"disconnected: {err}, {type(err)}")
     else:
@@ -17,6 +17,8 @@ parser.add_argument("--probeEndCycle", type=int, help="cycle to end debug probe.
 parser.add_argument("--probeBufferSize", type=int, help="number of records in circular buffer", default=16)
 parser.add_argument("--probePostDelay", type=int, help="number of events to capture after trigger event", default=8)
 parser.add_argument("--probePort", type=int, help="sst probe starting socket. 0=None", default=0 )
+parser.add_argument("--probeFile", type=str, help="base name of binary probe files. Empty flushes to stdout", default="" )
+parser.add_argument("--probeTrigger", type=str, help="trigger expression over the record fields. Empty uses the built-in trigger", default="" )
 parser.add_argument("--verbose", type=int, help="verbosity. 5=send/recv", default=1)
 # 0b0100_0000 : 0x40 : 64 Every checkpoint
 # 0b0010_0000 : 0x20 : 32 Every checkpoint when probe is active
@@ -81,6 +83,8 @@ cp1.addParams({
   "probeEndCycle"   : args.probeEndCycle,
   "probeBufferSize" : args.probeBufferSize,
   "probePostDelay"  : args.probePostDelay,
+  "probeFile"       : args.probeFile,
+  "probeTrigger"    : args.probeTrigger,
    #"probePort" : PROBE_PORT+1,
    #"cliControl"     : CLI_CONTROL,
    # component specific probe controls
@@ -0,0 +1,267 @@
+//
+// _probe_bench_cc_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+// Check and microbenchmark for the probe ring buffer. Verifies ordering,
+// trigger tagging and overrun against a small buffer, copies the buffer
+// out while another thread captures and overruns triggers into it, checks
+// trigger expressions,
+// then times capture of a record the size of the DbgCLI event attributes
+// with and without a trigger expression.
+//
+// usage: probe-bench [samples] [max ns/sample] [max ns/sample with trigger]
+//
+// The timings are only reported unless a limit is given. CMake passes
+// limits for optimized builds without sanitizers.
+//
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include "probe_buffer.h"
+
+using namespace SSTDEBUG::Probe;
+
+// same layout as DbgCLI_Probe::event_atts_t. check is derived from cycle
+// so a torn copy can be detected.
+struct rec_t {
+  uint64_t cycle = 0;
+  uint64_t sz = 0;
+  uint64_t deliveryTime = 0;
+  int priority = 0;
+  uint64_t orderTag = 0;
+  uint64_t check = 0;
+  rec_t() {}
+  rec_t(uint64_t c) : cycle(c), sz(8), deliveryTime(c + 1), orderTag(c), check(~c) {}
+  friend std::ostream& operator<<(std::ostream& os, const rec_t& r) {
+    os << "cycle=" << r.cycle;
+    return os;
+  }
+};
+
+static bool fail(const char* what)
+{
+  printf("probe-bench: %s\n", what);
+  return false;
+}
+
+static bool check_semantics()
+{
+  ProbeBuffer<rec_t> buf(5);
+  if (buf.size() != 8) return fail("size not rounded up to a power of 2");
+
+  // wrap around once
+  for (uint64_t i = 0; i < 20; i++) buf.capture(rec_t(i));
+  std::vector<rec_t> recs;
+  std::vector<ProbeBufCtl::TRIGGER_STATE> tags;
+  if (buf.getNumRecs() != 8 || buf.snapshot(recs, tags) != 8) return fail("wrong record count");
+  for (size_t i = 0; i < recs.size(); i++)
+    if (recs[i].cycle != 12 + i || tags[i] != ProbeBufCtl::CLEAR) return fail("wrong record order");
+
+  // trigger record stays marked until it is written over
+  buf.reset_buffer();
+  if (buf.getNumRecs() != 0) return fail("reset_buffer left records");
+  buf.capture(rec_t(100));
+  buf.markAsTriggerRec();
+  for (uint64_t i = 101; i < 108; i++) buf.capture(rec_t(i));
+  std::ostringstream os;
+  buf.render_buffer(os);
+  if (os.str().find("#T cycle=101\n") == std::string::npos || buf.getTrigStateChar() != '+')
+    return fail("trigger record not rendered");
+  for (uint64_t i = 108; i < 112; i++) buf.capture(rec_t(i));
+  os.str("");
+  buf.render_buffer(os);
+  if (buf.getTrigStateChar() != 'o' ||
+      os.str().find("#T cycle=101\n# records discarded 2\n") == std::string::npos)
+    return fail("overrun not reported");
+
+  buf.reset_trigger();
+  buf.reset_buffer();
+  buf.capture(rec_t(200));
+  if (buf.getTrigStateChar() != '-' || buf.snapshot(recs, tags) != 1 || recs[0].cycle != 200)
+    return fail("reset_trigger");
+  return true;
+}
+
+static const std::vector<probe_field_t> fields = {
+  PROBE_FIELD(rec_t, cycle, "cycle"),
+  PROBE_FIELD(rec_t, sz, "sz"),
+  PROBE_FIELD(rec_t, priority, "priority"),
+};
+
+static rec_t rec(uint64_t cycle, uint64_t sz, int priority = 0)
+{
+  rec_t r(cycle);
+  r.sz = sz;
+  r.priority = priority;
+  return r;
+}
+
+// Index of the first record of sz values the expression holds for, or -1
+static int first_match(const char* expr, const std::vector<uint64_t>& szs)
+{
+  std::string error;
+  auto t = ProbeTrigger::compile(expr, fields, error);
+  if (!t) {
+    printf("probe-bench: %s: %s\n", expr, error.c_str());
+    return -2;
+  }
+  for (size_t i = 0; i < szs.size(); i++) {
+    rec_t r = rec(i, szs[i], i % 2 ? 50 : 0);
+    if (t->eval(&r)) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+static bool check_trigger()
+{
+  std::string error;
+  for (const char* bad : { "sz >", "bogus == 1", "sz % 1.5", "(sz > 1", "sz > 1 then", "sz $ 2", "" })
+    if (ProbeTrigger::compile(bad, fields, error) || error.empty())
+      return fail("bad trigger expression accepted");
+
+  //                          0  1   2    3  4  5    6  7  8   9
+  std::vector<uint64_t> szs = { 5, 1, 120, 1, 1, 95, 3, 1, 7, 101 };
+  // priority is 50 on odd records
+  if (first_match("sz > 100 && priority == 50", szs) != 9) return fail("comparison trigger");
+  if (first_match("sz > 100 || (sz == 1 && priority != 50)", szs) != 2) return fail("boolean trigger");
+  if (first_match("!(sz < 100)", szs) != 2) return fail("not trigger");
+  if (first_match("sz * 1.5 > 10 && sz - 100 < 0", szs) != 5) return fail("float trigger");
+  if (first_match("(sz & 1) == 0 && sz % 7 == 1", szs) != 2) return fail("integer operator trigger");
+  if (first_match("0x14 == sz + 19", szs) != 1) return fail("hex trigger");
+  if (first_match("count(sz == 1) >= 3", szs) != 4) return fail("count trigger");
+  if (first_match("rise(sz == 1) && count(sz == 1) > 2", szs) != 7) return fail("rise trigger");
+  if (first_match("sz > 90 then sz < 5", szs) != 3) return fail("then trigger");
+  if (first_match("sz > 110 then sz == 3 within 3", szs) != -1) return fail("then within trigger");
+  if (first_match("sz > 90 then sz == 3 within 1", szs) != 6) return fail("then within trigger");
+
+  // the buffer marks the first record the expression holds for
+  ProbeBuffer<rec_t> buf(16);
+  buf.setFields(fields);
+  buf.setTrigger(ProbeTrigger::compile("count(sz > 90) == 2", fields, error));
+  for (size_t i = 0; i < szs.size(); i++) buf.capture(rec(i, szs[i]));
+  std::ostringstream os;
+  buf.render_buffer(os);
+  if (buf.getTrigStateChar() != '+' || os.str().find("#T cycle=5\n") == std::string::npos)
+    return fail("trigger expression did not mark the trigger record");
+  // re-armed by reset_trigger
+  buf.reset_trigger();
+  buf.reset_buffer();
+  for (size_t i = 0; i < szs.size(); i++) buf.capture(rec(100 + i, szs[i]));
+  os.str("");
+  buf.render_buffer(os);
+  if (os.str().find("#T cycle=105\n") == std::string::npos) return fail("trigger expression not re-armed");
+  return true;
+}
+
+// Saved trigger record of a DATA block, false if there is none
+static bool block_trigger_rec(const std::vector<char>& out, rec_t& r)
+{
+  probe_data_t d;
+  memcpy(&d, &out[sizeof(probe_block_t)], sizeof(d));
+  if (!d.has_trigger_rec) return false;
+  memcpy(&r, &out[sizeof(probe_block_t) + sizeof(d) + d.name_len], sizeof(r));
+  return true;
+}
+
+// One thread captures, triggering and overrunning every 1024 samples,
+// while this one keeps copying the buffer out the way the probe server's
+// concurrent DUMP and DUMPBIN commands do.
+static bool check_concurrent(uint64_t samples)
+{
+  ProbeBuffer<rec_t> buf(256);
+  std::atomic<bool> done = false;
+  std::thread producer([&] {
+    for (uint64_t i = 0; i < samples; i++) {
+      if (i % 1024 == 0) {
+        buf.reset_trigger();
+        buf.markAsTriggerRec();
+      }
+      buf.capture(rec_t(i));
+    }
+    done = true;
+  });
+  uint64_t snapshots = 0, copied = 0, trigrecs = 0;
+  bool ok = true;
+  std::vector<rec_t> recs;
+  std::vector<ProbeBufCtl::TRIGGER_STATE> tags;
+  std::vector<char> out;
+  std::ostringstream os;
+  rec_t trig;
+  while (!done.load() && ok) {
+    out.clear();
+    buf.write_block(out, 0, "c", 0);
+    if (block_trigger_rec(out, trig)) {
+      trigrecs++;
+      if (trig.check != ~trig.cycle || trig.cycle % 1024 != 0) {
+        ok = fail("torn trigger record");
+        break;
+      }
+    }
+    os.str("");
+    buf.render_buffer(os);
+    buf.snapshot(recs, tags);
+    for (size_t i = 0; i < recs.size(); i++) {
+      if (recs[i].check != ~recs[i].cycle || (i > 0 && recs[i].cycle <= recs[i - 1].cycle)) {
+        ok = fail("torn or out of order record");
+        break;
+      }
+    }
+    snapshots++;
+    copied += recs.size();
+  }
+  producer.join();
+  printf("concurrent: %" PRIu64 " snapshots, %" PRIu64 " records and %" PRIu64 " trigger records copied\n",
+         snapshots, copied, trigrecs);
+  return ok;
+}
+
+static double bench_capture(uint64_t samples, const char* expr = nullptr)
+{
+  ProbeBuffer<rec_t> buf(1024);
+  std::string error;
+  if (expr) buf.setTrigger(ProbeTrigger::compile(expr, fields, error));
+  // built in place the way DbgCLI_Probe::capture_event_atts does
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < samples; i++)
+    buf.emplace(i);
+  auto t1 = std::chrono::steady_clock::now();
+  if (buf.getNumRecs() != 1024) return -1;
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / static_cast<double>(samples);
+}
+
+int main(int argc, char** argv)
+{
+  uint64_t samples = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+  double limit = argc > 2 ? atof(argv[2]) : 0.;
+  double trigLimit = argc > 3 ? atof(argv[3]) : 0.;
+
+  bool ok = check_semantics();
+  ok &= check_trigger();
+  ok &= check_concurrent(samples);
+  double ns = bench_capture(samples);
+  printf("capture: %zu byte records, %.2f ns/sample\n", sizeof(rec_t), ns);
+  if (ns < 0) ok = fail("capture lost records");
+  else if (limit > 0 && ns > limit) ok = fail("capture slower than limit");
+  // never fires, so it is evaluated on every capture
+  const char* expr = "sz > 100 && priority == 50";
+  ns = bench_capture(samples, expr);
+  printf("capture with trigger '%s': %.2f ns/sample\n", expr, ns);
+  if (ns < 0) ok = fail("capture with trigger lost records");
+  else if (trigLimit > 0 && ns > trigLimit) ok = fail("capture with trigger slower than limit");
+
+  printf("%s\n", ok ? "probe-bench PASS" : "probe-bench FAIL");
+  return ok ? 0 : 1;
+}
+
+// EOF
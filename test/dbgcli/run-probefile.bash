@@ -0,0 +1,12 @@
+#!/bin/bash
+# Flush the probe buffer to a binary file and decode it with readprobe
+# usage: run-probefile.bash path-to-readprobe
+READPROBE=$1
+mkdir -p run
+cd run
+rm -f probe.*.prb
+
+sst --checkpoint-sim-period=1us ../dbgcli-sanity.py -- --probeStartCycle=3000000 --probeEndCycle=8000000 --probePostDelay=10 --probeBufferSize=1024 --probeFile=probe || exit 1
+
+$READPROBE probe.0.0.prb || exit 1
+$READPROBE -csv probe.0.0.prb | head -4
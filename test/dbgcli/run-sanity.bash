@@ -10,7 +10,8 @@ cd run
 # 0b0000_0010 : 0x02  Every probe sample from trigger onward
 # 0b0000_0001 : 0x01  Every probe state change
 
-sst --checkpoint-sim-period=1us ../dbgcli-sanity.py -- --probePort=10000 --cliControl=64  --probeStartCycle=3000000 --probeEndCycle=8000000 --probePostDelay=10 --probeBufferSize=1024 &
+# PROBE_WAIT_CLIENT holds the break points until the client below connects
+PROBE_WAIT_CLIENT=1 sst --checkpoint-sim-period=1us ../dbgcli-sanity.py -- --probePort=10000 --cliControl=64  --probeStartCycle=3000000 --probeEndCycle=8000000 --probePostDelay=10 --probeBufferSize=1024 &
 sleep 2
 ../dbgcli-client.py --probePort=10000<<EOF
 echo hello there sst component
@@ -0,0 +1,7 @@
+#!/bin/bash
+# Trigger on an expression over the probe record fields instead of the
+# component's built-in condition
+mkdir -p run
+cd run
+
+sst --checkpoint-sim-period=1us ../dbgcli-sanity.py -- --probeStartCycle=3000000 --probeEndCycle=8000000 --probePostDelay=4 --probeBufferSize=16 --probeTrigger="count(sz > 90) == 3"
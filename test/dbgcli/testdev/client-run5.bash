@@ -2,6 +2,11 @@
 
 # This script is used in conjuction with the makefile
 
+# Hold the break points until the client below connects
+if [[ ! -z ${PROBE_PORT} ]]; then
+    export PROBE_WAIT_CLIENT=1
+fi
+
 $SST $SSTOPTS $SSTCFG &
 
 if [[ ! -z ${PROBE_PORT} ]]; then
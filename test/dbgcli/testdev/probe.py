@@ -18,7 +18,7 @@ parser.add_argument("--probeStartCycle", type=int, help="cycle to initiate debug
 parser.add_argument("--probeEndCycle", type=int, help="cycle to end debug probe. 0=Never", default=0)
 parser.add_argument("--probeBufferSize", type=int, help="number of records in circular buffer", default=16)
 parser.add_argument("--probePostDelay", type=int, help="number of events to capture after trigger event", default=8)
-parser.add_argument("--probePort", type=int, help="sst probe starting socket. 0=None", default=10000 )
+parser.add_argument("--probePort", type=int, help="sst probe server socket. 0=None", default=10000 )
 parser.add_argument("--verbose", type=int, help="verbosity. 5=send/recv", default=1)
 # 0b0100_0000 : 0x40 : 64 Every checkpoint
 # 0b0010_0000 : 0x20 : 32 Every checkpoint when probe is active
@@ -86,7 +86,7 @@ cp1.addParams({
   "probeEndCycle"   : args.probeEndCycle,
   "probeBufferSize" : args.probeBufferSize,
   "probePostDelay"  : args.probePostDelay,
-  "probePort"       : args.probePort + 1,
+  "probePort"       : args.probePort,
   "cliControl"      : args.cliControlC1,
 })
 
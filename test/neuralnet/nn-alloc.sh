@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Runs the nn-5layers small simulation at verbose 1 and checks that no
+# layer allocates transfer function buffers after its first training step.
+
+layers=11   # input, 5 dense, 4 relu and the loss layer
+
+mkdir -p run
+log=run/nn-alloc.log
+
+VERBOSE=1 ./nn-5layers.sh > ${log}
+if [ $? != 0 ]; then
+    echo "error: simulation failed"
+    exit 1
+fi
+
+grep "buffer allocations:" ${log}
+reports=$(grep -c "buffer allocations:" ${log})
+if [ "${reports}" != "${layers}" ]; then
+    echo "error: ${reports} layers reported buffer allocations, expected ${layers}"
+    exit 2
+fi
+steady=$(grep -cE "buffer allocations: [0-9]+ in first training step, 0 in [0-9]+ later steps" ${log})
+if [ "${steady}" != "${layers}" ]; then
+    echo "error: $((layers - steady)) layers allocate buffers after the first training step"
+    exit 3
+fi
+
+grep "Simulation is complete" ${log}
+
+# for ctest pass regexp
+echo "nn-alloc PASS"
@@ -0,0 +1,56 @@
+//
+// _nn_dataset_bench_cc_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+// Startup time of Dataset image loading at 1, 4 and 16 decoding threads.
+// The binary cache is disabled so every run decodes all images. Each
+// thread count must produce the same rows and labels as the serial load.
+//
+// usage: nn-dataset-bench <class image directory> [classImageLimit]
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "dataset.h"
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <class image directory> [classImageLimit]\n", argv[0]);
+    return 1;
+  }
+  const uint64_t limit = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100000;
+  const unsigned threads[] = {1, 4, 16};
+
+  bool ok = true;
+  MatrixXs ref_data;
+  Eigen::MatrixXi ref_classes;
+  double serial = 0;
+  for (unsigned t : threads) {
+    Dataset ds;
+    auto start = std::chrono::steady_clock::now();
+    ds.load(argv[1], Dataset::DTYPE::IMAGE, limit, false, false, t);
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    if (t == 1) {
+      ref_data = ds.data;
+      ref_classes = ds.classes;
+      serial = d.count();
+    }
+    bool same = ds.data == ref_data && ds.classes == ref_classes;
+    ok &= same && ds.data.rows() > 0;
+    printf("load %6ld images %2u threads %8.3f s  speedup %.2fx %s\n",
+           (long)ds.data.rows(), t, d.count(), serial / d.count(), same ? "ok" : "MISMATCH");
+  }
+
+  printf("%s\n", ok ? "nn-dataset-bench PASS" : "nn-dataset-bench FAIL");
+  return ok ? 0 : 1;
+}
+
+// EOF
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Small simulation with layers running their passes from self-link events
+# rather than the clock. Each pass takes the time a device model gives it
+# and the per-layer work statistics are printed at the end.
+
+mkdir -p run
+cd run
+
+SSTOPTS=''
+
+IMAGE_DATA=$(realpath "../../../image_data")
+
+verbose=0
+if [ ! -z "${VERBOSE}" ]; then
+    verbose=${VERBOSE}
+fi
+
+echo "Running small simulation with eventDriven=1 and a device latency model"
+sst ../test-image.py ${SSTOPTS} -- \
+    --batchSize=1 \
+    --classImageLimit=4 \
+    --computeLatency=2ns \
+    --epochs=4 \
+    --evalImages="${IMAGE_DATA}/eval" \
+    --eventDriven=1 \
+    --hiddenLayers=5 \
+    --hiddenLayerSize=32 \
+    --initialWeightScaling=0.01 \
+    --layerOverhead=5ns \
+    --layerStatistics=1 \
+    --memBandwidth=1e11 \
+    --peakFlops=1e12 \
+    --testImages="${IMAGE_DATA}/fashion_mnist_images/test" \
+    --trainingImages="${IMAGE_DATA}/fashion_mnist_images/train" \
+    --verbose=${verbose}
+
+wait
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Small simulation with the whole layer stack inside one component. The
+# nn-5layers network is run once as separate layer components and once
+# fused, and the fused run must report the same epoch loss and accuracy
+# and the same predictions.
+
+mkdir -p run
+cd run
+
+SSTOPTS=''
+
+IMAGE_DATA=$(realpath "../../../image_data")
+
+# verbose must be at least 2 for the epoch summaries compared below
+verbose=2
+
+logs=nn-fused.logs
+rm -rf ${logs}
+mkdir -p ${logs}
+
+run() {
+    sst ../test-image.py ${SSTOPTS} -- \
+        --batchSize=1 \
+        --classImageLimit=4 \
+        --epochs=4 \
+        --evalImages="${IMAGE_DATA}/eval" \
+        --hiddenLayers=5 \
+        --hiddenLayerSize=32 \
+        --initialWeightScaling=0.01 \
+        --testImages="${IMAGE_DATA}/fashion_mnist_images/test" \
+        --trainingImages="${IMAGE_DATA}/fashion_mnist_images/train" \
+        --verbose=${verbose} \
+        "$@"
+}
+
+results() {
+    grep -E "epoch [0-9]+ (training|validation):|Survey says" $1
+}
+
+echo "Running small simulation with separate layer components"
+run > ${logs}/layers.log
+if [ $? != 0 ]; then
+    echo "error: layered simulation failed"
+    exit 1
+fi
+
+echo "Running small simulation with fusedNetwork=1"
+run --fusedNetwork=1 > ${logs}/fused.log
+if [ $? != 0 ]; then
+    echo "error: fused simulation failed"
+    exit 2
+fi
+
+results ${logs}/layers.log > ${logs}/layers.txt
+results ${logs}/fused.log > ${logs}/fused.txt
+if [ ! -s ${logs}/layers.txt ]; then
+    echo "error: no epoch results in ${logs}/layers.log"
+    exit 3
+fi
+diff ${logs}/layers.txt ${logs}/fused.txt
+if [ $? != 0 ]; then
+    echo "error: fused network results differ from the layered network"
+    exit 4
+fi
+
+cat ${logs}/fused.txt
+grep "Simulation is complete" ${logs}/fused.log
+
+# for ctest pass regexp
+echo "nn-fused PASS"
@@ -0,0 +1,398 @@
+//
+// _nn_kernels_cc_
+//
+// Copyright (C) 2017-2025 Tactical Computing Laboratories, LLC
+// All Rights Reserved
+// contact@tactcomplabs.com
+//
+// See LICENSE in the top level directory for licensing details
+//
+// Equivalence check and microbenchmark for the fused neural net kernels.
+// Each kernel is compared against the multi-pass Eigen expressions it
+// replaced in nn_layer.cc and then both are timed at the layer shapes
+// used by the example networks. The float/double conversion of
+// checkpointed matrices (eigen_block.h) is checked as well.
+//
+// usage: nn-kernels [iterations]
+//
+
+// Let Eigen assert on heap allocations while they are forbidden
+// (check_no_malloc). The assert needs a build without NDEBUG. Builds with
+// SST_TOOLS_NEURALNET_CHECK_NO_MALLOC already define it.
+#if !defined(NDEBUG) && !defined(NN_CHECK_NO_MALLOC)
+#define NN_CHECK_NO_MALLOC
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "eigen_block.h"
+#include "eigen_utils.h"
+#include "nn_bitmask.h"
+#include "nn_kernels.h"
+#include "thread_pool.h"
+
+using namespace SST::NeuralNet;
+using Eigen::MatrixXd;
+
+// Adam as written in NNAdamOptimizer::update_params before fusion
+static void adam_reference(MatrixXd& w, MatrixXd& m, MatrixXd& v, const MatrixXd& g,
+                           double beta_1, double beta_2, double lr, double eps, unsigned iterations)
+{
+  m = beta_1 * m.array() + (1. - beta_1) * g.array();
+  const double momentum_correction = 1. - pow(beta_1, (iterations + 1.));
+  auto m_corrected = m.array() / momentum_correction;
+  v = beta_2 * v.array() + (1 - beta_2) * g.array().pow(2);
+  const double cache_correction = 1 - pow(beta_2, (iterations + 1));
+  auto v_corrected = v.array() / cache_correction;
+  w.array() -= lr * m_corrected / (v_corrected.sqrt() + eps);
+}
+
+// largest elementwise difference relative to the magnitude of the reference
+static double max_rel_error(const MatrixXd& a, const MatrixXd& ref)
+{
+  return (a - ref).cwiseAbs().maxCoeff() / std::max(ref.cwiseAbs().maxCoeff(), 1e-300);
+}
+
+// With default flags the fused kernel is bitwise identical to the reference.
+// Wider vector units use an approximate vectorized pow(g,2) in the
+// reference, so allow a small relative tolerance rather than exact equality.
+static const double ADAM_TOLERANCE = 1e-12;
+// single precision parameters, relative to the double reference
+static const double ADAM_FLOAT_TOLERANCE = 1e-5;
+
+// T is the parameter type and S the optimizer state type. The reference
+// always runs in double so single and mixed precision are checked against
+// the full precision result.
+template<typename T, typename S>
+static bool check_adam(Eigen::Index rows, Eigen::Index cols, unsigned steps, double tolerance)
+{
+  using MatrixT = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+  using MatrixS = Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>;
+  const double b1 = 0.9, b2 = 0.999, lr = 0.005, eps = 1e-7;
+  MatrixXd rw = MatrixXd::Random(rows, cols);
+  MatrixXd rm = MatrixXd::Zero(rows, cols);
+  MatrixXd rv = MatrixXd::Zero(rows, cols);
+  MatrixT w = rw.cast<T>();
+  MatrixS m = rm.cast<S>(), v = rv.cast<S>();
+  double worst = 0;
+  for (unsigned t = 0; t < steps; t++) {
+    MatrixT g = (MatrixXd::Random(rows, cols) * 0.1).cast<T>();
+    adam_reference(rw, rm, rv, g.template cast<double>(), b1, b2, lr, eps, t);
+    Kernels::adam_update(w, m, v, g, Kernels::adam_step_t(b1, b2, lr, eps, t));
+    worst = std::max({worst,
+                      max_rel_error(w.template cast<double>(), rw),
+                      max_rel_error(m.template cast<double>(), rm),
+                      max_rel_error(v.template cast<double>(), rv)});
+  }
+  bool ok = worst <= tolerance;
+  printf("adam %4ldx%-4ld %-6s/%-6s max relative error %.3e %s\n", (long)rows, (long)cols,
+         sizeof(T) == sizeof(float) ? "float" : "double",
+         sizeof(S) == sizeof(float) ? "float" : "double",
+         worst, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+// Bitwise equality. The fused kernels below keep the operation order of
+// the layers they replace so they must not differ in a single bit.
+template<typename A, typename B>
+static bool same(const A& a, const B& b)
+{
+  return a.rows() == b.rows() && a.cols() == b.cols() &&
+         std::memcmp(a.data(), b.data(), sizeof(*a.data()) * static_cast<size_t>(a.size())) == 0;
+}
+
+// NNDenseReLULayer against NNDenseLayer followed by NNActivationReLULayer.
+// Forward: X*W + b then ReLU. Backward: the ReLU mask on the incoming
+// gradient, then the dense layer gradients.
+static bool check_dense_relu(Eigen::Index rows, Eigen::Index inputs, Eigen::Index neurons)
+{
+  const MatrixXs X = MatrixXs::Random(rows, inputs);
+  const MatrixXs W = MatrixXs::Random(inputs, neurons) * nn_scalar_t(0.1);
+  const RowVectorXs b = RowVectorXs::Random(neurons) * nn_scalar_t(0.1);
+  const MatrixXs dvalues = MatrixXs::Random(rows, neurons);
+
+  // Dense, then ReLU in place with its mask
+  MatrixXs ref = X * W;
+  ref.rowwise() += b;
+  NNBitMask ref_mask;
+  ref_mask.relu(ref);
+
+  // GEMM, then the fused bias/activation/mask pass
+  MatrixXs fused = X * W;
+  NNBitMask mask;
+  mask.resize(rows, neurons);
+  Kernels::bias_relu(fused.data(), rows, neurons, b.data(), mask.words());
+
+  bool ok = same(fused, ref);
+  for (Eigen::Index i = 0; i < mask.size(); i++)
+    ok &= mask.test(i) == ref_mask.test(i);
+
+  // Backward through each mask
+  MatrixXs ref_dv = dvalues, dv = dvalues;
+  ref_mask.apply(ref_dv);
+  mask.apply(dv);
+  ok &= same(MatrixXs(X.transpose() * dv), MatrixXs(X.transpose() * ref_dv));
+  ok &= same(RowVectorXs(dv.colwise().sum()), RowVectorXs(ref_dv.colwise().sum()));
+  ok &= same(MatrixXs(dv * W.transpose()), MatrixXs(ref_dv * W.transpose()));
+
+  printf("dense_relu %4ldx%-4ld x %4ldx%-4ld %s\n", (long)rows, (long)inputs,
+         (long)inputs, (long)neurons, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+// NNDenseLayer products banded over gemmThreads against the single
+// product each band is cut from. Every band is summed in the same order
+// so the results must be bitwise equal at any thread count.
+template<typename T>
+static bool check_gemm(Eigen::Index rows, Eigen::Index inputs, Eigen::Index neurons, unsigned threads)
+{
+  using MatrixT = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+  const MatrixT X = MatrixXd::Random(rows, inputs).cast<T>();
+  const MatrixT W = MatrixXd::Random(inputs, neurons).cast<T>();
+  const MatrixT dvalues = MatrixXd::Random(rows, neurons).cast<T>();
+  ThreadPool pool(threads);
+
+  MatrixT out(rows, neurons), dweights(inputs, neurons), dinputs(rows, inputs);
+  Kernels::gemm_rows(pool, out, X, W);
+  Kernels::gemm_dense_backward(pool, dweights, dinputs, X, dvalues, W);
+
+  MatrixT ref_out(rows, neurons), ref_dweights(inputs, neurons), ref_dinputs(rows, inputs);
+  ref_out.noalias() = X * W;
+  ref_dweights.noalias() = X.transpose() * dvalues;
+  ref_dinputs.noalias() = dvalues * W.transpose();
+
+  bool ok = same(out, ref_out) && same(dweights, ref_dweights) && same(dinputs, ref_dinputs);
+  printf("gemm %4ldx%-4ld x %4ldx%-4ld %-6s %2u threads %s\n", (long)rows, (long)inputs,
+         (long)inputs, (long)neurons, sizeof(T) == sizeof(float) ? "float" : "double",
+         threads, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+// Softmax, loss, predictions, accuracy and gradient of the unfused path:
+// NNActivationSoftmaxLayer::forward, NNLoss_CategoricalCrossEntropy::forward,
+// NNLossLayerAPI::predictions, NNAccuracyAPI::calculate and
+// NNActivationSoftmaxLayer::backward.
+template<typename T>
+static double softmax_cce_reference(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& z,
+                                    const Eigen::MatrixXi& y,
+                                    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& losses,
+                                    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& predictions,
+                                    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& dinputs)
+{
+  using MatrixT = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+  const Eigen::Index samples = z.rows();
+  const MatrixT row_max = z.rowwise().maxCoeff();
+  MatrixT probs = (z.colwise() - row_max.col(0)).array().exp();
+  const MatrixT row_sum = probs.rowwise().sum().reshaped(samples, 1);
+  probs.array().colwise() /= row_sum.col(0).array();
+
+  const T clip_min = static_cast<T>(1e-7);
+  const T clip_max = static_cast<T>(1-1e-7);
+  losses.resize(samples, 1);
+  for (Eigen::Index i = 0; i < samples; i++)
+    losses(i, 0) = -std::log(std::min(std::max(probs(i, y(i, 0)), clip_min), clip_max));
+
+  Eutils().argmax(predictions, probs);
+  const MatrixT labels = y.cast<T>();
+  const double accuracy = (predictions.array() == labels.array()).template cast<double>().mean();
+
+  dinputs = probs;
+  for (Eigen::Index i = 0; i < samples; i++)
+    dinputs(i, y(i, 0)) -= 1;
+  dinputs.array() /= static_cast<T>(samples);
+  return accuracy;
+}
+
+// NNLoss_SoftmaxCategoricalCrossEntropy against the unfused path. Logits
+// are scaled up to magnitudes where the unfused probabilities underflow
+// and get clipped. Predictions and accuracy must match exactly.
+template<typename T>
+static bool check_softmax_cce(Eigen::Index samples, Eigen::Index classes, double scale, double tolerance)
+{
+  using MatrixT = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+  const MatrixT z = (MatrixXd::Random(samples, classes) * scale).cast<T>();
+  Eigen::MatrixXi y(samples, 1);
+  for (Eigen::Index i = 0; i < samples; i++)
+    y(i, 0) = static_cast<int>(i % classes);
+
+  MatrixT ref_losses, ref_predictions, ref_dinputs;
+  const double ref_accuracy = softmax_cce_reference(z, y, ref_losses, ref_predictions, ref_dinputs);
+
+  MatrixT losses(samples, 1), predictions(samples, 1), dinputs(samples, classes);
+  const Eigen::Index correct = Kernels::softmax_cce(z, y, losses, predictions, &dinputs);
+  const double accuracy = static_cast<double>(correct) / static_cast<double>(samples);
+  // Without the gradient, as for validation and evaluation batches
+  MatrixT eval_losses(samples, 1), eval_predictions(samples, 1);
+  const Eigen::Index eval_correct = Kernels::softmax_cce<T>(z, y, eval_losses, eval_predictions, nullptr);
+
+  // Losses relative to 1 since the clipped ones sit near log(1e-7)
+  const double loss_error = (losses - ref_losses).template cast<double>().cwiseAbs().maxCoeff() /
+                            std::max(1., ref_losses.template cast<double>().cwiseAbs().maxCoeff());
+  const double worst = std::max(loss_error, max_rel_error(dinputs.template cast<double>(),
+                                                          ref_dinputs.template cast<double>()));
+  const bool ok = worst <= tolerance && same(predictions, ref_predictions) && accuracy == ref_accuracy &&
+                  same(eval_losses, losses) && same(eval_predictions, predictions) && eval_correct == correct;
+  printf("softmax_cce %4ldx%-4ld %-6s logits x%-6g max relative error %.3e %s\n",
+         (long)samples, (long)classes, sizeof(T) == sizeof(float) ? "float" : "double",
+         scale, worst, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+// The kernels run on the layers' preallocated buffers in every training
+// step after the first, so they must not touch the heap. Eigen asserts if
+// one allocates while allocation is forbidden.
+static bool check_no_malloc()
+{
+#ifdef NN_CHECK_NO_MALLOC
+  const Eigen::Index rows = 128, neurons = 128, classes = 10;
+  MatrixXd w = MatrixXd::Random(neurons, neurons);
+  MatrixXd m = MatrixXd::Zero(neurons, neurons), v = MatrixXd::Zero(neurons, neurons);
+  const MatrixXd g = MatrixXd::Random(neurons, neurons) * 0.1;
+  MatrixXs z = MatrixXs::Random(rows, neurons);
+  const RowVectorXs b = RowVectorXs::Random(neurons);
+  NNBitMask mask;
+  mask.resize(rows, neurons);
+  MatrixXs dvalues = MatrixXs::Random(rows, neurons);
+  const MatrixXs logits = MatrixXs::Random(rows, classes) * 10;
+  Eigen::MatrixXi y(rows, 1);
+  for (Eigen::Index i = 0; i < rows; i++)
+    y(i, 0) = static_cast<int>(i % classes);
+  MatrixXs losses(rows, 1), predictions(rows, 1), dinputs(rows, classes);
+
+  Eigen::internal::set_is_malloc_allowed(false);
+  Kernels::adam_update(w, m, v, g, Kernels::adam_step_t(0.9, 0.999, 0.005, 1e-7, 0));
+  Kernels::bias_relu(z.data(), rows, neurons, b.data(), mask.words());
+  mask.apply(dvalues);
+  Kernels::softmax_cce(logits, y, losses, predictions, &dinputs);
+  Eigen::internal::set_is_malloc_allowed(true);
+  printf("no heap allocation in adam_update, bias_relu, NNBitMask::apply, softmax_cce ok\n");
+#else
+  printf("heap allocation check skipped (NDEBUG)\n");
+#endif
+  return true;
+}
+
+// Write m as a checkpoint block and read it back into r, possibly at the
+// other floating point width
+template<typename M, typename R>
+static bool checkpoint_trip(const M& m, R& r)
+{
+  std::vector<char> block(EigenBlock::bytes(m));
+  std::memcpy(block.data(), m.data(), block.size());
+  size_t pos = 0;
+  r.resize(m.rows(), m.cols());
+  bool ok = EigenBlock::unpack(r, sizeof(typename M::Scalar), [&](void* p, size_t n) {
+    std::memcpy(p, block.data() + pos, n);
+    pos += n;
+  });
+  return ok && pos == block.size();
+}
+
+// A checkpoint taken by a double build restored by a float build and back,
+// as eigen_serialize.h does on UNPACK. The same width must restore every
+// bit. Integer matrices can not change width.
+static bool check_checkpoint_block(Eigen::Index rows, Eigen::Index cols)
+{
+  const MatrixXd d = MatrixXd::Random(rows, cols) * 1e3;
+  const Eigen::MatrixXf f = Eigen::MatrixXf::Random(rows, cols);
+  MatrixXd dd, fd, dfd;
+  Eigen::MatrixXf ff, df;
+  bool ok = checkpoint_trip(d, dd) && same(dd, d);
+  ok &= checkpoint_trip(f, ff) && same(ff, f);
+  ok &= checkpoint_trip(d, df) && same(df, Eigen::MatrixXf(d.cast<float>()));
+  ok &= checkpoint_trip(f, fd) && same(fd, MatrixXd(f.cast<double>()));
+  ok &= checkpoint_trip(df, dfd) && same(dfd, MatrixXd(d.cast<float>().cast<double>()));
+  const double err = max_rel_error(dfd, d);
+  ok &= err < 1e-6;
+  Eigen::MatrixXi i = Eigen::MatrixXi::Zero(rows, cols);
+  ok &= !EigenBlock::unpack(i, sizeof(double), [](void*, size_t) {});
+  printf("checkpoint block %4ldx%-4ld double->float->double max relative error %.3e %s\n",
+         (long)rows, (long)cols, err, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+template<typename F>
+static double seconds(unsigned iterations, F f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; i++)
+    f(i);
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+  return d.count();
+}
+
+static void bench_adam(Eigen::Index rows, Eigen::Index cols, unsigned iterations)
+{
+  const double b1 = 0.9, b2 = 0.999, lr = 0.005, eps = 1e-7;
+  MatrixXd w = MatrixXd::Random(rows, cols);
+  MatrixXd m = MatrixXd::Zero(rows, cols);
+  MatrixXd v = MatrixXd::Zero(rows, cols);
+  MatrixXd g = MatrixXd::Random(rows, cols) * 0.1;
+  // 4 streams read (w, m, v, g) and 3 written (w, m, v) per update
+  const double bytes = 7. * sizeof(double) * static_cast<double>(rows * cols) * iterations;
+  double tref = seconds(iterations, [&](unsigned t) {
+    adam_reference(w, m, v, g, b1, b2, lr, eps, t);
+  });
+  double tfused = seconds(iterations, [&](unsigned t) {
+    Kernels::adam_update(w, m, v, g, Kernels::adam_step_t(b1, b2, lr, eps, t));
+  });
+  printf("adam %4ldx%-4ld reference %8.3f us %6.2f GB/s  fused %8.3f us %6.2f GB/s  speedup %.2fx\n",
+         (long)rows, (long)cols,
+         1e6 * tref / iterations, bytes / tref / 1e9,
+         1e6 * tfused / iterations, bytes / tfused / 1e9,
+         tref / tfused);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned iterations = argc > 1 ? static_cast<unsigned>(atoi(argv[1])) : 200;
+  // layer shapes from the test networks: 784x128, 128x128, 128x10 and bias rows.
+  // Odd shapes exercise the scalar tail.
+  const Eigen::Index shapes[][2] = {{784, 128}, {128, 128}, {128, 10}, {1, 128}, {1, 10}, {7, 3}};
+
+  bool ok = true;
+  for (auto& s : shapes) {
+    ok &= check_adam<double, double>(s[0], s[1], 20, ADAM_TOLERANCE);
+    ok &= check_adam<float, float>(s[0], s[1], 20, ADAM_FLOAT_TOLERANCE);
+    ok &= check_adam<float, double>(s[0], s[1], 20, ADAM_FLOAT_TOLERANCE);
+  }
+  // batch x inputs x neurons of the dense/ReLU pairs. Odd shapes leave a
+  // partial mask word.
+  const Eigen::Index dense_shapes[][3] = {{1, 784, 32}, {8, 32, 32}, {128, 784, 128},
+                                          {128, 128, 128}, {7, 3, 5}};
+  for (auto& d : dense_shapes)
+    ok &= check_dense_relu(d[0], d[1], d[2]);
+  // batch x classes of the loss layer, logits of growing magnitude. A zero
+  // scale ties every class.
+  const Eigen::Index loss_shapes[][2] = {{1, 10}, {8, 10}, {128, 10}, {129, 3}};
+  for (auto& d : loss_shapes) {
+    for (double scale : {0., 1., 30., 1e3}) {
+      ok &= check_softmax_cce<double>(d[0], d[1], scale, 1e-12);
+      ok &= check_softmax_cce<float>(d[0], d[1], scale, 1e-5);
+    }
+  }
+  // Banded products, including bands that do not divide the batch
+  const Eigen::Index gemm_shapes[][3] = {{1, 784, 32}, {8, 32, 32}, {17, 784, 32},
+                                         {128, 784, 128}, {129, 128, 10}, {37, 50, 13}};
+  for (auto& d : gemm_shapes) {
+    for (unsigned threads : {1u, 2u, 3u, 4u, 16u}) {
+      ok &= check_gemm<double>(d[0], d[1], d[2], threads);
+      ok &= check_gemm<float>(d[0], d[1], d[2], threads);
+    }
+  }
+  ok &= check_no_malloc();
+  for (auto& s : shapes)
+    ok &= check_checkpoint_block(s[0], s[1]);
+  for (auto& s : shapes)
+    bench_adam(s[0], s[1], iterations);
+
+  printf("%s\n", ok ? "nn-kernels PASS" : "nn-kernels FAIL");
+  return ok ? 0 : 1;
+}
+
+// EOF
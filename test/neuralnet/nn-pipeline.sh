@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Small simulation with several training batches in flight on 2 threads.
+# The training images are reshuffled every epoch and gathered ahead on
+# the prefetch thread. Evaluation images go through in batches and the
+# dense layers split their matrix products over 2 threads.
+
+mkdir -p run
+cd run
+
+SSTOPTS='-n 2'
+
+IMAGE_DATA=$(realpath "../../../image_data")
+
+verbose=0
+if [ ! -z "${VERBOSE}" ]; then
+    verbose=${VERBOSE}
+fi
+
+depth=4
+if [ $# -ne 0 ]; then
+ depth=$1
+fi
+
+echo "Running small simulation with pipelineDepth=${depth}"
+sst ../test-image.py ${SSTOPTS} --verbose=${VERBOSE} -- \
+    --batchSize=1 \
+    --classImageLimit=4 \
+    --epochs=4 \
+    --evalBatchSize=8 \
+    --fuseSoftmaxLoss=1 \
+    --gemmThreads=2 \
+    --evalImages="${IMAGE_DATA}/eval" \
+    --hiddenLayerSize=32 \
+    --initialWeightScaling=0.01 \
+    --pipelineDepth=${depth} \
+    --prefetchDepth=2 \
+    --shuffleSeed=7 \
+    --testImages="${IMAGE_DATA}/fashion_mnist_images/test" \
+    --trainingImages="${IMAGE_DATA}/fashion_mnist_images/train" \
+    --verbose=${verbose}
+
+wait
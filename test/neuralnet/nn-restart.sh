@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Mid-training restart. The small simulation runs once straight through
+# and once with checkpoints, then restarts from the first checkpoint. The
+# restarted run must finish with the same epoch loss and accuracy and the
+# same predictions as the uninterrupted one. The controller reloads the
+# datasets and rebuilds the shuffled order on restart, and the batches
+# are gathered ahead on the prefetch thread (prefetchDepth=2) or on the
+# simulation thread (prefetchDepth=0).
+
+mkdir -p run
+cd run
+
+IMAGE_DATA=$(realpath "../../../image_data")
+
+# verbose must be at least 2 for the epoch summaries compared below
+verbose=2
+
+logs=nn-restart.logs
+rm -rf ${logs}
+mkdir -p ${logs}
+
+run() {
+    sst ../test-image.py "$@" -- \
+        --batchSize=1 \
+        --classImageLimit=4 \
+        --epochs=4 \
+        --evalImages="${IMAGE_DATA}/eval" \
+        --hiddenLayers=5 \
+        --hiddenLayerSize=32 \
+        --initialWeightScaling=0.01 \
+        --shuffleSeed=7 \
+        --testImages="${IMAGE_DATA}/fashion_mnist_images/test" \
+        --trainingImages="${IMAGE_DATA}/fashion_mnist_images/train" \
+        --verbose=${verbose} \
+        ${config}
+}
+
+results() {
+    grep -E "epoch [0-9]+ (training|validation):|Survey says" $1
+}
+
+n=0
+for config in "--prefetchDepth=2 --pipelineDepth=2" "--prefetchDepth=0 --pipelineDepth=1"; do
+    n=$((n+1))
+    pfx=nn-restart-${n}
+    rm -rf ${pfx}
+
+    echo "### ${config}: reference run"
+    run > ${logs}/${n}-ref.log
+    if [ $? != 0 ]; then
+        echo "error: reference simulation failed"
+        exit 1
+    fi
+
+    echo "### ${config}: creating checkpoints"
+    run --checkpoint-period=1ms --checkpoint-prefix=${pfx} > ${logs}/${n}-save.log
+    if [ $? != 0 ]; then
+        echo "error: checkpoint save failed"
+        exit 2
+    fi
+
+    cpt=$(find ${pfx} -name "*.sstcpt" | sort -V | head -1)
+    if [ -z "${cpt}" ]; then
+        echo "error: no checkpoint in ${pfx}"
+        exit 3
+    fi
+
+    echo "### ${config}: restarting from ${cpt}"
+    sst --load-checkpoint ${cpt} > ${logs}/${n}-restart.log
+    if [ $? != 0 ]; then
+        echo "error: checkpoint load failed for ${cpt}"
+        exit 4
+    fi
+
+    results ${logs}/${n}-ref.log > ${logs}/${n}-ref.txt
+    results ${logs}/${n}-restart.log > ${logs}/${n}-restart.txt
+    ref=$(wc -l < ${logs}/${n}-ref.txt)
+    restarted=$(wc -l < ${logs}/${n}-restart.txt)
+    # The checkpoint must be taken during training, before the last epoch
+    grep -q "training:" ${logs}/${n}-restart.txt
+    if [ $? != 0 ] || [ ${restarted} -ge ${ref} ]; then
+        echo "error: ${cpt} was not taken during training"
+        exit 5
+    fi
+    tail -n ${restarted} ${logs}/${n}-ref.txt | diff - ${logs}/${n}-restart.txt
+    if [ $? != 0 ]; then
+        echo "error: restarted results differ from the uninterrupted run"
+        exit 6
+    fi
+    grep "Simulation is complete" ${logs}/${n}-restart.log
+done
+
+# for ctest pass regexp
+echo "nn-restart PASS"
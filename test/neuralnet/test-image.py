@@ -17,12 +17,26 @@ parser = argparse.ArgumentParser(description="test image")
 
 parser.add_argument("--batchSize",            type=int,   help="number of images for each training batch", default=128)
 parser.add_argument("--classImageLimit",      type=int,   help="limited the number of images loaded per class", default=100000)
+parser.add_argument("--computeLatency",       type=str,   help="simulated time of each layer pass with eventDriven", default="1ns")
 parser.add_argument("--epochs",               type=int,   help="number of training rounds", default=1)
+parser.add_argument("--evalBatchSize",        type=int,   help="number of images for each evaluation batch", default=1)
 parser.add_argument("--evalImage",            type=str,   help="path to a single evaluation image", default="")
 parser.add_argument("--evalImages",           type=str,   help="path to a collection of evaluation images", default="")
+parser.add_argument("--eventDriven",          type=int,   help="run layer passes from self-link events instead of the clock", default=0)
+parser.add_argument("--fuseReLU",             type=int,   help="fuse each hidden dense layer with its ReLU activation", default=0)
+parser.add_argument("--fuseSoftmaxLoss",      type=int,   help="fuse the softmax activation into the cross-entropy loss", default=0)
+parser.add_argument("--fusedNetwork",         type=int,   help="run every layer inside one network component", default=0)
+parser.add_argument("--gemmThreads",          type=int,   help="threads for each dense layer's matrix products", default=1)
 parser.add_argument("--hiddenLayers",         type=int,   help="number of hidden layers (3 minimum)", default=3)
 parser.add_argument("--hiddenLayerSize",      type=int,   help="number of neurons in each hidden layer", default=128)
 parser.add_argument("--initialWeightScaling", type=float, help="scaling factor for random weights", default=0.1)
+parser.add_argument("--layerOverhead",        type=str,   help="device model: fixed time added to every layer pass", default="0ns")
+parser.add_argument("--layerStatistics",      type=int,   help="print per-layer work and modeled time statistics", default=0)
+parser.add_argument("--memBandwidth",         type=float, help="device model: memory bandwidth in bytes/s (0 ignores memory traffic)", default=0)
+parser.add_argument("--peakFlops",            type=float, help="device model: peak FLOP/s (0 turns the latency model off)", default=0)
+parser.add_argument("--pipelineDepth",        type=int,   help="training batches in flight (1 waits for each backward pass)", default=1)
+parser.add_argument("--prefetchDepth",        type=int,   help="training batches gathered ahead on a background thread", default=0)
+parser.add_argument("--shuffleSeed",          type=int,   help="seed for reshuffling the training images each epoch (0 keeps the load order)", default=0)
 parser.add_argument("--testImages",           type=str,   help="path to test data organized in class subdirectories", default="")
 parser.add_argument("--trainingImages",       type=str,   help="path to training data organized in class subdirectories", default="")
 parser.add_argument("--verbose",              type=int,   help="verbosity", default=1)
@@ -45,8 +59,12 @@ batch_controller_params = {
   "batchSize" : args.batchSize,
   "classImageLimit" : args.classImageLimit,
   "epochs" : args.epochs,
+  "evalBatchSize" : args.evalBatchSize,
   "evalImage" : args.evalImage,
   "evalImages" : args.evalImages,
+  "pipelineDepth" : args.pipelineDepth,
+  "prefetchDepth" : args.prefetchDepth,
+  "shuffleSeed" : args.shuffleSeed,
   "testImages" : args.testImages,
   "trainingImages" : args.trainingImages,
   "verbose" : args.verbose,
@@ -62,15 +80,19 @@ optimizer_params = {
   "verbose" : args.verbose,
 }
 
+def dense_params(inputs, neurons):
+  return {
+    "nInputs" : inputs, "nNeurons" : neurons,
+    "gemmThreads" : args.gemmThreads,
+    "initialWeightScaling" : args.initialWeightScaling,
+    "verbose" : args.verbose }
+
 class DenseLayer():
-  def __init__(self, name, inputs, neurons):
+  def __init__(self, name, inputs, neurons, transfer="neuralnet.NNDenseLayer"):
     self.comp =  sst.Component(name,  "neuralnet.NNLayer")
     self.transfer_function = self.comp.setSubComponent( 
-      "transfer_function", "neuralnet.NNDenseLayer" )
-    self.transfer_function.addParams({ 
-      "nInputs" : inputs, "nNeurons" : neurons,
-      "initialWeightScaling" : args.initialWeightScaling,
-      "verbose" : args.verbose })
+      "transfer_function", transfer )
+    self.transfer_function.addParams( dense_params(inputs, neurons) )
     self.optimizer = self.comp.setSubComponent(
       "optimizer", "neuralnet.NNAdamOptimizer" )
     self.optimizer.addParams({ "verbose" : args.verbose })
@@ -92,7 +114,7 @@ class Softmax():
     self.tranfer_function.addParams( {"verbose" : args.verbose} )
 
 class Loss_CategoricalCrossEntropy:
-  def __init__(self, name):
+  def __init__(self, name, loss="neuralnet.NNLoss_CategoricalCrossEntropy"):
     self.comp = sst.Component(name,    "neuralnet.NNLayer")
     self.comp.addParams({ 
       "lastComponent" : 1,
@@ -101,11 +123,34 @@ class Loss_CategoricalCrossEntropy:
     self.transfer_function.addParams({ "verbose" : args.verbose })
     self.accuracy_function = self.comp.setSubComponent( "accuracy_function", "neuralnet.NNAccuracyCategorical")
     self.accuracy_function.addParams( {"verbose" : args.verbose} );
-    self.loss_function = self.comp.setSubComponent( "loss_function", "neuralnet.NNLoss_CategoricalCrossEntropy")
+    self.loss_function = self.comp.setSubComponent( "loss_function", loss)
     self.loss_function.addParams( {"verbose" : args.verbose} )
     self.optimizer = self.comp.setSubComponent( "optimizer", "neuralnet.NNAdamOptimizer" )
     self.optimizer.addParams( optimizer_params )
 
+# All layers as numbered subcomponent slots of one component
+class FusedNetwork():
+  def __init__(self, name):
+    self.comp = sst.Component(name, "neuralnet.NNFusedNetwork")
+    self.comp.addParams( {"verbose" : args.verbose} )
+    self.slots = 0
+  def layer(self, transfer, params={}):
+    self.transfer_function = self.comp.setSubComponent("transfer_function", transfer, self.slots)
+    self.transfer_function.addParams( {"verbose" : args.verbose} )
+    self.transfer_function.addParams(params)
+    self.slots += 1
+  def dense(self, inputs, neurons, transfer="neuralnet.NNDenseLayer"):
+    self.optimizer = self.comp.setSubComponent("optimizer", "neuralnet.NNAdamOptimizer", self.slots)
+    self.optimizer.addParams( optimizer_params )
+    self.layer(transfer, dense_params(inputs, neurons))
+  def loss(self, loss="neuralnet.NNLoss_CategoricalCrossEntropy"):
+    self.accuracy_function = self.comp.setSubComponent("accuracy_function", "neuralnet.NNAccuracyCategorical")
+    self.accuracy_function.addParams( {"verbose" : args.verbose} )
+    self.loss_function = self.comp.setSubComponent("loss_function", loss)
+    self.loss_function.addParams( {"verbose" : args.verbose} )
+    self.loss_optimizer = self.comp.setSubComponent("loss_optimizer", "neuralnet.NNAdamOptimizer")
+    self.loss_optimizer.addParams( optimizer_params )
+
 # Model construction
 comps = []
 forward_links = []
@@ -116,21 +161,71 @@ comps.append(sst.Component("batch_controller", "neuralnet.NNBatchController"))
 comps[-1].addParams(batch_controller_params)
 
 # Input Layer
-input = sst.Component("input",   "neuralnet.NNLayer")
-input.setSubComponent("transfer_function", "neuralnet.NNInputLayer")
-comps.append(input)
+# With fusedNetwork the layers below are added to this one component
+if args.fusedNetwork:
+  net = FusedNetwork("network")
+  net.layer("neuralnet.NNInputLayer")
+  comps.append(net.comp)
+else:
+  input = sst.Component("input",   "neuralnet.NNLayer")
+  input.setSubComponent("transfer_function", "neuralnet.NNInputLayer")
+  comps.append(input)
 
 # Hidden Layers
-comps.append(DenseLayer("dense1", image_size, args.hiddenLayerSize).comp)
-comps.append(ReLU("relu1").comp)
+# With fuseReLU each dense/relu component pair becomes one component
+def HiddenLayer(i, inputs, neurons):
+  if args.fusedNetwork:
+    if args.fuseReLU:
+      net.dense(inputs, neurons, "neuralnet.NNDenseReLULayer")
+    else:
+      net.dense(inputs, neurons)
+      net.layer("neuralnet.NNActivationReLULayer")
+  elif args.fuseReLU:
+    comps.append(DenseLayer(f"dense{i}", inputs, neurons, "neuralnet.NNDenseReLULayer").comp)
+  else:
+    comps.append(DenseLayer(f"dense{i}", inputs, neurons).comp)
+    comps.append(ReLU(f"relu{i}").comp)
+
+HiddenLayer(1, image_size, args.hiddenLayerSize)
 for i in range(2, args.hiddenLayers):
-  comps.append(DenseLayer(f"dense{i}", args.hiddenLayerSize, args.hiddenLayerSize).comp)
-  comps.append(ReLU(f"relu{i}").comp)
-comps.append(DenseLayer(f"dense{args.hiddenLayers}", args.hiddenLayerSize, 10).comp)
+  HiddenLayer(i, args.hiddenLayerSize, args.hiddenLayerSize)
+if args.fusedNetwork:
+  net.dense(args.hiddenLayerSize, 10)
+else:
+  comps.append(DenseLayer(f"dense{args.hiddenLayers}", args.hiddenLayerSize, 10).comp)
 
 # Output Layers
-comps.append(Softmax("softmax").comp)
-comps.append(Loss_CategoricalCrossEntropy("loss").comp)
+# With fuseSoftmaxLoss the loss component takes the logits directly
+if args.fusedNetwork:
+  if args.fuseSoftmaxLoss:
+    net.loss("neuralnet.NNLoss_SoftmaxCategoricalCrossEntropy")
+  else:
+    net.layer("neuralnet.NNActivationSoftmaxLayer")
+    net.loss()
+elif args.fuseSoftmaxLoss:
+  comps.append(Loss_CategoricalCrossEntropy("loss", "neuralnet.NNLoss_SoftmaxCategoricalCrossEntropy").comp)
+else:
+  comps.append(Softmax("softmax").comp)
+  comps.append(Loss_CategoricalCrossEntropy("loss").comp)
+
+# Event driven layers run their passes from a self-link event. With a
+# device model each layer holds its outputs back for the modeled pass time.
+if args.eventDriven or args.peakFlops > 0 or args.layerStatistics:
+  if args.fusedNetwork:
+    print("eventDriven, peakFlops and layerStatistics require one component per layer", file=sys.stderr)
+    sys.exit(1)
+  for comp in comps[1:]:
+    comp.addParams({
+      "eventDriven" : args.eventDriven,
+      "computeLatency" : args.computeLatency,
+      "peakFlops" : args.peakFlops,
+      "memBandwidth" : args.memBandwidth,
+      "layerOverhead" : args.layerOverhead })
+
+if args.layerStatistics:
+  sst.setStatisticLoadLevel(1)
+  sst.setStatisticOutput("sst.statOutputConsole")
+  sst.enableAllStatisticsForComponentType("neuralnet.NNLayer", {"type" : "sst.AccumulatorStatistic"})
 
 # Connections
 for i in range(len(comps)):